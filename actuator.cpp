@@ -1,9 +1,8 @@
-#include <wiringPi.h>
-#include <softPwm.h>
 #include <stdlib.h>
 #include "actuator.h"
 #include "constants.h"
 #include "utils.h"
+#include "hal.h"
 
 //////////////////////////////////////////////
 // Buzzer
@@ -11,13 +10,13 @@
 
 bool Buzzer::onInit(const struct timespec& time)
 {
-	pinMode(mPin, OUTPUT);
-	digitalWrite(mPin, LOW);
+	Hal::pinMode(mPin, OUTPUT);
+	Hal::digitalWrite(mPin, LOW);
 	return true;
 }
 void Buzzer::onClean()
 {
-	digitalWrite(mPin, LOW);
+	Hal::digitalWrite(mPin, LOW);
 }
 bool Buzzer::onCommand(const std::vector<std::string>& args)
 {
@@ -114,19 +113,19 @@ void Buzzer::start(int on_period, int off_period, int count)
 		mOffPeriodMemory = off_period;
 		mOffPeriod		 = 0;
 		mCount			 = count;
-		digitalWrite(mPin, HIGH);
+		Hal::digitalWrite(mPin, HIGH);
 	}
 }
 void Buzzer::restart()
 {
-	digitalWrite(mPin, HIGH);
+	Hal::digitalWrite(mPin, HIGH);
 	mOnPeriod = mOnPeriodMemory;
 	mOffPeriod = 0;
 }
 void Buzzer::stop()
 {
 	mOnPeriod = 0;
-	digitalWrite(mPin, LOW);
+	Hal::digitalWrite(mPin, LOW);
 
 	if(mCount == 1)
 	{
@@ -154,12 +153,12 @@ Buzzer::~Buzzer()
 
 bool ParaServo::onInit(const struct timespec& time)
 {
-	if (wiringPiSetup() == -1)//Software PWMを使う前にwiringPiSetupを呼ぶ必要があるらしい
+	if (!Hal::setup())//Software PWMを使う前にwiringPiSetupを呼ぶ必要があるらしい
 	{
 		Debug::print(LOG_PRINT,"ParaServoError: wiringPi setup failed...\n");
 	}
 
-	softPwmCreate(mPin, 0, SERVO_RANGE);	//int softPwmCreate (int pin, int initialValue, int pwmRange);
+	Hal::softPwmCreate(mPin, 0, SERVO_RANGE);	//int softPwmCreate (int pin, int initialValue, int pwmRange);
 	return true;
 }
 void ParaServo::onClean()
@@ -212,7 +211,7 @@ void ParaServo::start(int angle)
 		angle = SERVO_MIN_RANGE;
 	}
 
-	softPwmWrite(mPin, angle);			//void softPwmWrite (int pin, int value);
+	Hal::softPwmWrite(mPin, angle);			//void softPwmWrite (int pin, int value);
 	Debug::print(LOG_PRINT,"ParaServo Start (%d)!\r\n",angle);
 }
 void ParaServo::start(POSITION p)
@@ -221,7 +220,7 @@ void ParaServo::start(POSITION p)
 }
 void ParaServo::stop()
 {
-	softPwmWrite (mPin, 0);
+	Hal::softPwmWrite(mPin, 0);
 }
 void ParaServo::moveRelease()
 {
@@ -246,11 +245,11 @@ ParaServo::~ParaServo()
 
 bool StabiServo::onInit(const struct timespec& time)
 {
-	pinMode(mPin, PWM_OUTPUT);
+	Hal::pinMode(mPin, PWM_OUTPUT);
 
-	pwmSetMode(PWM_MODE_MS);
-	pwmSetRange(9000);
-	pwmSetClock(32);
+	Hal::pwmSetMode(PWM_MODE_MS);
+	Hal::pwmSetRange(9000);
+	Hal::pwmSetClock(32);
 
 	return true;
 }
@@ -296,17 +295,17 @@ void StabiServo::start(double angle)
 	if(angle > 0.88)angle = 0.88;
 	else if(angle < 0)angle = 0;
 
-	pwmWrite (mPin, SERVO_BASE_VALUE + angle * SERVO_MOVABLE_RANGE);
+	Hal::pwmWrite(mPin, SERVO_BASE_VALUE + angle * SERVO_MOVABLE_RANGE);
 	Debug::print(LOG_DETAIL,"StabiServo Start (%f)!\r\n",angle);
 }
 void StabiServo::stop()
 {
-	pwmWrite (mPin, 0);
+	Hal::pwmWrite(mPin, 0);
 	Debug::print(LOG_DETAIL,"StabiServo Stop!\r\n");
 }
 void StabiServo::close()
 {
-	pwmWrite(mPin, SERVO_BASE_VALUE);
+	Hal::pwmWrite(mPin, SERVO_BASE_VALUE);
 	Debug::print(LOG_DETAIL,"StabiServo Close!\r\n");
 }
 StabiServo::StabiServo() : mPin(PIN_STABI_SERVO)
@@ -325,11 +324,11 @@ StabiServo::~StabiServo()
 /*
 bool CameraServo::onInit(const struct timespec& time)
 {
-	pinMode(mPin, PWM_OUTPUT);
+	Hal::pinMode(mPin, PWM_OUTPUT);
 
-	pwmSetMode(PWM_MODE_MS);
-	pwmSetRange(9000);
-	pwmSetClock(32);
+	Hal::pwmSetMode(PWM_MODE_MS);
+	Hal::pwmSetRange(9000);
+	Hal::pwmSetClock(32);
 
 	return true;
 }
@@ -376,17 +375,17 @@ void CameraServo::start(double angle)
 	if(angle > 0.6)angle = 0.6;
 	else if(angle < 0.4)angle = 0.4;
 
-	pwmWrite (mPin, SERVO_BASE_VALUE + angle * SERVO_MOVABLE_RANGE);
+	Hal::pwmWrite(mPin, SERVO_BASE_VALUE + angle * SERVO_MOVABLE_RANGE);
 	Debug::print(LOG_DETAIL,"CameraServo Start (%f)!\r\n",angle);
 }
 void CameraServo::stop()
 {
-	pwmWrite (mPin, 0);
+	Hal::pwmWrite(mPin, 0);
 	Debug::print(LOG_DETAIL,"CameraServo Stop!\r\n");
 }
 void CameraServo::close()
 {
-	pwmWrite(mPin, SERVO_BASE_VALUE);
+	Hal::pwmWrite(mPin, SERVO_BASE_VALUE);
 	Debug::print(LOG_DETAIL,"CameraServo Close!\r\n");
 }
 CameraServo::CameraServo() : mPin(PIN_CAMERA_SERVO)
@@ -405,13 +404,13 @@ CameraServo::~CameraServo()
 
 bool SoftCameraServo::onInit(const struct timespec& time)
 {
-	if (wiringPiSetup() == -1)//Software PWMを使う前にwiringPiSetupを呼ぶ必要があるらしい
+	if (!Hal::setup())//Software PWMを使う前にwiringPiSetupを呼ぶ必要があるらしい
 	{
 		Debug::print(LOG_PRINT,"SoftCameraServoError: wiringPi setup failed...\n");
 	}
 
 	//pinMode(mPin, OUTPUT); //ピンを出力モードにするっぽい
-	softPwmCreate(mPin, 0, SERVO_RANGE);	//int softPwmCreate (int pin, int initialValue, int pwmRange);
+	Hal::softPwmCreate(mPin, 0, SERVO_RANGE);	//int softPwmCreate (int pin, int initialValue, int pwmRange);
 	return true;
 }
 void SoftCameraServo::onClean()
@@ -464,7 +463,7 @@ void SoftCameraServo::start(int angle)
 		angle = SERVO_MIN_RANGE;
 	}
 
-	softPwmWrite(mPin, angle);			//void softPwmWrite (int pin, int value);
+	Hal::softPwmWrite(mPin, angle);			//void softPwmWrite (int pin, int value);
 	Debug::print(LOG_PRINT,"SoftCameraServo Start (%d)!\r\n",angle);
 }
 void SoftCameraServo::start(POSITION p)
@@ -473,7 +472,7 @@ void SoftCameraServo::start(POSITION p)
 }
 void SoftCameraServo::stop()
 {
-	softPwmWrite (mPin, 0);
+	Hal::softPwmWrite(mPin, 0);
 }
 void SoftCameraServo::moveRelease()
 {
@@ -498,12 +497,12 @@ SoftCameraServo::~SoftCameraServo()
 
 bool BackStabiServo::onInit(const struct timespec& time)
 {
-	if (wiringPiSetup() == -1)//Software PWMを使う前にwiringPiSetupを呼ぶ必要があるらしい
+	if (!Hal::setup())//Software PWMを使う前にwiringPiSetupを呼ぶ必要があるらしい
 	{
 		Debug::print(LOG_PRINT,"BackStabiServoError: wiringPi setup failed...\n");
 	}
 
-	softPwmCreate(mPin, 0, SERVO_RANGE);	//int softPwmCreate (int pin, int initialValue, int pwmRange);
+	Hal::softPwmCreate(mPin, 0, SERVO_RANGE);	//int softPwmCreate (int pin, int initialValue, int pwmRange);
 	//SERVO_RANGE　各種の定数はactuator.h 中
 	return true;
 }
@@ -557,7 +556,7 @@ void BackStabiServo::start(int angle)
 		angle = SERVO_MIN_RANGE;
 	}
 
-	softPwmWrite(mPin, angle);			//void softPwmWrite (int pin, int value);
+	Hal::softPwmWrite(mPin, angle);			//void softPwmWrite (int pin, int value);
 	Debug::print(LOG_PRINT,"BackStabiServo Start (%d)!\r\n",angle);
 }
 void BackStabiServo::start(POSITION p)
@@ -566,7 +565,7 @@ void BackStabiServo::start(POSITION p)
 }
 void BackStabiServo::stop()
 {
-	softPwmWrite (mPin, 0);
+	Hal::softPwmWrite(mPin, 0);
 }
 void BackStabiServo::moveRelease()
 {
@@ -597,13 +596,13 @@ BackStabiServo::~BackStabiServo()
 /*bool XBeeSleep::onInit(const struct timespec& time)
 {
 	mPin = PIN_XBEE_SLEEP;
-	pinMode(mPin, OUTPUT);
-	digitalWrite(mPin, LOW);
+	Hal::pinMode(mPin, OUTPUT);
+	Hal::digitalWrite(mPin, LOW);
 	return true;
 }
 void XBeeSleep::onClean()
 {
-	digitalWrite(mPin, LOW);
+	Hal::digitalWrite(mPin, LOW);
 }
 bool XBeeSleep::onCommand(const std::vector<std::string>& args)
 {
@@ -628,7 +627,7 @@ bool XBeeSleep::onCommand(const std::vector<std::string>& args)
 }
 void XBeeSleep::setState(bool sleep)
 {
-	digitalWrite(mPin, sleep ? HIGH : LOW);
+	Hal::digitalWrite(mPin, sleep ? HIGH : LOW);
 }
 XBeeSleep::XBeeSleep() : mPin(PIN_XBEE_SLEEP)
 {
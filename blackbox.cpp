@@ -0,0 +1,165 @@
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <string>
+#include "blackbox.h"
+#include "utils.h"
+#include "task.h"
+#include "sensor.h"
+#include "motor.h"
+
+int BlackBox::mFd = -1;
+BlackBoxHeader* BlackBox::mpHeader = NULL;
+BlackBoxRecord* BlackBox::mpRecords = NULL;
+size_t BlackBox::mMapSize = 0;
+unsigned long long BlackBox::mStartTime = 0;
+unsigned long long BlackBox::mNextRecordTime = 0;
+pthread_t BlackBox::mSyncThread;
+bool BlackBox::mHasSyncThread = false;
+unsigned long long BlackBox::mNextSyncTime = 0;
+volatile bool BlackBox::mIsRunning = false;
+
+bool BlackBox::start()
+{
+	if(mIsRunning)return true;
+
+	std::string filename;
+	Filename("blackbox",".bin").get(filename);
+	mFd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(mFd < 0)
+	{
+		Debug::print(LOG_SUMMARY, "BlackBox: Unable to open %s\r\n", filename.c_str());
+		return false;
+	}
+
+	//ファイルの大きさを先に確保してからmmapする
+	const unsigned int capacity = BLACKBOX_DURATION * 1000000 / BLACKBOX_PERIOD;
+	mMapSize = sizeof(BlackBoxHeader) + sizeof(BlackBoxRecord) * capacity;
+	void* pMap = MAP_FAILED;
+	if(ftruncate(mFd, mMapSize) == 0)pMap = mmap(NULL, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+	if(pMap == MAP_FAILED)
+	{
+		Debug::print(LOG_SUMMARY, "BlackBox: Unable to map %s\r\n", filename.c_str());
+		close(mFd);
+		mFd = -1;
+		return false;
+	}
+	//記録中にページフォルトが起きないように、ページを確保してメモリに固定する
+	memset(pMap, 0, mMapSize);
+	mlock(pMap, mMapSize);
+
+	mpHeader = (BlackBoxHeader*)pMap;
+	mpRecords = (BlackBoxRecord*)((char*)pMap + sizeof(BlackBoxHeader));
+	mpHeader->recordSize = sizeof(BlackBoxRecord);
+	mpHeader->capacity = capacity;
+
+	//ビットマスクとタスク名の対応を保存する
+	TaskManager* pTaskMan = TaskManager::getInstance();
+	const char* name;
+	while(mpHeader->taskCount < BLACKBOX_MAX_TASKS && (name = pTaskMan->getTaskName(mpHeader->taskCount)) != NULL)
+	{
+		strncpy(mpHeader->taskNames[mpHeader->taskCount], name, BLACKBOX_TASK_NAME_LENGTH - 1);
+		++mpHeader->taskCount;
+	}
+	__sync_synchronize();
+	memcpy(mpHeader->magic, BLACKBOX_MAGIC, sizeof(BLACKBOX_MAGIC));
+
+	mStartTime = mNextRecordTime = mNextSyncTime = TaskProfile::now();
+	mIsRunning = true;
+	mHasSyncThread = pthread_create(&mSyncThread, NULL, syncThread, NULL) == 0;
+	if(!mHasSyncThread)
+	{
+		Debug::print(LOG_SUMMARY, "BlackBox: Unable to start sync thread (sync from main loop)\r\n");
+	}
+	Debug::print(LOG_SUMMARY, "BlackBox: %s (%u records)\r\n", filename.c_str(), capacity);
+	return true;
+}
+void BlackBox::stop()
+{
+	if(!mIsRunning)return;
+	mIsRunning = false;
+	if(mHasSyncThread)pthread_join(mSyncThread, NULL);
+	mHasSyncThread = false;
+
+	msync(mpHeader, mMapSize, MS_SYNC);
+	munlock(mpHeader, mMapSize);
+	munmap(mpHeader, mMapSize);
+	close(mFd);
+	mFd = -1;
+	mpHeader = NULL;
+	mpRecords = NULL;
+}
+void* BlackBox::syncThread(void* arg)
+{
+	//一定間隔でSDに書き込む(メインループとは別スレッドなので待たせない)
+	while(mIsRunning)
+	{
+		usleep(BLACKBOX_SYNC_PERIOD);
+		msync(mpHeader, mMapSize, MS_SYNC);
+	}
+	return NULL;
+}
+void BlackBox::update()
+{
+	if(!mIsRunning)return;
+	unsigned long long now = TaskProfile::now();//vDSOで取得できるためシステムコールは発生しない
+	if(now < mNextRecordTime)return;
+	mNextRecordTime += BLACKBOX_PERIOD * 1000;
+	if(mNextRecordTime < now)mNextRecordTime = now;//長時間止まっていた場合は追いつこうとしない
+	record(now);
+
+	//書き込みスレッドがなければ、書き込みの開始だけを指示する(MS_ASYNCなので待たされない)
+	if(!mHasSyncThread && now >= mNextSyncTime)
+	{
+		mNextSyncTime = now + BLACKBOX_SYNC_PERIOD * 1000ULL;
+		msync(mpHeader, mMapSize, MS_ASYNC);
+	}
+}
+void BlackBox::record(unsigned long long now)
+{
+	unsigned long long count = mpHeader->writeCount;
+	BlackBoxRecord& record = mpRecords[count % mpHeader->capacity];
+
+	//書き込み中に落ちた場合に読み出し側で無視できるよう、先に通し番号を消す
+	record.sequence = 0;
+	__sync_synchronize();
+
+	record.time = (now - mStartTime) / 1000;
+	record.runningTasks = TaskManager::getInstance()->getRunningMask();
+
+	//角度と角速度は同じ更新時点の値を記録する
+	GyroSensor::Snapshot gyro;
+	gGyroSensor.getSnapshot(gyro);
+	if(!gGyroSensor.isActive())gyro.rangle = gyro.rvel = VECTOR3();
+	record.angle[0] = gyro.rangle.x;
+	record.angle[1] = gyro.rangle.y;
+	record.angle[2] = gyro.rangle.z;
+	record.angularVelocity[0] = gyro.rvel.x;
+	record.angularVelocity[1] = gyro.rvel.y;
+	record.angularVelocity[2] = gyro.rvel.z;
+
+	VECTOR3 vec;
+	if(!gAccelerationSensor.getAccel(vec))vec = VECTOR3();
+	record.accel[0] = vec.x;
+	record.accel[1] = vec.y;
+	record.accel[2] = vec.z;
+
+	record.powerL = gMotorDrive.getPowerL();
+	record.powerR = gMotorDrive.getPowerR();
+	record.encoderL = gMotorDrive.getL();
+	record.encoderR = gMotorDrive.getR();
+
+	record.pressure = gPressureSensor.get();
+	GPSSensor::Snapshot gps;
+	gGPSSensor.getSnapshot(gps);
+	if(!gps.hasPosition())gps.pos = VECTOR3();
+	record.longitude = gps.pos.x;
+	record.latitude = gps.pos.y;
+	record.altitude = gps.pos.z;
+	record.satelites = gps.satelites;
+
+	__sync_synchronize();
+	record.sequence = (unsigned int)count + 1;
+	mpHeader->writeCount = count + 1;
+}
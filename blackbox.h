@@ -0,0 +1,70 @@
+/*
+	ブラックボックス(フライトレコーダ)クラス
+
+	直近BLACKBOX_DURATION秒間の機体の状態をmmapしたファイル(blackbox*.bin)にリングバッファとして書き込みます
+	・プロセスが異常終了してもファイルに残るため、再起動後にmake blackbox_decodeで作成される変換ツールで読み出せます
+	・記録はメインループから呼び出され、システムコールを使わずにメモリへの書き込みだけで行う
+	・SDへの書き込みはカーネルと別スレッドのmsyncに任せるため、メインループは待たされない
+	・記録する状態：姿勢、角速度、加速度、モータ出力、エンコーダ、気圧、GPS、実行中のタスク
+*/
+#pragma once
+#include <pthread.h>
+#include "constants.h"
+
+const static char BLACKBOX_MAGIC[8] = {'R','O','V','E','B','B','X','1'};
+const static unsigned int BLACKBOX_MAX_TASKS = 64;
+const static unsigned int BLACKBOX_TASK_NAME_LENGTH = 24;
+
+//ファイルの先頭
+struct BlackBoxHeader
+{
+	char magic[8];
+	unsigned int recordSize;//BlackBoxRecordの大きさ
+	unsigned int capacity;//リングバッファの要素数
+	unsigned int taskCount;
+	unsigned int reserved;
+	char taskNames[BLACKBOX_MAX_TASKS][BLACKBOX_TASK_NAME_LENGTH];//runningTasksの各ビットに対応するタスク名
+	volatile unsigned long long writeCount;//これまでに書き込んだレコードの数
+};
+
+//1回分の記録(ファイル上ではヘッダの直後にcapacity個並ぶ)
+struct BlackBoxRecord
+{
+	volatile unsigned int sequence;//通し番号+1(0は書き込み中または未使用)
+	unsigned int reserved;
+	unsigned long long time;//記録開始からの時間(us)
+	unsigned long long runningTasks;//実行中のタスク(ビットマスク)
+	double longitude, latitude;//GPS座標(3D fixしていなければ0)
+	float angle[3];//ジャイロで求めた角度(度)
+	float angularVelocity[3];//角速度(dps)
+	float accel[3];//加速度(G)
+	float powerL, powerR;//モータ出力
+	unsigned int encoderL, encoderR;//累積パルス数
+	int pressure;//hPa
+	float altitude;
+	int satelites;
+};
+
+class BlackBox
+{
+	static int mFd;
+	static BlackBoxHeader* mpHeader;
+	static BlackBoxRecord* mpRecords;
+	static size_t mMapSize;
+	static unsigned long long mStartTime;//ns
+	static unsigned long long mNextRecordTime;//ns
+	static pthread_t mSyncThread;
+	static bool mHasSyncThread;//書き込みスレッドを起動できたか(できなければupdateからmsyncする)
+	static unsigned long long mNextSyncTime;//ns(書き込みスレッドがない場合に使う)
+	static volatile bool mIsRunning;
+
+	static void* syncThread(void* arg);
+	static void record(unsigned long long now);
+public:
+	//新しいファイルを作成して記録を開始する(タスクを登録した後に呼び出すこと)
+	static bool start();
+	//記録を終了する
+	static void stop();
+	//メインループから呼び出す(BLACKBOX_PERIODごとに状態を記録する)
+	static void update();
+};
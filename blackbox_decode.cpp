@@ -0,0 +1,89 @@
+/*
+	ブラックボックス変換ツール(PC用)
+
+	BlackBoxクラスが記録したファイルから最後の数秒間の状態を取り出し、CSVで標準出力に表示します
+	・ビルド：make blackbox_decode
+	・使い方：./blackbox_decode blackbox1.bin [秒数(省略時はすべて)] > blackbox1.csv
+	  書き込み途中で止まったレコードは読み飛ばします
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "blackbox.h"
+
+static bool compareSequence(const BlackBoxRecord& left, const BlackBoxRecord& right)
+{
+	return left.sequence < right.sequence;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s [blackbox file] [seconds]\n", argv[0]);
+		return 1;
+	}
+	double duration = argc >= 3 ? atof(argv[2]) : 0;
+
+	FILE* pInput = fopen(argv[1], "rb");
+	if(pInput == NULL)
+	{
+		fprintf(stderr, "Unable to open %s\n", argv[1]);
+		return 1;
+	}
+	BlackBoxHeader header;
+	if(fread(&header, sizeof(header), 1, pInput) != 1 || memcmp(header.magic, BLACKBOX_MAGIC, sizeof(BLACKBOX_MAGIC)) != 0)
+	{
+		fprintf(stderr, "%s is not a blackbox file\n", argv[1]);
+		fclose(pInput);
+		return 1;
+	}
+	if(header.recordSize != sizeof(BlackBoxRecord) || header.taskCount > BLACKBOX_MAX_TASKS)
+	{
+		fprintf(stderr, "%s was recorded by an incompatible version\n", argv[1]);
+		fclose(pInput);
+		return 1;
+	}
+
+	//正しく書き込まれたレコードだけを集め、書き込み順に並べる
+	std::vector<BlackBoxRecord> records;
+	BlackBoxRecord record;
+	for(unsigned int i = 0;i < header.capacity && fread(&record, sizeof(record), 1, pInput) == 1;++i)
+	{
+		if(record.sequence != 0 && (record.sequence - 1) % header.capacity == i)records.push_back(record);
+	}
+	fclose(pInput);
+	std::sort(records.begin(), records.end(), compareSequence);
+	if(records.empty())
+	{
+		fprintf(stderr, "No records\n");
+		return 0;
+	}
+
+	unsigned long long lastTime = records.back().time;
+	unsigned long long startTime = duration > 0 && lastTime > duration * 1000000 ? lastTime - (unsigned long long)(duration * 1000000) : 0;
+	fprintf(stderr, "%u records (%.3f - %.3f s), %llu written in total\n", (unsigned int)records.size(), records.front().time / 1000000.0, lastTime / 1000000.0, header.writeCount);
+
+	printf("time,sequence,angle x,angle y,angle z,rvel x,rvel y,rvel z,accel x,accel y,accel z,power L,power R,encoder L,encoder R,pressure,longitude,latitude,altitude,satelites,tasks\n");
+	for(std::vector<BlackBoxRecord>::iterator it = records.begin();it != records.end();++it)
+	{
+		if(it->time < startTime)continue;
+		printf("%.6f,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f,%.3f,%.3f,%.1f,%.1f,%u,%u,%d,%.7f,%.7f,%.1f,%d,",
+			it->time / 1000000.0, it->sequence - 1, it->angle[0], it->angle[1], it->angle[2], it->angularVelocity[0], it->angularVelocity[1], it->angularVelocity[2],
+			it->accel[0], it->accel[1], it->accel[2], it->powerL, it->powerR, it->encoderL, it->encoderR, it->pressure, it->longitude, it->latitude, it->altitude, it->satelites);
+
+		//実行中のタスク名を空白区切りで表示
+		std::string tasks;
+		for(unsigned int i = 0;i < header.taskCount;++i)
+		{
+			if(!(it->runningTasks & (1ULL << i)))continue;
+			if(!tasks.empty())tasks += " ";
+			tasks.append(header.taskNames[i], strnlen(header.taskNames[i], BLACKBOX_TASK_NAME_LENGTH));
+		}
+		printf("%s\n", tasks.c_str());
+	}
+	return 0;
+}
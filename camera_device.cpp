@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+#include "camera_device.h"
+#include "utils.h"
+
+//デバイスが受け取った時刻(記録/再生の対象にしないため、Time::getは使わない)
+static void getRawTime(struct timespec& time)
+{
+	clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+}
+//ドライバが撮影した時刻(CLOCK_MONOTONIC)をgetRawTimeの時計に直す(取り込んでからの経過時間を差し引く)
+static void getCaptureTime(const struct v4l2_buffer& buf, struct timespec& time)
+{
+	getRawTime(time);
+	if((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)return;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long age = (now.tv_sec - (long long)buf.timestamp.tv_sec) * 1000000000LL + now.tv_nsec - buf.timestamp.tv_usec * 1000LL;
+	if(age <= 0 || age >= 1000000000LL)return;//時刻がおかしければ受け取った時刻を使う
+	time.tv_nsec -= age;
+	if(time.tv_nsec < 0)
+	{
+		time.tv_nsec += 1000000000;
+		--time.tv_sec;
+	}
+}
+//シグナルで中断されたioctlを再試行する
+static int xioctl(int fd, unsigned long request, void* arg)
+{
+	int result;
+	do
+	{
+		result = ioctl(fd, request, arg);
+	}while(result == -1 && errno == EINTR);
+	return result;
+}
+
+CameraDevice* CameraDevice::create(const char* path)
+{
+	struct stat st;
+	if(stat(path, &st) != 0)return NULL;
+	if(S_ISCHR(st.st_mode))return new V4L2CameraDevice();
+	if(S_ISREG(st.st_mode))return new FileCameraDevice();
+	return NULL;
+}
+
+//////////////////////////////////////////////
+// V4L2
+//////////////////////////////////////////////
+bool V4L2CameraDevice::setFormat(unsigned int width, unsigned int height, CameraBuffer::FORMAT format)
+{
+	struct v4l2_format fmt;
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.fmt.pix.width = width;
+	fmt.fmt.pix.height = height;
+	fmt.fmt.pix.pixelformat = format == CameraBuffer::FORMAT_MJPEG ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV;
+	fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	if(xioctl(mFd, VIDIOC_S_FMT, &fmt) == -1)return false;
+
+	//対応していない形式なら別の形式に変えられる
+	if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV)mFormat = CameraBuffer::FORMAT_YUYV;
+	else if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG)mFormat = CameraBuffer::FORMAT_MJPEG;
+	else return false;
+	mWidth = fmt.fmt.pix.width;
+	mHeight = fmt.fmt.pix.height;
+	mStride = fmt.fmt.pix.bytesperline != 0 ? fmt.fmt.pix.bytesperline : mWidth * 2;
+	return true;
+}
+bool V4L2CameraDevice::open(const char* path, unsigned int width, unsigned int height, CameraBuffer::FORMAT format)
+{
+	close();
+	if((mFd = ::open(path, O_RDWR | O_NONBLOCK)) == -1)
+	{
+		Debug::print(LOG_SUMMARY, "Camera: Failed to open %s\r\n", path);
+		return false;
+	}
+
+	struct v4l2_capability cap;
+	if(xioctl(mFd, VIDIOC_QUERYCAP, &cap) == -1 || !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING))
+	{
+		Debug::print(LOG_SUMMARY, "Camera: %s does not support streaming capture\r\n", path);
+		close();
+		return false;
+	}
+
+	//指定した形式を試し、駄目ならもう一方の形式を使う
+	CameraBuffer::FORMAT other = format == CameraBuffer::FORMAT_MJPEG ? CameraBuffer::FORMAT_YUYV : CameraBuffer::FORMAT_MJPEG;
+	if(!setFormat(width, height, format) && !setFormat(width, height, other))
+	{
+		Debug::print(LOG_SUMMARY, "Camera: Neither YUYV nor MJPEG is supported\r\n");
+		close();
+		return false;
+	}
+
+	//ドライバのバッファを確保してmmapする
+	struct v4l2_requestbuffers req;
+	memset(&req, 0, sizeof(req));
+	req.count = CAMERA_BUFFER_COUNT;
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_MMAP;
+	if(xioctl(mFd, VIDIOC_REQBUFS, &req) == -1 || req.count < 4)
+	{
+		Debug::print(LOG_SUMMARY, "Camera: Failed to request buffers\r\n");
+		close();
+		return false;
+	}
+	if(req.count > CAMERA_BUFFER_COUNT)req.count = CAMERA_BUFFER_COUNT;
+	for(mBufferCount = 0;mBufferCount < req.count;++mBufferCount)
+	{
+		struct v4l2_buffer buf;
+		memset(&buf, 0, sizeof(buf));
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index = mBufferCount;
+		if(xioctl(mFd, VIDIOC_QUERYBUF, &buf) == -1)break;
+		void* pStart = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, buf.m.offset);
+		if(pStart == MAP_FAILED)break;
+		mBuffers[mBufferCount].pStart = pStart;
+		mBuffers[mBufferCount].length = buf.length;
+		if(xioctl(mFd, VIDIOC_QBUF, &buf) == -1)
+		{
+			++mBufferCount;
+			break;
+		}
+	}
+	if(mBufferCount < req.count)
+	{
+		Debug::print(LOG_SUMMARY, "Camera: Failed to map buffers\r\n");
+		close();
+		return false;
+	}
+
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(xioctl(mFd, VIDIOC_STREAMON, &type) == -1)
+	{
+		Debug::print(LOG_SUMMARY, "Camera: Failed to start streaming\r\n");
+		close();
+		return false;
+	}
+	mIsStreaming = true;
+	Debug::print(LOG_SUMMARY, "Camera: %s %ux%u %s (%u buffers)\r\n", path, mWidth, mHeight, mFormat == CameraBuffer::FORMAT_MJPEG ? "MJPEG" : "YUYV", mBufferCount);
+	return true;
+}
+void V4L2CameraDevice::close()
+{
+	if(mIsStreaming)
+	{
+		enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		xioctl(mFd, VIDIOC_STREAMOFF, &type);
+		mIsStreaming = false;
+	}
+	for(unsigned int i = 0;i < mBufferCount;++i)munmap(mBuffers[i].pStart, mBuffers[i].length);
+	mBufferCount = 0;
+	if(mFd != -1)::close(mFd);
+	mFd = -1;
+}
+bool V4L2CameraDevice::dequeue(CameraBuffer& buffer, int timeout)
+{
+	if(!mIsStreaming)return false;
+
+	struct pollfd fds;
+	fds.fd = mFd;
+	fds.events = POLLIN;
+	if(poll(&fds, 1, timeout) <= 0)return false;
+
+	struct v4l2_buffer buf;
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	if(xioctl(mFd, VIDIOC_DQBUF, &buf) == -1 || buf.index >= mBufferCount)return false;
+
+	buffer.pData = (const unsigned char*)mBuffers[buf.index].pStart;
+	buffer.size = buf.bytesused;
+	buffer.width = mWidth;
+	buffer.height = mHeight;
+	buffer.stride = mStride;
+	buffer.format = mFormat;
+	buffer.index = buf.index;
+	getCaptureTime(buf, buffer.time);
+
+	//壊れたフレームは捨てる
+	if((buf.flags & V4L2_BUF_FLAG_ERROR) || (mFormat == CameraBuffer::FORMAT_YUYV && buffer.size < mStride * mHeight))
+	{
+		requeue(buffer);
+		return false;
+	}
+	return true;
+}
+void V4L2CameraDevice::requeue(const CameraBuffer& buffer)
+{
+	if(!mIsStreaming || buffer.pData == NULL)return;
+	struct v4l2_buffer buf;
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = buffer.index;
+	xioctl(mFd, VIDIOC_QBUF, &buf);
+}
+V4L2CameraDevice::V4L2CameraDevice() : mFd(-1), mBufferCount(0), mWidth(0), mHeight(0), mStride(0), mFormat(CameraBuffer::FORMAT_YUYV), mIsStreaming(false)
+{
+}
+V4L2CameraDevice::~V4L2CameraDevice()
+{
+	close();
+}
+
+//////////////////////////////////////////////
+// File
+//////////////////////////////////////////////
+bool FileCameraDevice::open(const char* path, unsigned int width, unsigned int height, CameraBuffer::FORMAT format)
+{
+	close();
+	if((mFd = ::open(path, O_RDONLY)) == -1)
+	{
+		Debug::print(LOG_SUMMARY, "Camera: Failed to open %s\r\n", path);
+		return false;
+	}
+	struct stat st;
+	unsigned long long frameSize = (unsigned long long)width * height * 2;
+	if(fstat(mFd, &st) != 0 || (unsigned long long)st.st_size < frameSize)
+	{
+		Debug::print(LOG_SUMMARY, "Camera: %s has no %ux%u YUYV frame\r\n", path, width, height);
+		close();
+		return false;
+	}
+	mFileSize = st.st_size;
+	void* pData = mmap(NULL, mFileSize, PROT_READ, MAP_SHARED, mFd, 0);
+	if(pData == MAP_FAILED)
+	{
+		Debug::print(LOG_SUMMARY, "Camera: Failed to map %s\r\n", path);
+		close();
+		return false;
+	}
+	mpData = (const unsigned char*)pData;
+	mWidth = width;
+	mHeight = height;
+	mFrameCount = mFileSize / frameSize;
+	mNextFrame = 0;
+	getRawTime(mNextTime);
+	Debug::print(LOG_SUMMARY, "Camera: %s %ux%u YUYV (%u frames from file)\r\n", path, mWidth, mHeight, mFrameCount);
+	return true;
+}
+void FileCameraDevice::close()
+{
+	if(mpData != NULL)munmap((void*)mpData, mFileSize);
+	mpData = NULL;
+	if(mFd != -1)::close(mFd);
+	mFd = -1;
+}
+bool FileCameraDevice::dequeue(CameraBuffer& buffer, int timeout)
+{
+	if(mpData == NULL)return false;
+
+	//カメラのフレームレートを真似て、次のフレームの時刻まで待つ
+	struct timespec now;
+	getRawTime(now);
+	double wait = Time::dt(mNextTime, now);
+	if(wait > timeout / 1000.0)
+	{
+		usleep(timeout * 1000);
+		return false;
+	}
+	if(wait > 0)usleep((useconds_t)(wait * 1000000));
+	getRawTime(now);
+	mNextTime = now;
+	mNextTime.tv_nsec += (long)(1000000000 / CAMERA_FILE_FRAME_RATE);
+	mNextTime.tv_sec += mNextTime.tv_nsec / 1000000000;
+	mNextTime.tv_nsec %= 1000000000;
+
+	//ファイルは読み込み専用でmmapしているため、そのまま渡す
+	buffer.pData = mpData + (unsigned long long)mNextFrame * mWidth * mHeight * 2;
+	buffer.size = mWidth * mHeight * 2;
+	buffer.width = mWidth;
+	buffer.height = mHeight;
+	buffer.stride = mWidth * 2;
+	buffer.format = CameraBuffer::FORMAT_YUYV;
+	buffer.index = mNextFrame;
+	buffer.time = now;
+	mNextFrame = (mNextFrame + 1) % mFrameCount;
+	return true;
+}
+void FileCameraDevice::requeue(const CameraBuffer& buffer)
+{
+}
+FileCameraDevice::FileCameraDevice() : mFd(-1), mpData(NULL), mFileSize(0), mWidth(0), mHeight(0), mFrameCount(0), mNextFrame(0)
+{
+}
+FileCameraDevice::~FileCameraDevice()
+{
+	close();
+}
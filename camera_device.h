@@ -0,0 +1,100 @@
+/*
+	カメラデバイス
+
+	V4L2のカメラからOpenCVを通さずにフレームを受け取るクラスです
+	・ドライバがmmapしたバッファをそのまま渡す(YUYVまたはMJPEG、BGRへの変換やコピーは行わない)
+	・受け取ったバッファは使い終わったらrequeueでドライバに返すこと
+	・dequeue/requeueは1つのスレッドから呼ぶこと
+	・通常のファイルを開くと、YUYVのフレームを並べたファイルをカメラの代わりに使う(ラズパイ以外での動作確認用)
+*/
+#pragma once
+#include <time.h>
+#include "constants.h"
+
+//カメラから受け取ったフレームのバッファ
+struct CameraBuffer
+{
+	enum FORMAT {FORMAT_YUYV, FORMAT_MJPEG};
+
+	const unsigned char* pData;//NULLならバッファ無し
+	unsigned int size;//データのバイト数
+	unsigned int width, height;
+	unsigned int stride;//1行のバイト数(YUYVのみ)
+	FORMAT format;
+	unsigned int index;//デバイスのバッファ番号
+	struct timespec time;//撮影した時刻(ドライバが時刻を付けていなければ受け取った時刻)
+
+	//YUYV: (x,y)の輝度
+	unsigned char getY(unsigned int x, unsigned int y) const
+	{
+		return pData[y * stride + x * 2];
+	}
+	//YUYV: (x,y)を含む横2画素で共有する色差
+	void getUV(unsigned int x, unsigned int y, unsigned char& u, unsigned char& v) const
+	{
+		const unsigned char* p = pData + y * stride + (x & ~1u) * 2;
+		u = p[1];
+		v = p[3];
+	}
+};
+
+class CameraDevice
+{
+public:
+	//width×heightで撮影を開始する(デバイスが対応していなければ近いサイズになる)
+	virtual bool open(const char* path, unsigned int width, unsigned int height, CameraBuffer::FORMAT format) = 0;
+	virtual void close() = 0;
+	//次のフレームをtimeout[ms]まで待って受け取る
+	virtual bool dequeue(CameraBuffer& buffer, int timeout) = 0;
+	//受け取ったバッファをデバイスに返す
+	virtual void requeue(const CameraBuffer& buffer) = 0;
+
+	//pathがキャラクタデバイスならV4L2、通常のファイルならファイルを読むデバイスを作る(どちらでもなければNULL)
+	static CameraDevice* create(const char* path);
+
+	virtual ~CameraDevice(){}
+};
+
+//V4L2のmmapストリーミングでフレームを受け取るデバイス
+class V4L2CameraDevice : public CameraDevice
+{
+	int mFd;
+	struct MappedBuffer
+	{
+		void* pStart;
+		unsigned int length;
+	} mBuffers[CAMERA_BUFFER_COUNT];
+	unsigned int mBufferCount;
+	unsigned int mWidth, mHeight, mStride;
+	CameraBuffer::FORMAT mFormat;
+	bool mIsStreaming;
+
+	bool setFormat(unsigned int width, unsigned int height, CameraBuffer::FORMAT format);
+public:
+	virtual bool open(const char* path, unsigned int width, unsigned int height, CameraBuffer::FORMAT format);
+	virtual void close();
+	virtual bool dequeue(CameraBuffer& buffer, int timeout);
+	virtual void requeue(const CameraBuffer& buffer);
+
+	V4L2CameraDevice();
+	virtual ~V4L2CameraDevice();
+};
+
+//YUYVのフレームを並べたファイルをmmapし、CAMERA_FILE_FRAME_RATEで順番に返すデバイス(最後まで読んだら先頭に戻る)
+class FileCameraDevice : public CameraDevice
+{
+	int mFd;
+	const unsigned char* mpData;
+	unsigned long long mFileSize;
+	unsigned int mWidth, mHeight;
+	unsigned int mFrameCount, mNextFrame;
+	struct timespec mNextTime;//次のフレームを返す時刻
+public:
+	virtual bool open(const char* path, unsigned int width, unsigned int height, CameraBuffer::FORMAT format);
+	virtual void close();
+	virtual bool dequeue(CameraBuffer& buffer, int timeout);
+	virtual void requeue(const CameraBuffer& buffer);
+
+	FileCameraDevice();
+	virtual ~FileCameraDevice();
+};
@@ -55,16 +55,64 @@ const static double STABI_FOLD_ANGLE = 0.0;	//収納時のスタビ角度
 const static double STABI_WAKING_ANGLE = 0.4; //起き上がり用のスたビの角度
  
 //ジャイロ設定
-const static unsigned int GYRO_SAMPLE_COUNT_FOR_CALCULATE_OFFSET = 100;//ドリフト誤差補正時に用いるサンプル数
+//ドリフト誤差の自動補正(区間ごとに静止判定し、静止していた区間の角速度の平均をドリフト誤差とする)
+const static unsigned int GYRO_STILL_WINDOW = 50;//静止判定を行う区間のサンプル数(95Hzで約0.5秒)
+const static double GYRO_STILL_VARIANCE = 0.25;//区間内の角速度の分散が全軸でこれ以下なら静止とする(dps^2)
+const static double GYRO_STILL_ACCEL_TOLERANCE = 0.05;//加速度の大きさと1Gとの差がこれ以下なら静止とする(G)
+const static double GYRO_BIAS_TOLERANCE = 0.5;//区間の平均角速度と推定値との差が全軸でこれ以下のときのみ推定に使う(dps、超えると一定の角速度で回転中とみなす)
+const static double GYRO_BIAS_MAX = 10;//推定値が無いとき、区間の平均角速度が全軸でこれ以下のときのみ推定に使う(dps、L3GD20のゼロレートレベル)
+const static unsigned int GYRO_BIAS_SAMPLE_LIMIT = 3000;//ドリフト誤差の推定に使うサンプル数の上限(超えると古いサンプルほど重みが下がる)
+const static unsigned int GYRO_FIFO_SIZE = 32;//L3GD20のFIFOの段数
+
+//加速度センサ設定
+const static unsigned int ACCEL_FIFO_SIZE = 32;//MMA8451QのFIFOの段数
+const static double ACCEL_DATA_RATE = 100;//MMA8451Qの出力データレート(Hz、800/400/200/100/50/12.5/6.25/1.56のうちこれ以上で最も低いものを使う)
+
+//距離センサ設定
+const static int DISTANCE_ECHO_TIMEOUT = 25;//送信からエコーの終わりまで待つ時間(ms)
+const static double DISTANCE_MIN_ECHO_WIDTH = 0.0001;//これより短いパルスはトリガーパルスとして無視する(秒)
+const static double DISTANCE_MAX_ECHO_WIDTH = 0.019;//これより長いエコーは計測不能とする(秒)
+
+//カメラ設定
+const static unsigned int CAMERA_FIRST_FRAME_TIMEOUT = 2000;//getFrameで最初のフレームを待つ最大時間(ms)
+const static unsigned long long CAMERA_RETRY_PERIOD = 100000;//フレームの取り込みに失敗したときに再試行するまでの時間(us)
+const static unsigned int CAMERA_BUFFER_COUNT = 5;//V4L2のストリーミングバッファの数(トリプルバッファが3つ持つため4以上にすること)
+const static bool CAMERA_USE_MJPEG = false;//真ならMJPEGで受け取る(USB帯域が足りない場合用、輝度/色差を直接読めなくなる)
+const static char CAMERA_FILE_DEVICE[] = "camera.yuv";//カメラが無い場合に代わりに使うYUYVのフレームを並べたファイル
+const static double CAMERA_FILE_FRAME_RATE = 15;//ファイルからフレームを返す頻度(Hz)
+
+//画像保存設定
+const static unsigned int IMAGE_SAVER_QUEUE_SIZE = 8;//保存待ちにできる画像の数
+const static int IMAGE_SAVER_JPEG_QUALITY = 90;//JPEGの画質(0〜100)
+const static unsigned int IMAGE_SAVER_THUMBNAIL_WIDTH = 0;//この幅に縮小して保存する(0なら縮小しない)
+
+//動画記録設定
+const static unsigned int VIDEO_RECORDER_QUEUE_SIZE = 30;//書き込み待ちにできるフレームの数
+const static unsigned int VIDEO_RECORDER_FPS = 15;//動画のフレームレート
+
+//気圧センサ設定
+const static unsigned int PRESSURE_BASELINE_COUNT = 50;//基準気圧を求めるのに平均するサンプル数
+const static double PRESSURE_RESOLUTION = (115 - 50) * 10 / 1023.0;//MPL115A2の1カウントあたりの気圧(hPa)
+const static double PRESSURE_INNOVATION_TIME = 1.0;//鉛直速度の推定誤差を補正するため、残差の大きさを平均する時間(s)
+const static double PRESSURE_ACCEL_NOISE = 3.0;//想定する鉛直加速度の大きさ(標準偏差、m/s^2)。大きいほど速度の変化に早く追従する
 
 //////////////////////////////////////////////
 // シーケンス系設定
 //////////////////////////////////////////////
-const static unsigned int WAITING_LIGHT_COUNT = 3000;//何回連続で光っていると判定されたときに放出判定とするか
+const static unsigned int WAITING_LIGHT_TIME = 3000;//何ms連続で光っていると判定されたときに放出判定とするか(チャタリング除去の時間)
+const static unsigned long long WAITING_IDLE_PERIOD = 50000;//待機中の全タスクの実行周期の下限(us)
+//放出判定(自由落下、気圧の上昇、明るさの重み付き多数決)
+const static double RELEASE_FREEFALL_THRESHOLD = 0.3;//加速度の大きさがこれ以下なら自由落下とする(g)
+const static unsigned int RELEASE_FREEFALL_TIME = 150;//自由落下が何ms続いたら検出とするか
+const static double RELEASE_DESCENT_SPEED = 5.0;//気圧から求めた降下速度がこれ以上なら降下中とする(m/s)
+const static double RELEASE_DESCENT_SIGMA = 3.0;//降下速度が推定誤差(標準偏差)のこの倍数以上のときのみ降下中とする(ノイズで検出しないため)
+const static unsigned int RELEASE_LIGHT_TIME = 200;//何ms明るいままなら検出とするか
+const static unsigned int RELEASE_VOTE_WINDOW = 1000;//検出したセンサを何msの間投票に加えるか
+const static double RELEASE_VOTE_THRESHOLD = 0.6;//重み付きの得票率(確信度)がこれ以上なら放出判定
 const static unsigned int WAITING_ABORT_TIME =7200;//強制的に放出判定とする時間（秒）
 
-const static unsigned int FALLING_DELTA_PRESSURE_THRESHOLD = 2;//前回との気圧の差がこれ以内なら停止中とカウント(1秒間隔でサンプリング)
-const static unsigned int FALLING_PRESSURE_COUNT = 5;//気圧変化量が閾値以下の状態がこれだけ続いたら着地と判定
+const static double FALLING_LANDING_SPEED = 1.0;//鉛直速度の大きさと推定誤差(標準偏差)がこれ以下なら停止中(m/s)
+const static unsigned int FALLING_LANDING_TIME = 500;//気圧から求めた停止中の状態が何ms続いたら着地と判定するか
 const static double FALLING_GYRO_THRESHOLD = 10;//角速度がこの値以下なら停止中とカウント
 const static unsigned int FALLING_GYRO_COUNT = 1000;//角速度の値が閾値以下のサンプルがこれだけ連続したら着地と判定
 const static unsigned int FALLING_ABORT_TIME = 1800;//落下状態を強制終了する時間
@@ -107,6 +155,81 @@ const static unsigned int TASK_INTERVAL_MOTOR = 0;
 const static unsigned int TASK_INTERVAL_COMMUNICATION = 1;
 const static unsigned int TASK_INTERVAL_ACTUATOR = 0;
 const static unsigned int TASK_INTERVAL_SEQUENCE = 0;
+//タスク実行周期(us) 実行間隔で指定したタスクは(実行間隔 + 1) * TASK_TICK_PERIODの周期で実行される
+const static unsigned long long TASK_TICK_PERIOD = 1000;
+const static unsigned long long TASK_PERIOD_GYRO = 10000;//L3GD20(95Hz)のFIFOを1〜2サンプルずつ読む
+const static unsigned long long TASK_DEADLINE_GYRO = 2000;
+const static unsigned long long TASK_PERIOD_MOTOR = 2000;
+const static unsigned long long TASK_DEADLINE_MOTOR = 1000;
+const static unsigned long long TASK_PERIOD_SEQUENCE = 1000;//シーケンスのカウント系の閾値は1回 = 1msとして扱う
+const static unsigned long long TASK_DEADLINE_SEQUENCE = 5000;
+const static unsigned long long TASK_MAX_SLEEP_PERIOD = 100000;//メインループが一度にスリープする最大時間
+const static unsigned long long TASK_ASYNC_INIT_POLL_PERIOD = 10000;//別スレッドで初期化中のタスクの終了を確認する間隔
+const static unsigned long long TASK_PROFILE_BUDGET = 5000;//onInit/onClean/onCommandの処理時間の予算(us、onUpdateは締め切りを予算とする)
+
+//////////////////////////////////////////////
+//I2Cバス
+//////////////////////////////////////////////
+//転送の優先度(小さいほど優先)
+const static unsigned int I2C_PRIORITY_GYRO = 0;
+const static unsigned int I2C_PRIORITY_ACCEL = 1;
+const static unsigned int I2C_PRIORITY_GPS = 2;
+const static unsigned int I2C_PRIORITY_PRESSURE = 3;
+//転送の実行周期(us)
+const static unsigned long long I2C_PERIOD_GYRO = 10000;
+const static unsigned long long I2C_PERIOD_ACCEL = 10000;
+const static unsigned long long I2C_PERIOD_GPS = 100000;
+const static unsigned long long I2C_PERIOD_PRESSURE = 10000;//MPL115A2の変換時間(3ms)以上にすること
+const static unsigned long long I2C_BUS_MAX_SLEEP_PERIOD = 100000;//バスのスレッドが一度に待つ最大時間
+
+//////////////////////////////////////////////
+//サンプルバス
+//////////////////////////////////////////////
+//チャンネルごとに保持するサンプル数(2のべき乗)
+const static unsigned int SAMPLE_BUS_GYRO_SIZE = 256;//95Hzで約2.7秒
+const static unsigned int SAMPLE_BUS_ACCEL_SIZE = 256;//100Hzで約2.5秒
+const static unsigned int SAMPLE_BUS_ENCODER_SIZE = 512;//500Hzで約1秒
+const static unsigned int SAMPLE_BUS_GPS_SIZE = 16;
+const static unsigned int SAMPLE_BUS_PRESSURE_SIZE = 128;//100Hzで約1.3秒
+const static double SAMPLE_BUS_MAX_SKEW = 0.05;//融合処理で遅れているセンサをこれ以上(秒)は待たない
+
+//////////////////////////////////////////////
+//ログ
+//////////////////////////////////////////////
+const static unsigned int LOGGER_RING_SIZE = 256;//書き込み待ちにできるログの数(2のべき乗、1つあたりMAX_STRING_LENGTHバイト)
+const static unsigned int LOGGER_BATCH_SIZE = 16384;//一度にwriteする最大サイズ
+const static unsigned long long LOGGER_SYNC_PERIOD = 1000000;//fdatasyncでSDに書き込む間隔(us)
+const static unsigned long long LOGGER_WAKE_PERIOD = 100000;//ログが来なくても書き込みスレッドが起きる間隔(us)
+
+//////////////////////////////////////////////
+//テレメトリ
+//////////////////////////////////////////////
+const static unsigned int TELEMETRY_BUFFER_SIZE = 16384;//このサイズごとにまとめてファイルに書き込む
+const static unsigned int TELEMETRY_BUFFER_COUNT = 4;//バッファの数(書き込みスレッドが遅れている間は残りのバッファに記録する)
+const static double TELEMETRY_FLUSH_PERIOD = 1;//バッファが一杯にならなくても書き込む間隔(秒)
+
+//////////////////////////////////////////////
+//ブラックボックス
+//////////////////////////////////////////////
+const static unsigned long long BLACKBOX_PERIOD = 20000;//状態を記録する間隔(us)
+const static unsigned int BLACKBOX_DURATION = 60;//記録を残す時間(秒)、これより古いものは上書きされる
+const static unsigned int BLACKBOX_SYNC_PERIOD = 1000000;//msyncでSDに書き込む間隔(us)
+
+//////////////////////////////////////////////
+//シミュレータ(make SIM=1)
+//////////////////////////////////////////////
+const static double SIM_DEFAULT_PRESSURE = 1013.25;//気圧の初期値(hPa)
+const static double SIM_DEFAULT_LONGITUDE = -119.1068;//GPS座標の初期値(ブラックロック砂漠)
+const static double SIM_DEFAULT_LATITUDE = 40.8814;
+const static double SIM_DEFAULT_ALTITUDE = 1190;
+const static int SIM_DEFAULT_SATELITES = 8;
+const static double SIM_DEFAULT_DISTANCE = 2;//距離センサの前にある物体までの距離(m)
+const static double SIM_MOTOR_MAX_SPEED = 0.5;//モータ出力最大時の速さ(m/s)
+const static double SIM_MOTOR_MAX_YAW_RATE = 90;//左右のモータを逆向きに最大出力したときの角速度(dps)
+const static double SIM_ENCODER_MAX_PULSE_RATE = 3000;//モータ出力最大時のエンコーダのパルス数(1秒あたり)
+const static double SIM_GPS_UPDATE_PERIOD = 1;//GPSの座標更新間隔(秒)
+const static double SIM_DISTANCE_ECHO_DELAY = 0.0002;//距離センサの送信からエコーが返り始めるまでの時間(秒)
+const static double SIM_SOUND_SPEED = 340.29;//音速(m/s)
 
 //////////////////////////////////////////////
 //その他
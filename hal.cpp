@@ -0,0 +1,322 @@
+#ifdef USE_WIRINGPI
+#include <wiringPi.h>
+#include <wiringPiI2C.h>
+#include <softPwm.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <linux/gpio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <map>
+#include <pthread.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hal.h"
+#ifndef USE_WIRINGPI
+#include "hal_sim.h"
+#endif
+
+#ifdef USE_WIRINGPI
+//////////////////////////////////////////////
+// wiringPi Backend
+//////////////////////////////////////////////
+class WiringPiBackend : public HalBackend
+{
+	//I2C_RDWRで使うスレーブアドレス(キーはファイルハンドル)
+	//i2cReadBlockはI2CBusのスレッドから呼ばれるため、mMutexで保護する
+	std::map<int, int> mI2CAddresses;
+	pthread_mutex_t mMutex;
+
+	//fdのスレーブアドレス(無ければ-1)
+	int getAddress(int fd)
+	{
+		pthread_mutex_lock(&mMutex);
+		std::map<int, int>::iterator it = mI2CAddresses.find(fd);
+		int address = it == mI2CAddresses.end() ? -1 : it->second;
+		pthread_mutex_unlock(&mMutex);
+		return address;
+	}
+public:
+	WiringPiBackend()
+	{
+		pthread_mutex_init(&mMutex, NULL);
+	}
+	virtual ~WiringPiBackend()
+	{
+		pthread_mutex_destroy(&mMutex);
+	}
+
+	virtual bool setup()
+	{
+		return wiringPiSetup() == 0;
+	}
+
+	virtual int i2cSetup(int address)
+	{
+		int fd = wiringPiI2CSetup(address);
+		if(fd != -1)
+		{
+			pthread_mutex_lock(&mMutex);
+			mI2CAddresses[fd] = address;
+			pthread_mutex_unlock(&mMutex);
+		}
+		return fd;
+	}
+	virtual int i2cReadReg8(int fd, int reg)
+	{
+		return wiringPiI2CReadReg8(fd, reg);
+	}
+	virtual int i2cWriteReg8(int fd, int reg, int data)
+	{
+		return wiringPiI2CWriteReg8(fd, reg, data);
+	}
+	virtual void i2cClose(int fd)
+	{
+		pthread_mutex_lock(&mMutex);
+		mI2CAddresses.erase(fd);
+		pthread_mutex_unlock(&mMutex);
+		close(fd);
+	}
+
+	virtual int i2cReadBlock(int fd, int reg, unsigned char* pData, int length)
+	{
+		int address = getAddress(fd);
+		if(address == -1 || length <= 0)return -1;
+
+		//レジスタ番号の書き込みと読み込みをリピートスタートでつなげて1回の転送にする
+		unsigned char subAddress = reg;
+		struct i2c_msg messages[2];
+		messages[0].addr = address;
+		messages[0].flags = 0;
+		messages[0].len = 1;
+		messages[0].buf = &subAddress;
+		messages[1].addr = address;
+		messages[1].flags = I2C_M_RD;
+		messages[1].len = length;
+		messages[1].buf = pData;
+		struct i2c_rdwr_ioctl_data data;
+		data.msgs = messages;
+		data.nmsgs = 2;
+		if(ioctl(fd, I2C_RDWR, &data) < 0)return -1;
+		return length;
+	}
+
+	virtual void pinMode(int pin, int mode)
+	{
+		::pinMode(pin, mode);
+	}
+	virtual int digitalRead(int pin)
+	{
+		return ::digitalRead(pin);
+	}
+	virtual void digitalWrite(int pin, int value)
+	{
+		::digitalWrite(pin, value);
+	}
+
+	virtual int softPwmCreate(int pin, int initialValue, int range)
+	{
+		return ::softPwmCreate(pin, initialValue, range);
+	}
+	virtual void softPwmWrite(int pin, int value)
+	{
+		::softPwmWrite(pin, value);
+	}
+
+	virtual void pwmSetMode(int mode)
+	{
+		::pwmSetMode(mode);
+	}
+	virtual void pwmSetRange(unsigned int range)
+	{
+		::pwmSetRange(range);
+	}
+	virtual void pwmSetClock(int divisor)
+	{
+		::pwmSetClock(divisor);
+	}
+	virtual void pwmWrite(int pin, int value)
+	{
+		::pwmWrite(pin, value);
+	}
+
+	virtual int setISR(int pin, int edgeType, void (*function)(void))
+	{
+		return wiringPiISR(pin, edgeType, function);
+	}
+	virtual void clearISR(int pin)
+	{
+		//wiringPiには割り込みを解除する関数が無いため、gpioコマンドでエッジ検出を無効にする
+		char command[64];
+		sprintf(command, "/usr/local/bin/gpio edge %d none", pin);
+		system(command);
+	}
+
+	virtual int edgeOpen(int pin, int edgeType)
+	{
+		//gpiochipのイベントを使うと、エッジの時刻をカーネルが割り込み時に記録する
+		//(ピンは入力として確保されるが、wiringPiは/dev/gpiomemから直接出力に切り替えられる)
+		int chip = open("/dev/gpiochip0", O_RDONLY);
+		if(chip < 0)return -1;
+		struct gpioevent_request request;
+		memset(&request, 0, sizeof(request));
+		request.lineoffset = wpiPinToGpio(pin);
+		request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+		request.eventflags = edgeType == INT_EDGE_RISING ? GPIOEVENT_REQUEST_RISING_EDGE : (edgeType == INT_EDGE_FALLING ? GPIOEVENT_REQUEST_FALLING_EDGE : GPIOEVENT_REQUEST_BOTH_EDGES);
+		strncpy(request.consumer_label, "rovermain", sizeof(request.consumer_label) - 1);
+		int result = ioctl(chip, GPIO_GET_LINEEVENT_IOCTL, &request);
+		close(chip);
+		if(result < 0)return -1;
+		return request.fd;
+	}
+	virtual int edgeWait(int handle, int timeout, int& value, struct timespec& time)
+	{
+		struct pollfd pfd;
+		pfd.fd = handle;
+		pfd.events = POLLIN | POLLPRI;
+		int result = poll(&pfd, 1, timeout);
+		if(result < 0)return errno == EINTR ? 0 : -1;
+		if(result == 0)return 0;
+
+		struct gpioevent_data event;
+		if(read(handle, &event, sizeof(event)) != sizeof(event))return -1;
+		value = event.id == GPIOEVENT_EVENT_RISING_EDGE ? HIGH : LOW;
+		time.tv_sec = event.timestamp / 1000000000ULL;
+		time.tv_nsec = event.timestamp % 1000000000ULL;
+		return 1;
+	}
+	virtual void edgeClose(int handle)
+	{
+		close(handle);
+	}
+
+	virtual void delay(unsigned int ms)
+	{
+		::delay(ms);
+	}
+};
+#endif
+
+//////////////////////////////////////////////
+// Hal
+//////////////////////////////////////////////
+HalBackend* Hal::mpBackend = NULL;
+
+HalBackend* Hal::getBackend()
+{
+	if(mpBackend == NULL)
+	{
+#ifdef USE_WIRINGPI
+		static WiringPiBackend backend;
+		mpBackend = &backend;
+#else
+		mpBackend = SimulatedBackend::getInstance();
+#endif
+	}
+	return mpBackend;
+}
+void Hal::setBackend(HalBackend* pBackend)
+{
+	mpBackend = pBackend;
+}
+bool Hal::setup()
+{
+	return getBackend()->setup();
+}
+int Hal::i2cSetup(int address)
+{
+	return getBackend()->i2cSetup(address);
+}
+int Hal::i2cReadReg8(int fd, int reg)
+{
+	return getBackend()->i2cReadReg8(fd, reg);
+}
+int Hal::i2cWriteReg8(int fd, int reg, int data)
+{
+	return getBackend()->i2cWriteReg8(fd, reg, data);
+}
+void Hal::i2cClose(int fd)
+{
+	getBackend()->i2cClose(fd);
+}
+int Hal::i2cReadBlock(int fd, int reg, unsigned char* pData, int length)
+{
+	return getBackend()->i2cReadBlock(fd, reg, pData, length);
+}
+unsigned int Hal::i2cReadReg32LE(int fd, int reg)
+{
+	return (unsigned int)((unsigned long)i2cReadReg8(fd, reg + 3) << 24 | (unsigned int)i2cReadReg8(fd, reg + 2) << 16 | (unsigned int)i2cReadReg8(fd, reg + 1) << 8 | (unsigned int)i2cReadReg8(fd, reg));
+}
+unsigned short Hal::i2cReadReg16BE(int fd, int reg)
+{
+	return (unsigned short)((unsigned short)i2cReadReg8(fd, reg) << 8 | (unsigned short)i2cReadReg8(fd, reg + 1));
+}
+unsigned short Hal::i2cReadReg16LE(int fd, int reg)
+{
+	return (unsigned short)((unsigned short)i2cReadReg8(fd, reg) | (unsigned short)i2cReadReg8(fd, reg + 1) << 8);
+}
+void Hal::pinMode(int pin, int mode)
+{
+	getBackend()->pinMode(pin, mode);
+}
+int Hal::digitalRead(int pin)
+{
+	return getBackend()->digitalRead(pin);
+}
+void Hal::digitalWrite(int pin, int value)
+{
+	getBackend()->digitalWrite(pin, value);
+}
+int Hal::softPwmCreate(int pin, int initialValue, int range)
+{
+	return getBackend()->softPwmCreate(pin, initialValue, range);
+}
+void Hal::softPwmWrite(int pin, int value)
+{
+	getBackend()->softPwmWrite(pin, value);
+}
+void Hal::pwmSetMode(int mode)
+{
+	getBackend()->pwmSetMode(mode);
+}
+void Hal::pwmSetRange(unsigned int range)
+{
+	getBackend()->pwmSetRange(range);
+}
+void Hal::pwmSetClock(int divisor)
+{
+	getBackend()->pwmSetClock(divisor);
+}
+void Hal::pwmWrite(int pin, int value)
+{
+	getBackend()->pwmWrite(pin, value);
+}
+int Hal::setISR(int pin, int edgeType, void (*function)(void))
+{
+	return getBackend()->setISR(pin, edgeType, function);
+}
+void Hal::clearISR(int pin)
+{
+	getBackend()->clearISR(pin);
+}
+int Hal::edgeOpen(int pin, int edgeType)
+{
+	return getBackend()->edgeOpen(pin, edgeType);
+}
+int Hal::edgeWait(int handle, int timeout, int& value, struct timespec& time)
+{
+	return getBackend()->edgeWait(handle, timeout, value, time);
+}
+void Hal::edgeClose(int handle)
+{
+	getBackend()->edgeClose(handle);
+}
+void Hal::delay(unsigned int ms)
+{
+	getBackend()->delay(ms);
+}
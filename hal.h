@@ -0,0 +1,120 @@
+/*
+	ハードウェア抽象化層
+
+	I2C/GPIO/PWM/割り込みへのアクセスをまとめたクラスです
+	・ドライバはwiringPiの関数を直接呼ばずにHal::i2cReadReg8()のように呼び出してください
+	・通常はwiringPiを呼び出すバックエンドが使われます
+	・make SIM=1でビルドするとwiringPiを使わずにシミュレータ(hal_sim.cpp)がセンサ類を模擬するため、
+	  ラズパイ以外のLinux上でもoutを実行できます
+*/
+#pragma once
+#include <time.h>
+
+//wiringPiと同じ値の定数(wiringPiを使わない場合のみ定義)
+#ifndef INPUT
+#define INPUT 0
+#define OUTPUT 1
+#define PWM_OUTPUT 2
+#endif
+#ifndef LOW
+#define LOW 0
+#define HIGH 1
+#endif
+#ifndef INT_EDGE_RISING
+#define INT_EDGE_SETUP 0
+#define INT_EDGE_FALLING 1
+#define INT_EDGE_RISING 2
+#define INT_EDGE_BOTH 3
+#endif
+#ifndef PWM_MODE_MS
+#define PWM_MODE_MS 0
+#define PWM_MODE_BAL 1
+#endif
+
+//ハードウェアへのアクセスを実装するクラス(実機用、シミュレータ用など)
+class HalBackend
+{
+public:
+	virtual bool setup() = 0;
+
+	//I2C(失敗時は-1を返す)
+	virtual int i2cSetup(int address) = 0;
+	virtual int i2cReadReg8(int fd, int reg) = 0;
+	virtual int i2cWriteReg8(int fd, int reg, int data) = 0;
+	virtual void i2cClose(int fd) = 0;
+	//regから連続するlengthバイトを1回の転送で読み込む(読み込んだバイト数を返す)
+	virtual int i2cReadBlock(int fd, int reg, unsigned char* pData, int length) = 0;
+
+	//GPIO
+	virtual void pinMode(int pin, int mode) = 0;
+	virtual int digitalRead(int pin) = 0;
+	virtual void digitalWrite(int pin, int value) = 0;
+
+	//ソフトウェアPWM
+	virtual int softPwmCreate(int pin, int initialValue, int range) = 0;
+	virtual void softPwmWrite(int pin, int value) = 0;
+
+	//ハードウェアPWM
+	virtual void pwmSetMode(int mode) = 0;
+	virtual void pwmSetRange(unsigned int range) = 0;
+	virtual void pwmSetClock(int divisor) = 0;
+	virtual void pwmWrite(int pin, int value) = 0;
+
+	//割り込み(functionは別スレッドから呼ばれる)
+	virtual int setISR(int pin, int edgeType, void (*function)(void)) = 0;
+	virtual void clearISR(int pin) = 0;
+
+	//エッジ検出(カーネルが割り込み時に記録した時刻を受け取る、別スレッドで待つ用)
+	//edgeOpenはハンドルを返す(失敗時は-1)
+	virtual int edgeOpen(int pin, int edgeType) = 0;
+	//エッジをtimeout[ms]まで待つ(エッジがあれば1を返し、valueにエッジ後の値、timeに時刻を書き込む、タイムアウトは0、失敗時は-1)
+	//時刻は同じハンドルのエッジ同士の差を求めるためのもの(Time::getとは基準が違う場合がある)
+	virtual int edgeWait(int handle, int timeout, int& value, struct timespec& time) = 0;
+	virtual void edgeClose(int handle) = 0;
+
+	virtual void delay(unsigned int ms) = 0;
+
+	virtual ~HalBackend(){}
+};
+
+class Hal
+{
+	static HalBackend* mpBackend;
+public:
+	//使用するバックエンドを取得/変更する
+	static HalBackend* getBackend();
+	static void setBackend(HalBackend* pBackend);
+
+	static bool setup();
+
+	static int i2cSetup(int address);
+	static int i2cReadReg8(int fd, int reg);
+	static int i2cWriteReg8(int fd, int reg, int data);
+	static void i2cClose(int fd);
+	static int i2cReadBlock(int fd, int reg, unsigned char* pData, int length);
+	//複数バイトのレジスタを1バイトずつ読み込んで結合する
+	static unsigned int i2cReadReg32LE(int fd, int reg);
+	static unsigned short i2cReadReg16BE(int fd, int reg);
+	static unsigned short i2cReadReg16LE(int fd, int reg);
+
+	static void pinMode(int pin, int mode);
+	static int digitalRead(int pin);
+	static void digitalWrite(int pin, int value);
+
+	static int softPwmCreate(int pin, int initialValue, int range);
+	static void softPwmWrite(int pin, int value);
+
+	static void pwmSetMode(int mode);
+	static void pwmSetRange(unsigned int range);
+	static void pwmSetClock(int divisor);
+	static void pwmWrite(int pin, int value);
+
+	static int setISR(int pin, int edgeType, void (*function)(void));
+	static void clearISR(int pin);
+
+	static int edgeOpen(int pin, int edgeType);
+	static int edgeWait(int handle, int timeout, int& value, struct timespec& time);
+	static void edgeClose(int handle);
+
+	static void delay(unsigned int ms);
+};
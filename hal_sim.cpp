@@ -0,0 +1,798 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "hal_sim.h"
+#include "constants.h"
+
+SimulatorControl gSimulatorControl;
+
+//MPL115A2のデータシートに記載されている係数の例
+const static unsigned short SIM_PRESSURE_COEFFICIENTS[4] = {0x3ECE, 0xB3F9, 0xC517, 0x33C8};
+const static unsigned int SIM_PRESSURE_TADC = 507;//温度のADC値(固定)
+const static int SIM_I2C_FD_BASE = 0x100;//シミュレータが返すI2Cのファイルハンドル
+const static int SIM_EDGE_FD_BASE = 0x200;//シミュレータが返すエッジ検出のハンドル
+const static int SIM_I2C_ADDRESSES[SimulatedBackend::DEVICE_COUNT] = {0x60, 0x20, 0x6b, 0x1d};
+
+//シミュレータ内部の時刻(記録/再生の対象にしないため、Time::getは使わない)
+static void getRawTime(struct timespec& time)
+{
+	clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+}
+//timeにseconds秒を足す
+static void addTime(struct timespec& time, double seconds)
+{
+	long long nsec = time.tv_nsec + (long long)(seconds * 1000000000);
+	time.tv_sec += nsec / 1000000000;
+	time.tv_nsec = nsec % 1000000000;
+	if(time.tv_nsec < 0)
+	{
+		time.tv_nsec += 1000000000;
+		--time.tv_sec;
+	}
+}
+
+SimulatedBackend* SimulatedBackend::getInstance()
+{
+	static SimulatedBackend singleton;
+	return &singleton;
+}
+SimulatedBackend::SimulatedBackend() : mGyroFifoHead(0), mGyroFifoCount(0), mIsGyroOverrun(false), mGyroSampleTimer(0), mAccelFifoHead(0), mAccelFifoCount(0), mIsAccelOverflow(false), mAccelSampleTimer(0), mGpsUpdateTimer(0), mGpsStatusReadCount(0),
+	mPressure(SIM_DEFAULT_PRESSURE), mAccel(), mRotation(), mYawRate(0), mLongitude(SIM_DEFAULT_LONGITUDE), mLatitude(SIM_DEFAULT_LATITUDE), mAltitude(SIM_DEFAULT_ALTITUDE),
+	mCourse(0), mSpeed(0), mSatelites(SIM_DEFAULT_SATELITES), mDistance(SIM_DEFAULT_DISTANCE), mIsEchoRequested(false), mIsISRThreadRunning(false)
+{
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&mEdgeCond, &attr);
+	pthread_condattr_destroy(&attr);
+	memset(mRegisters, 0, sizeof(mRegisters));
+	memset(mIsOpened, 0, sizeof(mIsOpened));
+	memset(mGyroFifo, 0, sizeof(mGyroFifo));
+	memset(mAccelFifo, 0, sizeof(mAccelFifo));
+	memset(mPinModes, 0, sizeof(mPinModes));
+	memset(mPinValues, 0, sizeof(mPinValues));
+	memset(mPwmValues, 0, sizeof(mPwmValues));
+	memset(mPwmRanges, 0, sizeof(mPwmRanges));
+	memset(mPulseRemainder, 0, sizeof(mPulseRemainder));
+	for(int i = 0;i < PIN_COUNT;++i)mpISR[i] = NULL;
+	for(int i = 0;i < PIN_COUNT;++i)mEdgeTypes[i] = -1;
+	memset(&mEchoStartTime, 0, sizeof(mEchoStartTime));
+	getRawTime(mLastStepTime);
+
+	mAccel.z = 1;
+
+	//気圧センサの係数(ビッグエンディアン)
+	for(int i = 0;i < 4;++i)
+	{
+		mRegisters[DEVICE_PRESSURE][0x04 + i * 2] = SIM_PRESSURE_COEFFICIENTS[i] >> 8;
+		mRegisters[DEVICE_PRESSURE][0x05 + i * 2] = SIM_PRESSURE_COEFFICIENTS[i] & 0xff;
+	}
+	latchPressure();
+
+	//GPSのファームウェアバージョン
+	mRegisters[DEVICE_GPS][0x03] = 1;
+	updateGpsRegisters();
+
+	//ジャイロのWHO_AM_I
+	mRegisters[DEVICE_GYRO][0x0F] = 0xD4;
+
+	//加速度センサのWHO_AM_I
+	mRegisters[DEVICE_ACCEL][0x0D] = 0x1A;
+}
+SimulatedBackend::~SimulatedBackend()
+{
+	if(mIsISRThreadRunning)
+	{
+		mIsISRThreadRunning = false;
+		pthread_join(mISRThread, NULL);
+	}
+	pthread_cond_destroy(&mEdgeCond);
+	pthread_mutex_destroy(&mMutex);
+}
+
+void SimulatedBackend::step()
+{
+	struct timespec now;
+	getRawTime(now);
+	double dt = Time::dt(now, mLastStepTime);
+	mLastStepTime = now;
+	if(dt < 0)dt = 0;
+	if(dt > 1)dt = 1;//長時間止まっていた場合は1秒分だけ進める
+
+	//左右のモータ出力から移動と旋回を計算する
+	double right = getMotorPower(PIN_PWM_A, PIN_INVERT_MOTOR_A);
+	double left = getMotorPower(PIN_PWM_B, PIN_INVERT_MOTOR_B);
+	mSpeed = (right + left) / 2 * SIM_MOTOR_MAX_SPEED;
+	mYawRate = (right - left) / 2 * SIM_MOTOR_MAX_YAW_RATE;
+
+	mCourse -= (mYawRate + mRotation.z) * dt;
+	mCourse = fmod(mCourse, 360);
+	if(mCourse < 0)mCourse += 360;
+	double distance = mSpeed * dt;
+	mLatitude += distance * cos(mCourse / 180 * M_PI) / DEGREE_2_METER;
+	mLongitude += distance * sin(mCourse / 180 * M_PI) / (DEGREE_2_METER * cos(mLatitude / 180 * M_PI));
+
+	stepGyro(dt);
+	stepAccel(dt);
+
+	mGpsUpdateTimer -= dt;
+	if(mGpsUpdateTimer <= 0)
+	{
+		mGpsUpdateTimer += SIM_GPS_UPDATE_PERIOD;
+		if(mGpsUpdateTimer <= 0)mGpsUpdateTimer = SIM_GPS_UPDATE_PERIOD;
+		updateGpsRegisters();
+	}
+}
+void SimulatedBackend::stepGyro(double dt)
+{
+	unsigned char* pRegisters = mRegisters[DEVICE_GYRO];
+	if(!(pRegisters[0x20] & 0x08))
+	{
+		//パワーダウン中
+		mGyroSampleTimer = 0;
+		return;
+	}
+
+	//出力データレート(CTRL_REG1のDR)
+	const static double ODR[4] = {95, 190, 380, 760};
+	double period = 1.0 / ODR[pRegisters[0x20] >> 6];
+	//感度(CTRL_REG4のFS)
+	const static double SENSITIVITY[4] = {0.00875, 0.0175, 0.070, 0.070};
+	double sensitivity = SENSITIVITY[(pRegisters[0x23] >> 4) & 0x03];
+	//FIFOが無効ならデータは1つだけ保持される
+	unsigned int depth = ((pRegisters[0x24] & 0x40) && (pRegisters[0x2E] & 0xE0)) ? GYRO_FIFO_SIZE : 1;
+
+	mGyroSampleTimer -= dt;
+	while(mGyroSampleTimer <= 0)
+	{
+		mGyroSampleTimer += period;
+
+		double rate[3] = {mRotation.x, mRotation.y, mRotation.z + mYawRate};
+		if(mGyroFifoCount >= depth)
+		{
+			//古いサンプルを捨てる
+			mGyroFifoHead = (mGyroFifoHead + 1) % GYRO_FIFO_SIZE;
+			--mGyroFifoCount;
+			mIsGyroOverrun = true;
+		}
+		short* pSample = mGyroFifo[(mGyroFifoHead + mGyroFifoCount) % GYRO_FIFO_SIZE];
+		for(int i = 0;i < 3;++i)
+		{
+			double raw = rate[i] / sensitivity;
+			if(raw > SHRT_MAX)raw = SHRT_MAX;
+			else if(raw < SHRT_MIN)raw = SHRT_MIN;
+			pSample[i] = (short)raw;
+		}
+		++mGyroFifoCount;
+	}
+}
+void SimulatedBackend::updateGpsRegisters()
+{
+	unsigned char* pRegisters = mRegisters[DEVICE_GPS];
+	int longitude = (int)(mLongitude * 10000000), latitude = (int)(mLatitude * 10000000);
+	short altitude = (short)mAltitude, speed = (short)(mSpeed * 100), course = (short)(mCourse * 10);
+
+	time_t now = time(NULL);
+	struct tm utc;
+	gmtime_r(&now, &utc);
+	int gpsTime = utc.tm_hour * 10000 + utc.tm_min * 100 + utc.tm_sec;
+
+	for(int i = 0;i < 4;++i)
+	{
+		pRegisters[0x07 + i] = (longitude >> (i * 8)) & 0xff;
+		pRegisters[0x0B + i] = (latitude >> (i * 8)) & 0xff;
+		pRegisters[39 + i] = (gpsTime >> (i * 8)) & 0xff;
+	}
+	for(int i = 0;i < 2;++i)
+	{
+		pRegisters[0x21 + i] = (altitude >> (i * 8)) & 0xff;
+		pRegisters[31 + i] = (speed >> (i * 8)) & 0xff;
+		pRegisters[35 + i] = (course >> (i * 8)) & 0xff;
+	}
+	mGpsStatusReadCount = 0;
+}
+void SimulatedBackend::latchPressure()
+{
+	//ドライバと同じ式を逆に解いて、指定された気圧になるADC値を求める
+	double a0 = (short)SIM_PRESSURE_COEFFICIENTS[0] / 8.0;
+	double b1 = (short)SIM_PRESSURE_COEFFICIENTS[1] / 8192.0;
+	double b2 = (short)SIM_PRESSURE_COEFFICIENTS[2] / 16384.0;
+	double c12 = (short)SIM_PRESSURE_COEFFICIENTS[3] / 16777216.0;
+	double Pcomp = (mPressure / 10 - 50) * 1023 / (115 - 50);
+	int Padc = (int)floor((Pcomp - a0 - b2 * SIM_PRESSURE_TADC) / (b1 + c12 * SIM_PRESSURE_TADC) + 0.5);
+	if(Padc < 0)Padc = 0;
+	else if(Padc > 1023)Padc = 1023;
+
+	unsigned char* pRegisters = mRegisters[DEVICE_PRESSURE];
+	pRegisters[0x00] = Padc >> 2;
+	pRegisters[0x01] = (Padc & 0x03) << 6;
+	pRegisters[0x02] = SIM_PRESSURE_TADC >> 2;
+	pRegisters[0x03] = (SIM_PRESSURE_TADC & 0x03) << 6;
+}
+void SimulatedBackend::stepAccel(double dt)
+{
+	unsigned char* pRegisters = mRegisters[DEVICE_ACCEL];
+	if(!(pRegisters[0x2A] & 0x01))
+	{
+		//スタンバイ中
+		mAccelSampleTimer = 0;
+		return;
+	}
+
+	//出力データレート(CTRL_REG1のDR)
+	const static double ODR[8] = {800, 400, 200, 100, 50, 12.5, 6.25, 1.56};
+	double period = 1.0 / ODR[(pRegisters[0x2A] >> 3) & 0x07];
+	//感度(XYZ_DATA_CFGのFS、14bit)
+	const static double SENSITIVITY[4] = {4096, 2048, 1024, 1024};
+	double sensitivity = SENSITIVITY[pRegisters[0x0E] & 0x03];
+	//FIFOが無効ならデータは1つだけ保持される
+	unsigned int depth = (pRegisters[0x09] & 0xC0) ? ACCEL_FIFO_SIZE : 1;
+
+	mAccelSampleTimer -= dt;
+	while(mAccelSampleTimer <= 0)
+	{
+		mAccelSampleTimer += period;
+
+		double accel[3] = {mAccel.x, mAccel.y, mAccel.z};
+		if(mAccelFifoCount >= depth)
+		{
+			//古いサンプルを捨てる
+			mAccelFifoHead = (mAccelFifoHead + 1) % ACCEL_FIFO_SIZE;
+			--mAccelFifoCount;
+			if(depth > 1)mIsAccelOverflow = true;
+		}
+		short* pSample = mAccelFifo[(mAccelFifoHead + mAccelFifoCount) % ACCEL_FIFO_SIZE];
+		for(int i = 0;i < 3;++i)
+		{
+			int raw = (int)floor(accel[i] * sensitivity + 0.5);
+			if(raw > 8191)raw = 8191;
+			else if(raw < -8192)raw = -8192;
+			pSample[i] = (short)raw;
+		}
+		++mAccelFifoCount;
+	}
+}
+double SimulatedBackend::getMotorPower(int pwmPin, int reversePin)
+{
+	if(mPwmRanges[pwmPin] <= 0)return 0;
+	double power = (double)mPwmValues[pwmPin] / mPwmRanges[pwmPin];
+	return mPinValues[reversePin] == HIGH ? power : -power;
+}
+SimulatedBackend::DEVICE SimulatedBackend::getDevice(int fd)
+{
+	int device = fd - SIM_I2C_FD_BASE;
+	if(device < 0 || device >= DEVICE_COUNT || !mIsOpened[device])return DEVICE_COUNT;
+	return (DEVICE)device;
+}
+
+bool SimulatedBackend::setup()
+{
+	return true;
+}
+int SimulatedBackend::i2cSetup(int address)
+{
+	for(int i = 0;i < DEVICE_COUNT;++i)
+	{
+		if(SIM_I2C_ADDRESSES[i] == address)
+		{
+			pthread_mutex_lock(&mMutex);
+			mIsOpened[i] = true;
+			pthread_mutex_unlock(&mMutex);
+			return SIM_I2C_FD_BASE + i;
+		}
+	}
+	return -1;
+}
+int SimulatedBackend::i2cReadReg8(int fd, int reg)
+{
+	if(reg < 0 || reg > 0xff)return -1;
+	pthread_mutex_lock(&mMutex);
+	DEVICE device = getDevice(fd);
+	if(device == DEVICE_COUNT)
+	{
+		pthread_mutex_unlock(&mMutex);
+		return -1;
+	}
+	step();
+	int value = readRegister(device, reg);
+	pthread_mutex_unlock(&mMutex);
+	return value;
+}
+int SimulatedBackend::i2cReadBlock(int fd, int reg, unsigned char* pData, int length)
+{
+	if(reg < 0 || reg > 0xff || length <= 0)return -1;
+	pthread_mutex_lock(&mMutex);
+	DEVICE device = getDevice(fd);
+	if(device == DEVICE_COUNT)
+	{
+		pthread_mutex_unlock(&mMutex);
+		return -1;
+	}
+	step();
+
+	//L3GD20はサブアドレスの最上位ビットが立っている場合のみアドレスを自動で進める
+	bool isAutoIncrement = true;
+	if(device == DEVICE_GYRO)
+	{
+		isAutoIncrement = (reg & 0x80) != 0;
+		reg &= 0x7f;
+	}
+	for(int i = 0;i < length;++i)
+	{
+		pData[i] = readRegister(device, reg);
+		if(!isAutoIncrement)continue;
+		reg = (reg + 1) & 0xff;
+		//FIFOが有効な場合はOUT_Z_Hの次はOUT_X_Lに戻る(複数のサンプルを連続で読める)
+		if(device == DEVICE_GYRO && reg == 0x2E && (mRegisters[DEVICE_GYRO][0x24] & 0x40))reg = 0x28;
+		//MMA8451QもFIFOが有効な場合はOUT_Z_LSBの次はOUT_X_MSBに戻る
+		if(device == DEVICE_ACCEL && reg == 0x07 && (mRegisters[DEVICE_ACCEL][0x09] & 0xC0))reg = 0x01;
+	}
+	pthread_mutex_unlock(&mMutex);
+	return length;
+}
+int SimulatedBackend::readRegister(DEVICE device, int reg)
+{
+	int value = mRegisters[device][reg];
+	switch(device)
+	{
+	case DEVICE_GPS:
+		if(reg == 0x00)
+		{
+			//ステータス(上位4bitが衛星数、0x06が測位済み、0x01が新しいデータ)
+			value = (mSatelites > 15 ? 15 : mSatelites) << 4;
+			if(mSatelites >= 4)value |= 0x06;
+			//新しいデータのフラグはドライバの1回の読み取り(2回読み)の間だけ立てる
+			if(mGpsStatusReadCount++ < 2)value |= 0x01;
+		}
+		break;
+	case DEVICE_GYRO:
+		if(reg == 0x27)
+		{
+			//STATUS_REG
+			value = 0;
+			if(mGyroFifoCount > 0)value |= 0x0F;
+			if(mIsGyroOverrun)value |= 0xF0;
+		}else if(reg == 0x2F)
+		{
+			//FIFO_SRC_REG
+			value = mGyroFifoCount >= GYRO_FIFO_SIZE ? GYRO_FIFO_SIZE - 1 : mGyroFifoCount;
+			if(mGyroFifoCount == 0)value |= 0x20;
+			if(mIsGyroOverrun)value |= 0x40;
+			if(mGyroFifoCount >= (mRegisters[DEVICE_GYRO][0x2E] & 0x1Fu))value |= 0x80;
+		}else if(reg >= 0x28 && reg <= 0x2D)
+		{
+			//OUT_X_L〜OUT_Z_H(BLEが立っている場合は下位アドレスが上位バイト)
+			short sample = mGyroFifo[mGyroFifoHead][(reg - 0x28) / 2];
+			bool isLowerAddress = ((reg - 0x28) % 2) == 0;
+			bool isBigEndian = (mRegisters[DEVICE_GYRO][0x23] & 0x40) != 0;
+			value = (isLowerAddress != isBigEndian) ? (sample & 0xff) : ((sample >> 8) & 0xff);
+			//OUT_Z_Hまで読んだら次のサンプルに進む
+			if(reg == 0x2D && mGyroFifoCount > 0)
+			{
+				mGyroFifoHead = (mGyroFifoHead + 1) % GYRO_FIFO_SIZE;
+				--mGyroFifoCount;
+				mIsGyroOverrun = false;
+			}
+		}
+		break;
+	case DEVICE_ACCEL:
+		if(reg == 0x00)
+		{
+			if(mRegisters[DEVICE_ACCEL][0x09] & 0xC0)
+			{
+				//F_STATUS(F_OVF、F_CNT)
+				value = mAccelFifoCount;
+				if(mIsAccelOverflow)value |= 0x80;
+			}else
+			{
+				//STATUS(ZYXDR)
+				value = mAccelFifoCount > 0 ? 0x08 : 0;
+			}
+		}else if(reg >= 0x01 && reg <= 0x06)
+		{
+			//OUT_X_MSB〜OUT_Z_LSB(14bit左詰め、空の場合は最後のサンプルのまま)
+			unsigned int index = mAccelFifoCount > 0 ? mAccelFifoHead : (mAccelFifoHead + ACCEL_FIFO_SIZE - 1) % ACCEL_FIFO_SIZE;
+			short sample = mAccelFifo[index][(reg - 0x01) / 2] << 2;
+			value = ((reg - 0x01) % 2) == 0 ? ((sample >> 8) & 0xff) : (sample & 0xff);
+			//OUT_Z_LSBまで読んだら次のサンプルに進む
+			if(reg == 0x06 && mAccelFifoCount > 0)
+			{
+				mAccelFifoHead = (mAccelFifoHead + 1) % ACCEL_FIFO_SIZE;
+				--mAccelFifoCount;
+				mIsAccelOverflow = false;
+			}
+		}
+		break;
+	default:
+		break;
+	}
+	return value;
+}
+int SimulatedBackend::i2cWriteReg8(int fd, int reg, int data)
+{
+	if(reg < 0 || reg > 0xff)return -1;
+	pthread_mutex_lock(&mMutex);
+	DEVICE device = getDevice(fd);
+	if(device == DEVICE_COUNT)
+	{
+		pthread_mutex_unlock(&mMutex);
+		return -1;
+	}
+	step();
+
+	mRegisters[device][reg] = data & 0xff;
+	if(device == DEVICE_PRESSURE && reg == 0x12)latchPressure();//変換開始
+	pthread_mutex_unlock(&mMutex);
+	return 0;
+}
+void SimulatedBackend::i2cClose(int fd)
+{
+	pthread_mutex_lock(&mMutex);
+	DEVICE device = getDevice(fd);
+	if(device != DEVICE_COUNT)mIsOpened[device] = false;
+	pthread_mutex_unlock(&mMutex);
+}
+
+void SimulatedBackend::pinMode(int pin, int mode)
+{
+	if(pin < 0 || pin >= PIN_COUNT)return;
+	pthread_mutex_lock(&mMutex);
+	mPinModes[pin] = mode;
+	pthread_mutex_unlock(&mMutex);
+}
+int SimulatedBackend::digitalRead(int pin)
+{
+	if(pin < 0 || pin >= PIN_COUNT)return LOW;
+	pthread_mutex_lock(&mMutex);
+	int value = mPinValues[pin];
+	if(pin == PIN_DISTANCE && mPinModes[pin] == INPUT && mIsEchoRequested)
+	{
+		//送信から一定時間後に、物体までの往復時間だけHIGHを返す
+		struct timespec now;
+		getRawTime(now);
+		double elapsed = Time::dt(now, mEchoStartTime) - SIM_DISTANCE_ECHO_DELAY;
+		value = (elapsed >= 0 && elapsed < mDistance * 2 / SIM_SOUND_SPEED) ? HIGH : LOW;
+		if(elapsed >= mDistance * 2 / SIM_SOUND_SPEED)mIsEchoRequested = false;
+	}
+	pthread_mutex_unlock(&mMutex);
+	return value;
+}
+void SimulatedBackend::digitalWrite(int pin, int value)
+{
+	if(pin < 0 || pin >= PIN_COUNT)return;
+	pthread_mutex_lock(&mMutex);
+	if(pin == PIN_DISTANCE && mPinModes[pin] == OUTPUT && mPinValues[pin] == HIGH && value == LOW)
+	{
+		//トリガーパルスの終わりで超音波を送信する
+		mIsEchoRequested = true;
+		getRawTime(mEchoStartTime);
+
+		//エコーの始まりと終わりのエッジ
+		addEdge(pin, HIGH, SIM_DISTANCE_ECHO_DELAY);
+		addEdge(pin, LOW, SIM_DISTANCE_ECHO_DELAY + mDistance * 2 / SIM_SOUND_SPEED);
+	}
+	//出力の変化もエッジとして検出される(トリガーパルス)
+	if(mPinValues[pin] != value)addEdge(pin, value, 0);
+	mPinValues[pin] = value;
+	pthread_mutex_unlock(&mMutex);
+}
+
+int SimulatedBackend::softPwmCreate(int pin, int initialValue, int range)
+{
+	if(pin < 0 || pin >= PIN_COUNT || range <= 0)return -1;
+	pthread_mutex_lock(&mMutex);
+	step();
+	mPwmRanges[pin] = range;
+	mPwmValues[pin] = initialValue;
+	pthread_mutex_unlock(&mMutex);
+	return 0;
+}
+void SimulatedBackend::softPwmWrite(int pin, int value)
+{
+	if(pin < 0 || pin >= PIN_COUNT)return;
+	pthread_mutex_lock(&mMutex);
+	//出力が変わる前の状態で模擬環境を進める
+	step();
+	if(value < 0)value = 0;
+	else if(value > mPwmRanges[pin])value = mPwmRanges[pin];
+	mPwmValues[pin] = value;
+	pthread_mutex_unlock(&mMutex);
+}
+
+void SimulatedBackend::pwmSetMode(int mode)
+{
+	//ハードウェアPWM(サーボ)の出力は模擬しない
+}
+void SimulatedBackend::pwmSetRange(unsigned int range)
+{
+}
+void SimulatedBackend::pwmSetClock(int divisor)
+{
+}
+void SimulatedBackend::pwmWrite(int pin, int value)
+{
+	if(pin < 0 || pin >= PIN_COUNT)return;
+	pthread_mutex_lock(&mMutex);
+	mPwmValues[pin] = value;
+	pthread_mutex_unlock(&mMutex);
+}
+
+void* SimulatedBackend::isrThread(void* arg)
+{
+	//モータの出力に応じてエンコーダの割り込みを発生させる
+	SimulatedBackend& parent = *reinterpret_cast<SimulatedBackend*>(arg);
+	struct timespec lastTime, now;
+	getRawTime(lastTime);
+	while(parent.mIsISRThreadRunning)
+	{
+		usleep(1000);
+		getRawTime(now);
+		double dt = Time::dt(now, lastTime);
+		lastTime = now;
+
+		const static int ENCODER_PINS[2] = {PIN_PULSE_A, PIN_PULSE_B};
+		void (*functions[2])(void);
+		unsigned int pulses[2];
+
+		pthread_mutex_lock(&parent.mMutex);
+		double powers[2] = {parent.getMotorPower(PIN_PWM_A, PIN_INVERT_MOTOR_A), parent.getMotorPower(PIN_PWM_B, PIN_INVERT_MOTOR_B)};
+		for(int i = 0;i < 2;++i)
+		{
+			int pin = ENCODER_PINS[i];
+			functions[i] = parent.mpISR[pin];
+			double count = parent.mPulseRemainder[pin] + fabs(powers[i]) * SIM_ENCODER_MAX_PULSE_RATE * dt;
+			pulses[i] = (unsigned int)count;
+			parent.mPulseRemainder[pin] = count - pulses[i];
+		}
+		pthread_mutex_unlock(&parent.mMutex);
+
+		//割り込み処理はロックを外してから呼び出す
+		for(int i = 0;i < 2;++i)
+		{
+			if(functions[i] == NULL)continue;
+			for(unsigned int j = 0;j < pulses[i];++j)functions[i]();
+		}
+	}
+	return NULL;
+}
+int SimulatedBackend::setISR(int pin, int edgeType, void (*function)(void))
+{
+	if(pin < 0 || pin >= PIN_COUNT)return -1;
+	pthread_mutex_lock(&mMutex);
+	mpISR[pin] = function;
+	mPulseRemainder[pin] = 0;
+	pthread_mutex_unlock(&mMutex);
+
+	if(!mIsISRThreadRunning)
+	{
+		mIsISRThreadRunning = true;
+		if(pthread_create(&mISRThread, NULL, isrThread, this) != 0)
+		{
+			mIsISRThreadRunning = false;
+			return -1;
+		}
+	}
+	return 0;
+}
+void SimulatedBackend::clearISR(int pin)
+{
+	if(pin < 0 || pin >= PIN_COUNT)return;
+	pthread_mutex_lock(&mMutex);
+	mpISR[pin] = NULL;
+	pthread_mutex_unlock(&mMutex);
+}
+
+void SimulatedBackend::addEdge(int pin, int value, double delay)
+{
+	if(mEdgeTypes[pin] == -1)return;
+	if(mEdgeTypes[pin] == INT_EDGE_RISING && value != HIGH)return;
+	if(mEdgeTypes[pin] == INT_EDGE_FALLING && value != LOW)return;
+
+	Edge edge;
+	edge.value = value;
+	clock_gettime(CLOCK_MONOTONIC, &edge.time);
+	addTime(edge.time, delay);
+
+	//時刻順に挿入する
+	std::deque<Edge>& edges = mEdges[pin];
+	std::deque<Edge>::iterator it = edges.end();
+	while(it != edges.begin() && Time::dt((it - 1)->time, edge.time) > 0)--it;
+	edges.insert(it, edge);
+	pthread_cond_broadcast(&mEdgeCond);
+}
+int SimulatedBackend::edgeOpen(int pin, int edgeType)
+{
+	if(pin < 0 || pin >= PIN_COUNT)return -1;
+	pthread_mutex_lock(&mMutex);
+	mEdgeTypes[pin] = edgeType == INT_EDGE_SETUP ? INT_EDGE_BOTH : edgeType;
+	mEdges[pin].clear();
+	pthread_mutex_unlock(&mMutex);
+	return SIM_EDGE_FD_BASE + pin;
+}
+int SimulatedBackend::edgeWait(int handle, int timeout, int& value, struct timespec& time)
+{
+	int pin = handle - SIM_EDGE_FD_BASE;
+	if(pin < 0 || pin >= PIN_COUNT)return -1;
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	addTime(deadline, timeout / 1000.0);
+
+	pthread_mutex_lock(&mMutex);
+	int result = 0;
+	while(mEdgeTypes[pin] != -1)
+	{
+		//時刻を過ぎたエッジがあれば返す
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		std::deque<Edge>& edges = mEdges[pin];
+		if(!edges.empty() && Time::dt(now, edges.front().time) >= 0)
+		{
+			value = edges.front().value;
+			time = edges.front().time;
+			edges.pop_front();
+			result = 1;
+			break;
+		}
+		if(Time::dt(now, deadline) >= 0)break;
+
+		//次のエッジの時刻かタイムアウトまで待つ(エッジが追加されたら起きる)
+		struct timespec wake = deadline;
+		if(!edges.empty() && Time::dt(edges.front().time, wake) < 0)wake = edges.front().time;
+		pthread_cond_timedwait(&mEdgeCond, &mMutex, &wake);
+	}
+	pthread_mutex_unlock(&mMutex);
+	return result;
+}
+void SimulatedBackend::edgeClose(int handle)
+{
+	int pin = handle - SIM_EDGE_FD_BASE;
+	if(pin < 0 || pin >= PIN_COUNT)return;
+	pthread_mutex_lock(&mMutex);
+	mEdgeTypes[pin] = -1;
+	mEdges[pin].clear();
+	pthread_cond_broadcast(&mEdgeCond);
+	pthread_mutex_unlock(&mMutex);
+}
+
+void SimulatedBackend::delay(unsigned int ms)
+{
+	usleep(ms * 1000);
+}
+
+void SimulatedBackend::setPressure(double pressure)
+{
+	pthread_mutex_lock(&mMutex);
+	mPressure = pressure;
+	pthread_mutex_unlock(&mMutex);
+}
+void SimulatedBackend::setAccel(const VECTOR3& accel)
+{
+	pthread_mutex_lock(&mMutex);
+	mAccel = accel;
+	pthread_mutex_unlock(&mMutex);
+}
+void SimulatedBackend::setRotation(const VECTOR3& rotation)
+{
+	pthread_mutex_lock(&mMutex);
+	step();
+	mRotation = rotation;
+	pthread_mutex_unlock(&mMutex);
+}
+void SimulatedBackend::setLight(bool bright)
+{
+	//CdSセンサは明るいときにLOWになる
+	pthread_mutex_lock(&mMutex);
+	int value = bright ? LOW : HIGH;
+	bool isChanged = mPinValues[PIN_LIGHT_SENSOR] != value;
+	mPinValues[PIN_LIGHT_SENSOR] = value;
+	void (*function)(void) = mpISR[PIN_LIGHT_SENSOR];
+	pthread_mutex_unlock(&mMutex);
+
+	//変化した場合は割り込みを発生させる(割り込み処理はロックを外してから呼び出す)
+	if(isChanged && function != NULL)function();
+}
+void SimulatedBackend::setPosition(double longitude, double latitude, double altitude)
+{
+	pthread_mutex_lock(&mMutex);
+	mLongitude = longitude;
+	mLatitude = latitude;
+	mAltitude = altitude;
+	updateGpsRegisters();
+	pthread_mutex_unlock(&mMutex);
+}
+void SimulatedBackend::setSatelites(int satelites)
+{
+	pthread_mutex_lock(&mMutex);
+	mSatelites = satelites;
+	pthread_mutex_unlock(&mMutex);
+}
+void SimulatedBackend::setDistance(double distance)
+{
+	pthread_mutex_lock(&mMutex);
+	mDistance = distance;
+	pthread_mutex_unlock(&mMutex);
+}
+void SimulatedBackend::showState()
+{
+	pthread_mutex_lock(&mMutex);
+	step();
+	Debug::print(LOG_SUMMARY, "Simulator\r\n Pressure: %f hPa\r\n Accel: %f %f %f g\r\n Rotation: %f %f %f dps\r\n",
+		mPressure, mAccel.x, mAccel.y, mAccel.z, mRotation.x, mRotation.y, mRotation.z + mYawRate);
+	Debug::print(LOG_SUMMARY, " Position: %f %f %f (%d satelites)\r\n Course: %f Speed: %f\r\n Light: %s Distance: %f m\r\n",
+		mLongitude, mLatitude, mAltitude, mSatelites, mCourse, mSpeed, mPinValues[PIN_LIGHT_SENSOR] == LOW ? "bright" : "dark", mDistance);
+	pthread_mutex_unlock(&mMutex);
+}
+
+//////////////////////////////////////////////
+// Simulator Control
+//////////////////////////////////////////////
+bool SimulatorControl::onCommand(const std::vector<std::string>& args)
+{
+	SimulatedBackend* pSim = SimulatedBackend::getInstance();
+	if(args.size() == 1)
+	{
+		pSim->showState();
+		return true;
+	}
+	if(args.size() == 3)
+	{
+		double value = atof(args[2].c_str());
+		if(args[1].compare("pressure") == 0)
+		{
+			pSim->setPressure(value);
+			return true;
+		}else if(args[1].compare("light") == 0)
+		{
+			pSim->setLight(args[2].compare("on") == 0);
+			return true;
+		}else if(args[1].compare("sats") == 0)
+		{
+			pSim->setSatelites(atoi(args[2].c_str()));
+			return true;
+		}else if(args[1].compare("distance") == 0)
+		{
+			pSim->setDistance(value);
+			return true;
+		}
+	}else if(args.size() == 5)
+	{
+		VECTOR3 vec;
+		vec.x = atof(args[2].c_str());
+		vec.y = atof(args[3].c_str());
+		vec.z = atof(args[4].c_str());
+		if(args[1].compare("accel") == 0)
+		{
+			pSim->setAccel(vec);
+			return true;
+		}else if(args[1].compare("gyro") == 0)
+		{
+			pSim->setRotation(vec);
+			return true;
+		}else if(args[1].compare("gps") == 0)
+		{
+			pSim->setPosition(vec.x, vec.y, vec.z);
+			return true;
+		}
+	}
+	Debug::print(LOG_PRINT, "sim                     : show simulator state\r\n\
+sim pressure [hPa]      : set pressure\r\n\
+sim light [on/off]      : set light\r\n\
+sim sats [count]        : set GPS satelites\r\n\
+sim distance [m]        : set distance sensor target\r\n\
+sim accel [x] [y] [z]   : set acceleration (g)\r\n\
+sim gyro [x] [y] [z]    : set external rotation (dps)\r\n\
+sim gps [lon] [lat] [alt]: set position\r\n");
+	return true;
+}
+SimulatorControl::SimulatorControl()
+{
+	setName("sim");
+	setPriority(UINT_MAX,UINT_MAX);
+}
+SimulatorControl::~SimulatorControl()
+{
+}
@@ -0,0 +1,155 @@
+/*
+	ハードウェアシミュレータ
+
+	make SIM=1でビルドした場合にHalのバックエンドとして使われます
+	・コードが使っているレジスタマップの範囲でI2Cセンサを模擬します
+	  (気圧センサMPL115A2:0x60、GPS(Navigatron):0x20、ジャイロL3GD20:0x6b、加速度センサMMA8451Q:0x1d)
+	・モータのPWM出力からローバーの移動と回転を計算し、ジャイロ/GPS/エンコーダの値に反映します
+	・simコマンドで気圧や明るさなどの環境を変更できます
+*/
+#pragma once
+#include <pthread.h>
+#include <time.h>
+#include <deque>
+#include "hal.h"
+#include "task.h"
+#include "utils.h"
+
+class SimulatedBackend : public HalBackend
+{
+public:
+	enum DEVICE {DEVICE_PRESSURE, DEVICE_GPS, DEVICE_GYRO, DEVICE_ACCEL, DEVICE_COUNT};
+	const static int PIN_COUNT = 64;
+	const static unsigned int GYRO_FIFO_SIZE = 32;
+	const static unsigned int ACCEL_FIFO_SIZE = 32;
+private:
+	pthread_mutex_t mMutex;
+
+	//I2Cデバイスのレジスタ
+	unsigned char mRegisters[DEVICE_COUNT][256];
+	bool mIsOpened[DEVICE_COUNT];
+
+	//ジャイロのFIFO(生の値)
+	short mGyroFifo[GYRO_FIFO_SIZE][3];
+	unsigned int mGyroFifoHead,mGyroFifoCount;
+	bool mIsGyroOverrun;
+	double mGyroSampleTimer;//次のサンプルまでの時間(秒)
+
+	//加速度センサのFIFO(14bitの生の値)
+	short mAccelFifo[ACCEL_FIFO_SIZE][3];
+	unsigned int mAccelFifoHead,mAccelFifoCount;
+	bool mIsAccelOverflow;
+	double mAccelSampleTimer;
+
+	//GPSのレジスタ更新
+	double mGpsUpdateTimer;
+	unsigned int mGpsStatusReadCount;
+
+	//模擬している環境
+	struct timespec mLastStepTime;
+	double mPressure;//気圧(hPa)
+	VECTOR3 mAccel;//加速度(g)
+	VECTOR3 mRotation;//外部から与える角速度(dps)
+	double mYawRate;//モータによる旋回の角速度(dps)
+	double mLongitude,mLatitude,mAltitude;//GPS座標
+	double mCourse,mSpeed;//進行方向(度)と速さ(m/s)
+	int mSatelites;
+	double mDistance;//距離センサの前にある物体までの距離(m)
+
+	//GPIO/PWM
+	int mPinModes[PIN_COUNT];
+	int mPinValues[PIN_COUNT];
+	int mPwmValues[PIN_COUNT];
+	int mPwmRanges[PIN_COUNT];
+	struct timespec mEchoStartTime;//距離センサの超音波を送信した時刻
+	bool mIsEchoRequested;
+
+	//割り込み
+	void (*mpISR[PIN_COUNT])(void);
+	double mPulseRemainder[PIN_COUNT];
+	pthread_t mISRThread;
+	volatile bool mIsISRThreadRunning;
+	static void* isrThread(void* arg);
+
+	//エッジ検出(edgeOpenされたピンのエッジを時刻付きで溜める、時刻はCLOCK_MONOTONIC)
+	struct Edge
+	{
+		int value;
+		struct timespec time;
+	};
+	int mEdgeTypes[PIN_COUNT];//検出するエッジ(edgeOpenされていなければ-1)
+	std::deque<Edge> mEdges[PIN_COUNT];//時刻順
+	pthread_cond_t mEdgeCond;
+	//エッジを追加する(mMutexをロックしてから呼ぶこと、delayは現在からの遅れ(秒))
+	void addEdge(int pin, int value, double delay);
+
+	//前回呼び出されてからの経過時間だけ模擬環境を進める(mMutexをロックしてから呼ぶこと)
+	void step();
+	void stepGyro(double dt);
+	void updateGpsRegisters();
+	void latchPressure();
+	void stepAccel(double dt);
+	//モータの出力(-1〜1)
+	double getMotorPower(int pwmPin, int reversePin);
+	//fdに対応するデバイス(無効な場合はDEVICE_COUNT)
+	DEVICE getDevice(int fd);
+	//レジスタを1バイト読み込む(mMutexをロックしてから呼ぶこと)
+	int readRegister(DEVICE device, int reg);
+
+	SimulatedBackend();
+public:
+	static SimulatedBackend* getInstance();
+
+	virtual bool setup();
+
+	virtual int i2cSetup(int address);
+	virtual int i2cReadReg8(int fd, int reg);
+	virtual int i2cWriteReg8(int fd, int reg, int data);
+	virtual void i2cClose(int fd);
+	virtual int i2cReadBlock(int fd, int reg, unsigned char* pData, int length);
+
+	virtual void pinMode(int pin, int mode);
+	virtual int digitalRead(int pin);
+	virtual void digitalWrite(int pin, int value);
+
+	virtual int softPwmCreate(int pin, int initialValue, int range);
+	virtual void softPwmWrite(int pin, int value);
+
+	virtual void pwmSetMode(int mode);
+	virtual void pwmSetRange(unsigned int range);
+	virtual void pwmSetClock(int divisor);
+	virtual void pwmWrite(int pin, int value);
+
+	virtual int setISR(int pin, int edgeType, void (*function)(void));
+	virtual void clearISR(int pin);
+
+	virtual int edgeOpen(int pin, int edgeType);
+	virtual int edgeWait(int handle, int timeout, int& value, struct timespec& time);
+	virtual void edgeClose(int handle);
+
+	virtual void delay(unsigned int ms);
+
+	//模擬する環境を変更する
+	void setPressure(double pressure);
+	void setAccel(const VECTOR3& accel);
+	void setRotation(const VECTOR3& rotation);
+	void setLight(bool bright);
+	void setPosition(double longitude, double latitude, double altitude);
+	void setSatelites(int satelites);
+	void setDistance(double distance);
+	void showState();
+
+	virtual ~SimulatedBackend();
+};
+
+//simコマンドを受け付けるタスク
+class SimulatorControl : public TaskBase
+{
+protected:
+	virtual bool onCommand(const std::vector<std::string>& args);
+public:
+	SimulatorControl();
+	~SimulatorControl();
+};
+
+extern SimulatorControl gSimulatorControl;
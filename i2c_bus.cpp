@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <errno.h>
+#include "i2c_bus.h"
+#include "utils.h"
+#include "recorder.h"
+
+I2CBus gI2CBus;
+
+I2CJob::I2CJob(const char* name, unsigned int priority, unsigned long long period) : mpName(name), mPriority(priority), mPeriod(period), mNextTime(0), mIsTransferring(false),
+	mTransferCount(0), mErrorCount(0), mTotalLatency(0), mMaxLatency(0), mTotalDelay(0), mMaxDelay(0)
+{
+}
+I2CJob::~I2CJob()
+{
+}
+
+unsigned long long I2CBus::now()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+bool I2CBus::isInline()
+{
+	return Recorder::getMode() != Recorder::MODE_NONE;
+}
+void I2CBus::add(I2CJob* pJob)
+{
+	pthread_mutex_lock(&mMutex);
+	if(std::find(mJobs.begin(), mJobs.end(), pJob) == mJobs.end())
+	{
+		//ドライバのonInitの直後に転送しないように1周期後から実行する
+		pJob->mNextTime = now() + pJob->mPeriod * 1000;
+		mJobs.push_back(pJob);
+	}
+	if(!mIsThreadRunning && !isInline())
+	{
+		mIsThreadRunning = true;
+		if(pthread_create(&mThread, NULL, busThread, this) != 0)
+		{
+			mIsThreadRunning = false;
+			Debug::print(LOG_SUMMARY, "I2CBus: Failed to start thread\r\n");
+		}
+	}
+	pthread_cond_broadcast(&mCond);
+	pthread_mutex_unlock(&mMutex);
+}
+void I2CBus::remove(I2CJob* pJob)
+{
+	pthread_mutex_lock(&mMutex);
+	//転送中ならば終わるまで待つ
+	while(pJob->mIsTransferring)pthread_cond_wait(&mCond, &mMutex);
+	std::vector<I2CJob*>::iterator it = std::find(mJobs.begin(), mJobs.end(), pJob);
+	if(it != mJobs.end())mJobs.erase(it);
+
+	//転送内容がなくなったらスレッドを終了する
+	bool isStopping = mJobs.empty() && mIsThreadRunning;
+	if(isStopping)mIsThreadRunning = false;
+	pthread_cond_broadcast(&mCond);
+	pthread_mutex_unlock(&mMutex);
+	if(isStopping)pthread_join(mThread, NULL);
+}
+void I2CBus::poll(I2CJob* pJob, const struct timespec& time)
+{
+	if(!isInline())return;
+	execute(pJob, now(), time);
+}
+void I2CBus::execute(I2CJob* pJob, unsigned long long due, const struct timespec& time)
+{
+	unsigned long long start = now();
+	bool result = pJob->onTransfer(time);
+	unsigned long long end = now();
+
+	pthread_mutex_lock(&mMutex);
+	++pJob->mTransferCount;
+	if(!result)++pJob->mErrorCount;
+	unsigned long long latency = end - start, delay = start > due ? start - due : 0;
+	pJob->mTotalLatency += latency;
+	if(latency > pJob->mMaxLatency)pJob->mMaxLatency = latency;
+	pJob->mTotalDelay += delay;
+	if(delay > pJob->mMaxDelay)pJob->mMaxDelay = delay;
+	pthread_mutex_unlock(&mMutex);
+}
+void* I2CBus::busThread(void* arg)
+{
+	((I2CBus*)arg)->run();
+	return NULL;
+}
+void I2CBus::run()
+{
+	pthread_mutex_lock(&mMutex);
+	while(mIsThreadRunning)
+	{
+		//実行時刻を過ぎた転送のうち、最も優先度の高いものを探す
+		unsigned long long curTime = now();
+		unsigned long long nextTime = curTime + I2C_BUS_MAX_SLEEP_PERIOD * 1000;
+		I2CJob* pNextJob = NULL;
+		for(std::vector<I2CJob*>::iterator it = mJobs.begin();it != mJobs.end();++it)
+		{
+			I2CJob* pJob = *it;
+			if(pJob->mNextTime <= curTime)
+			{
+				if(pNextJob == NULL || pJob->mPriority < pNextJob->mPriority || (pJob->mPriority == pNextJob->mPriority && pJob->mNextTime < pNextJob->mNextTime))pNextJob = pJob;
+			}else if(pJob->mNextTime < nextTime)nextTime = pJob->mNextTime;
+		}
+
+		if(pNextJob == NULL)
+		{
+			//次の転送の時刻まで待つ(登録/削除されたら起きる)
+			struct timespec timeout;
+			timeout.tv_sec = nextTime / 1000000000ULL;
+			timeout.tv_nsec = nextTime % 1000000000ULL;
+			pthread_cond_timedwait(&mCond, &mMutex, &timeout);
+			continue;
+		}
+
+		//転送中はロックを外す(ドライバの登録/削除を待たせない)
+		unsigned long long due = pNextJob->mNextTime;
+		pNextJob->mIsTransferring = true;
+		pthread_mutex_unlock(&mMutex);
+		struct timespec time;
+		Time::get(time);
+		execute(pNextJob, due, time);
+		pthread_mutex_lock(&mMutex);
+		pNextJob->mIsTransferring = false;
+
+		//次の実行時刻(大きく遅れた場合は追いつこうとしない)
+		pNextJob->mNextTime += pNextJob->mPeriod * 1000;
+		curTime = now();
+		if(pNextJob->mNextTime < curTime)pNextJob->mNextTime = curTime;
+		pthread_cond_broadcast(&mCond);
+	}
+	pthread_mutex_unlock(&mMutex);
+}
+bool I2CBus::onCommand(const std::vector<std::string>& args)
+{
+	pthread_mutex_lock(&mMutex);
+	unsigned long long curTime = now();
+	if(args.size() == 2 && args[1].compare("reset") == 0)
+	{
+		for(std::vector<I2CJob*>::iterator it = mJobs.begin();it != mJobs.end();++it)
+		{
+			I2CJob* pJob = *it;
+			pJob->mTransferCount = pJob->mErrorCount = 0;
+			pJob->mTotalLatency = pJob->mMaxLatency = pJob->mTotalDelay = pJob->mMaxDelay = 0;
+		}
+		mStatsStartTime = curTime;
+		pthread_mutex_unlock(&mMutex);
+		Debug::print(LOG_SUMMARY, "I2CBus: statistics reset\r\n");
+		return true;
+	}
+
+	//転送内容ごとの実行頻度、所要時間、開始の遅れを表示
+	double elapsed = (curTime - mStatsStartTime) / 1000000000.0;
+	Debug::print(LOG_SUMMARY, "I2CBus: %s, %u jobs\r\n", isInline() ? "inline" : (mIsThreadRunning ? "running" : "stopped"), (unsigned int)mJobs.size());
+	Debug::print(LOG_SUMMARY, " Name       Priority  Rate(Hz)  Latency avg/max(us)  Delay avg/max(us)  Errors\r\n");
+	for(std::vector<I2CJob*>::iterator it = mJobs.begin();it != mJobs.end();++it)
+	{
+		I2CJob* pJob = *it;
+		unsigned long long count = pJob->mTransferCount == 0 ? 1 : pJob->mTransferCount;
+		Debug::print(LOG_SUMMARY, " %-10s %8u %9.1f %9llu/%-9llu %8llu/%-8llu %7llu\r\n", pJob->mpName, pJob->mPriority, elapsed > 0 ? pJob->mTransferCount / elapsed : 0,
+			pJob->mTotalLatency / count / 1000, pJob->mMaxLatency / 1000, pJob->mTotalDelay / count / 1000, pJob->mMaxDelay / 1000, pJob->mErrorCount);
+	}
+	pthread_mutex_unlock(&mMutex);
+	Debug::print(LOG_PRINT, "i2cbus reset : reset statistics\r\n");
+	return true;
+}
+I2CBus::I2CBus() : mIsThreadRunning(false), mStatsStartTime(now())
+{
+	setName("i2cbus");
+	setPriority(UINT_MAX,UINT_MAX);
+
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&mCond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+I2CBus::~I2CBus()
+{
+}
@@ -0,0 +1,120 @@
+/*
+	I2Cバス管理クラス
+
+	I2Cの転送を専用のスレッドでまとめて実行し、結果をドライバに渡します
+	・ドライバは転送内容をI2CTransactionとして優先度と実行周期を指定して登録する(onInitでadd、onCleanでremove)
+	・スレッドは実行時刻を過ぎた転送を優先度の高い順に続けて実行する
+	・ドライバはonUpdateでreceiveを呼び、新しい結果があれば受け取る(メインループはI2Cの転送を待たない)
+	・記録/再生中(Recorder)はスレッドを使わず、pollを呼んだときにメインスレッドで転送する
+	・i2cbusコマンドで転送ごとの実行頻度と所要時間を表示します
+*/
+#pragma once
+#include <pthread.h>
+#include <time.h>
+#include <vector>
+#include "task.h"
+
+class I2CBus;
+
+//I2Cの転送内容
+class I2CJob
+{
+	friend class I2CBus;
+	const char* mpName;
+	unsigned int mPriority;//小さいほど優先
+	unsigned long long mPeriod;//実行周期(us)
+	unsigned long long mNextTime;//次の実行時刻(ns)
+	bool mIsTransferring;
+
+	//統計
+	unsigned long long mTransferCount, mErrorCount;
+	unsigned long long mTotalLatency, mMaxLatency;//転送にかかった時間(ns)
+	unsigned long long mTotalDelay, mMaxDelay;//実行時刻から転送を開始するまでの遅れ(ns)
+protected:
+	//I2Cの転送を行う(バスのスレッドから呼ばれる、失敗時はfalse)
+	virtual bool onTransfer(const struct timespec& time) = 0;
+public:
+	I2CJob(const char* name, unsigned int priority, unsigned long long period);
+	virtual ~I2CJob();
+};
+
+//転送結果をドライバに渡す転送内容(Tは転送結果の型)
+template<class T> class I2CTransaction : public I2CJob
+{
+	pthread_mutex_t mMutex;
+	T mResult;//受け取り待ちの結果
+	bool mIsNew;
+protected:
+	//転送を行いresultに書き込む(失敗時はfalse)
+	virtual bool transfer(T& result, const struct timespec& time) = 0;
+	//受け取り待ちの結果に新しい結果を反映する(標準では上書き)
+	virtual void merge(T& pending, const T& result)
+	{
+		pending = result;
+	}
+	virtual bool onTransfer(const struct timespec& time)
+	{
+		T result;
+		if(!transfer(result, time))return false;
+		pthread_mutex_lock(&mMutex);
+		merge(mResult, result);
+		mIsNew = true;
+		pthread_mutex_unlock(&mMutex);
+		return true;
+	}
+public:
+	//新しい結果があればresultに書き込んでtrueを返す(バスのスレッドが結果を書き込み中なら待たずにfalse)
+	bool receive(T& result)
+	{
+		if(pthread_mutex_trylock(&mMutex) != 0)return false;
+		bool isNew = mIsNew;
+		if(isNew)
+		{
+			result = mResult;
+			mResult = T();
+			mIsNew = false;
+		}
+		pthread_mutex_unlock(&mMutex);
+		return isNew;
+	}
+
+	I2CTransaction(const char* name, unsigned int priority, unsigned long long period) : I2CJob(name, priority, period), mResult(), mIsNew(false)
+	{
+		pthread_mutex_init(&mMutex, NULL);
+	}
+	virtual ~I2CTransaction()
+	{
+		pthread_mutex_destroy(&mMutex);
+	}
+};
+
+class I2CBus : public TaskBase
+{
+	std::vector<I2CJob*> mJobs;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mCond;
+	pthread_t mThread;
+	bool mIsThreadRunning;
+	unsigned long long mStatsStartTime;//ns
+
+	static void* busThread(void* arg);
+	void run();
+	//転送を実行して統計を更新する(dueは実行予定時刻(ns)、timeはドライバに渡す時刻)
+	void execute(I2CJob* pJob, unsigned long long due, const struct timespec& time);
+	//記録/再生中はメインスレッドで転送する
+	static bool isInline();
+	static unsigned long long now();
+protected:
+	virtual bool onCommand(const std::vector<std::string>& args);
+public:
+	//転送内容を登録/削除する(removeは実行中の転送が終わるまで待つ)
+	void add(I2CJob* pJob);
+	void remove(I2CJob* pJob);
+	//ドライバのonUpdateから呼び出す(記録/再生中のみ、その場で転送する)
+	void poll(I2CJob* pJob, const struct timespec& time);
+
+	I2CBus();
+	~I2CBus();
+};
+
+extern I2CBus gI2CBus;
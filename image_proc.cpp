@@ -7,7 +7,47 @@
 ImageProc gImageProc;
 
 /* ここから　2014年実装 */
-// 実行速度：0.22~0.24sec
+void ImageProc::findColor(const cv::Mat& hsv, ColorRegion& region)
+{
+	//閾値の判定を表引きにする(ビット0:H 1:S 2:V、すべて満たせば7)
+	unsigned char table[3][256];
+	for(int i = 0; i < 256; i++)
+	{
+		table[0][i] = (i <= (int)mHMinThreshold || (int)mHMaxThreshold <= i) ? 1 : 0;
+		table[1][i] = ((int)mSMinThreshold <= i) ? 2 : 0;
+		table[2][i] = ((int)mVMinThreshold <= i) ? 4 : 0;
+	}
+
+	region.count = 0;
+	region.min_x = region.min_y = region.max_x = region.max_y = -1;
+	region.sum_x = region.sum_y = 0;
+	for(int y = 0; y < hsv.rows; y++)
+	{
+		const unsigned char* p = hsv.ptr<unsigned char>(y);
+		unsigned int row_count = 0;
+		unsigned long long row_sum_x = 0;
+		int row_min_x = -1, row_max_x = -1;
+		for(int x = 0; x < hsv.cols; x++, p += 3)
+		{
+			if((table[0][p[0]] | table[1][p[1]] | table[2][p[2]]) != 7)continue;
+			if(row_min_x == -1)row_min_x = x;
+			row_max_x = x;
+			row_sum_x += x;
+			row_count++;
+		}
+		if(row_count == 0)continue;
+
+		//行ごとの結果をまとめる
+		if(region.min_y == -1)region.min_y = y;
+		region.max_y = y;
+		if(region.min_x == -1 || row_min_x < region.min_x)region.min_x = row_min_x;
+		if(row_max_x > region.max_x)region.max_x = row_max_x;
+		region.count += row_count;
+		region.sum_x += row_sum_x;
+		region.sum_y += (unsigned long long)y * row_count;
+	}
+}
+// 実行速度：平滑化とHSV変換の後、抽出と重心計算はHSV画像を1回走査するだけ(以前の実装は0.22~0.24sec)
 int ImageProc::howColorGap(IplImage* src, double *counter)
 {
 	if(src == NULL)//カメラが死んでる場合
@@ -17,14 +57,7 @@ int ImageProc::howColorGap(IplImage* src, double *counter)
 	}
 	
 	int x_gap = 0;												//返り値(中心からのX位置のずれ)
-	cv::Mat input_img;											//カメラ
-	cv::Mat hsv_img;											//HSV
-	cv::Mat smooth_img;											//平滑化後
-	cv::Mat hsv_color_img = cv::Mat(cv::Size(320,240),CV_8UC3);	//抽出後
-	cv::Mat gray_img;											//グレースケール化後
-	cv::Mat mono_img;											//二値化後
-	cv::Mat tmp_img;											//一時Mat
-	cv::Moments moments;										//重心計算用
+	ColorRegion region;											//抽出結果
 
 	//////////threshold//////////
 	// H <= mHMinThreshold, mHMaxThreshold <= H
@@ -33,108 +66,31 @@ int ImageProc::howColorGap(IplImage* src, double *counter)
 	//if distance >= mDistanceThreshold and area >= mGoalAreaThreshold then goal;
 	////////////////////////////
 
-	input_img = cv::cvarrToMat(src);						//カメラのストリーミング先を設定
-	cv::medianBlur(input_img,smooth_img,7);					//ノイズがあるので平滑化
-	cv::cvtColor(smooth_img,hsv_img,CV_BGR2HSV);			//HSVに変換(グローバル)
-	hsv_color_img = smooth_img.clone();						//平滑化データをコピー
+	cv::Mat input_img = cv::cvarrToMat(src);				//カメラのストリーミング先を設定
+	cv::medianBlur(input_img,mSmoothImage,7);				//ノイズがあるので平滑化(バッファは使い回す)
+	cv::cvtColor(mSmoothImage,mHsvImage,CV_BGR2HSV);		//HSVに変換
+	findColor(mHsvImage, region);							//抽出色の画素数、範囲、重心を求める
 
-	int count = 240*320;
+	int area = mHsvImage.rows*mHsvImage.cols;
+	int count = region.count;
+	double distance = region.max_y-region.min_y;
 
-	//////////座標検索///////////////////////////////////////
-	double min_x = -1; //
-	double min_y = -1; //
-	double max_x = -1; //
-	double max_y = -1; //
-
-	for(int y=0; y<240; y++)
+	if(count > 0)
 	{
-		for(int x=0; x<320; x++)
-		{
-			int a = hsv_img.step*y+(x*3);//参照番号を設定
-
-			if(hsv_img.data[a] <= mHMinThreshold || mHMaxThreshold <= hsv_img.data[a])
-			{
-				if(mSMinThreshold <= hsv_img.data[a+1])
-				{
-					if(mVMinThreshold <= hsv_img.data[a+2])
-					{
-						min_x = x;
-						min_y = y;
-						break;
-					}
-				}
-			}
-		}
-		if ( min_x != -1 && min_y != -1 )
-		{
-			break;
-		}
+		int gX = region.sum_x / count;										//重心X位置計算
+		// int gY = region.sum_y / count;									//重心Y位置計算
+		x_gap = -mHsvImage.cols/2 + gX;										//中心からのX位置のずれを設定
 	}
-	for(int y=240-1; y>=0; y--)
-	{
-		for(int x=320-1; x>=0; x--)
-		{
-			int a = hsv_img.step*y+(x*3);//参照番号を設定
-			
-			if(hsv_img.data[a] <= mHMinThreshold || mHMaxThreshold <= hsv_img.data[a])
-			{
-				if(mSMinThreshold <= hsv_img.data[a+1])
-				{
-					if(mVMinThreshold <= hsv_img.data[a+2])
-					{
-						max_x = x;
-						max_y = y;
-						break;
-					}
-				}
-			}
-		}
-		if ( max_x != -1 && max_y != -1 )
-		{
-			break;
-		}
-	}
-
-	double distance = max_y-min_y;
-
-	/////////////////////////////////////////////////////////
-
-	for(int y=0; y<240;y++)
-	{
-		for(int x=0; x<320; x++)
-		{
-			int a = hsv_img.step*y+(x*3);					//参照番号を設定
-			//閾値によって抽出色以外を黒に
-			if(!((hsv_img.data[a] <= mHMinThreshold || mHMaxThreshold <= hsv_img.data[a]) 
-				&& hsv_img.data[a+1] >= mSMinThreshold
-				&& hsv_img.data[a+2] >= mVMinThreshold))
-			{
-				hsv_color_img.data[a] = 0;		//H値 (0-180)
-				hsv_color_img.data[a+1] = 0;	//S値 (0-255)
-				hsv_color_img.data[a+2] = 0;	//V値 (0-255)
-				count--;
-			}
-		}
-	}
-
-	cvtColor(hsv_color_img, tmp_img, CV_HSV2BGR);					//一時変換
-	cvtColor(tmp_img, gray_img, CV_RGB2GRAY);						//グレースケール化
-	cv::threshold(gray_img, mono_img, 1, 255, CV_THRESH_BINARY);	//二値化
-
-	moments = cv::moments(mono_img);										//重心計算
-	int gX = moments.m10 / moments.m00;										//重心X位置計算
-	// int gY = moments.m01 / moments.m00;									//重心Y位置計算
-	x_gap = -160 + gX;														//中心からのX位置のずれを設定
 
-	if(count > 240*320*mFindAreaThreshold)
+	if(count > area*mFindAreaThreshold)
 	{
-		if(-160 < x_gap && x_gap < 160)
+		if(-mHsvImage.cols/2 < x_gap && x_gap < mHsvImage.cols/2)
 		{
 			Debug::print(LOG_SUMMARY, "Detecting: distance= %f\r\n", distance);
 
-			*counter = (double)count / (240*320);
+			*counter = (double)count / area;
 
-			if (count > 240*320*mGoalAreaThreshold && distance > mDistanceThreshold)
+			if (count > area*mGoalAreaThreshold && distance > mDistanceThreshold)
 			{
 				Debug::print(LOG_SUMMARY, "***Goal is detected!***\r\n");
 				x_gap = INT_MIN;	//ゴール判定
@@ -15,10 +15,25 @@ class ImageProc : public TaskBase
 	double mDistanceThreshold;
 	double mFindAreaThreshold;
 	double mGoalAreaThreshold;
+
+	//howColorGapで使う画像(毎回確保しないように使い回す)
+	cv::Mat mSmoothImage;
+	cv::Mat mHsvImage;
+
+	//抽出色の領域
+	struct ColorRegion
+	{
+		int count;							//画素数
+		int min_x, min_y, max_x, max_y;		//範囲(見つからなければ-1)
+		unsigned long long sum_x, sum_y;	//座標の和(一次モーメント)
+	};
+	//HSV画像を1回走査して、閾値を満たす画素の数、範囲、座標の和を求める
+	void findColor(const cv::Mat& hsv, ColorRegion& region);
 	
 protected:
 	virtual bool onCommand(const std::vector<std::string>& args);
 public:
+	//以下の検出処理はBGR画像を受け取る(いずれも内部でHSVに変換するため、輝度だけの画像では代用できない)
 	// 画像中心から特定の色重心がどれだけずれているか
 	// もし色が見つらなかったらINT_MAX，もしゴール判定したらINT_MINを返す．
 	int howColorGap(IplImage* pImage, double* count);
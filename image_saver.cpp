@@ -0,0 +1,180 @@
+#include "image_saver.h"
+#include "utils.h"
+
+//////////////////////////////////////////////
+// SharedImage
+//////////////////////////////////////////////
+SharedImage* SharedImage::create(CvSize size, int depth, int channels)
+{
+	return new SharedImage(cvCreateImage(size, depth, channels));
+}
+SharedImage* SharedImage::clone(const IplImage* pImage)
+{
+	return new SharedImage(cvCloneImage(pImage));
+}
+IplImage* SharedImage::get() const
+{
+	return mpImage;
+}
+bool SharedImage::isShared() const
+{
+	return mRefCount > 1;
+}
+SharedImage* SharedImage::retain()
+{
+	__sync_add_and_fetch(&mRefCount, 1);
+	return this;
+}
+void SharedImage::release()
+{
+	if(__sync_sub_and_fetch(&mRefCount, 1) == 0)delete this;
+}
+SharedImage::SharedImage(IplImage* pImage) : mpImage(pImage), mRefCount(1)
+{
+}
+SharedImage::~SharedImage()
+{
+	if(mpImage != NULL)cvReleaseImage(&mpImage);
+}
+
+//////////////////////////////////////////////
+// ImageSaver
+//////////////////////////////////////////////
+bool ImageSaver::push(const std::string& filename, SharedImage* pImage, bool nolog)
+{
+	pthread_mutex_lock(&mMutex);
+	if(mCount == IMAGE_SAVER_QUEUE_SIZE)
+	{
+		++mDroppedCount;
+		pthread_mutex_unlock(&mMutex);
+		pImage->release();
+		Debug::print(LOG_SUMMARY, "ImageSaver: queue is full, %s was dropped\r\n", filename.c_str());
+		return false;
+	}
+	Job& job = mJobs[(mHead + mCount++) % IMAGE_SAVER_QUEUE_SIZE];
+	job.pImage = pImage;
+	job.filename = filename;
+	job.nolog = nolog;
+
+	//保存スレッドは最初の保存時に起動する
+	if(!mIsRunning)
+	{
+		mIsRunning = true;
+		if(pthread_create(&mThread, NULL, saverThread, this) != 0)
+		{
+			mIsRunning = false;
+			--mCount;
+			++mFailedCount;
+			pthread_mutex_unlock(&mMutex);
+			pImage->release();
+			Debug::print(LOG_SUMMARY, "ImageSaver: Failed to start thread\r\n");
+			return false;
+		}
+	}
+	pthread_cond_signal(&mCond);
+	pthread_mutex_unlock(&mMutex);
+	return true;
+}
+void ImageSaver::stop()
+{
+	pthread_mutex_lock(&mMutex);
+	bool isRunning = mIsRunning;
+	mIsRunning = false;
+	pthread_cond_signal(&mCond);
+	pthread_mutex_unlock(&mMutex);
+	if(isRunning)pthread_join(mThread, NULL);
+}
+void* ImageSaver::saverThread(void* arg)
+{
+	((ImageSaver*)arg)->run();
+	return NULL;
+}
+void ImageSaver::run()
+{
+	pthread_mutex_lock(&mMutex);
+	while(true)
+	{
+		//stopが呼ばれても残りの画像は保存する
+		while(mIsRunning && mCount == 0)pthread_cond_wait(&mCond, &mMutex);
+		if(mCount == 0)break;
+
+		Job job = mJobs[mHead];
+		mJobs[mHead].pImage = NULL;
+		mHead = (mHead + 1) % IMAGE_SAVER_QUEUE_SIZE;
+		--mCount;
+		int quality = mQuality;
+		unsigned int thumbnailWidth = mThumbnailWidth;
+		pthread_mutex_unlock(&mMutex);
+
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		bool result = write(job, quality, thumbnailWidth);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+		job.pImage->release();
+
+		double elapsed = Time::dt(end, start);
+		if(!result)Debug::print(LOG_SUMMARY, "ImageSaver: Failed to save %s\r\n", job.filename.c_str());
+		else if(!job.nolog)Debug::print(LOG_SUMMARY, "Captured image was saved as %s (%.0f ms)\r\n", job.filename.c_str(), elapsed * 1000);
+
+		pthread_mutex_lock(&mMutex);
+		if(result)
+		{
+			++mSavedCount;
+			mTotalEncodeTime += elapsed;
+			if(elapsed > mMaxEncodeTime)mMaxEncodeTime = elapsed;
+		}else ++mFailedCount;
+	}
+	pthread_mutex_unlock(&mMutex);
+}
+bool ImageSaver::write(const Job& job, int quality, unsigned int thumbnailWidth)
+{
+	IplImage* pImage = job.pImage->get();
+	IplImage* pThumbnail = NULL;
+	if(thumbnailWidth > 0 && thumbnailWidth < (unsigned int)pImage->width)
+	{
+		//縦横比を保って縮小する
+		int height = pImage->height * thumbnailWidth / pImage->width;
+		pThumbnail = cvCreateImage(cvSize(thumbnailWidth, height > 0 ? height : 1), pImage->depth, pImage->nChannels);
+		cvResize(pImage, pThumbnail, CV_INTER_AREA);
+		pImage = pThumbnail;
+	}
+	int params[] = {CV_IMWRITE_JPEG_QUALITY, quality, 0};
+	bool result = cvSaveImage(job.filename.c_str(), pImage, params) != 0;
+	if(pThumbnail != NULL)cvReleaseImage(&pThumbnail);
+	return result;
+}
+void ImageSaver::setQuality(int quality)
+{
+	if(quality < 0)quality = 0;
+	if(quality > 100)quality = 100;
+	pthread_mutex_lock(&mMutex);
+	mQuality = quality;
+	pthread_mutex_unlock(&mMutex);
+}
+void ImageSaver::setThumbnailWidth(unsigned int width)
+{
+	pthread_mutex_lock(&mMutex);
+	mThumbnailWidth = width;
+	pthread_mutex_unlock(&mMutex);
+}
+void ImageSaver::showState()
+{
+	pthread_mutex_lock(&mMutex);
+	Debug::print(LOG_SUMMARY, "ImageSaver: %s, %u queued, quality %d, thumbnail %u\r\n", mIsRunning ? "running" : "stopped", mCount, mQuality, mThumbnailWidth);
+	Debug::print(LOG_SUMMARY, " Saved %u (avg %.0f ms, max %.0f ms), dropped %u, failed %u\r\n", mSavedCount,
+		mSavedCount == 0 ? 0 : mTotalEncodeTime / mSavedCount * 1000, mMaxEncodeTime * 1000, mDroppedCount, mFailedCount);
+	pthread_mutex_unlock(&mMutex);
+}
+ImageSaver::ImageSaver() : mHead(0), mCount(0), mIsRunning(false), mQuality(IMAGE_SAVER_JPEG_QUALITY), mThumbnailWidth(IMAGE_SAVER_THUMBNAIL_WIDTH),
+	mSavedCount(0), mDroppedCount(0), mFailedCount(0), mTotalEncodeTime(0), mMaxEncodeTime(0)
+{
+	for(unsigned int i = 0;i < IMAGE_SAVER_QUEUE_SIZE;++i)mJobs[i].pImage = NULL;
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mCond, NULL);
+}
+ImageSaver::~ImageSaver()
+{
+	stop();
+	pthread_cond_destroy(&mCond);
+	pthread_mutex_destroy(&mMutex);
+}
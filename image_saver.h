@@ -0,0 +1,81 @@
+/*
+	画像保存キュー
+
+	画像のエンコードとSDへの書き込みを専用のスレッドで行います
+	・画像は参照カウント付き(SharedImage)で受け取り、呼び出し元はキューに積むだけで待たされない
+	・キューが一杯の場合は保存せずに捨て、捨てた数を記録する
+	・JPEGの画質と縮小後の幅(サムネイル)を設定できる
+	・stopを呼ぶと残りの画像をすべて保存してからスレッドを終了する
+*/
+#pragma once
+#include <pthread.h>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "constants.h"
+
+//参照カウント付きの画像(最後にreleaseした時点で解放される)
+class SharedImage
+{
+	IplImage* mpImage;
+	volatile int mRefCount;
+
+	SharedImage(IplImage* pImage);
+	~SharedImage();
+public:
+	//参照カウント1の画像を作る
+	static SharedImage* create(CvSize size, int depth, int channels);
+	//pImageをコピーした画像を作る
+	static SharedImage* clone(const IplImage* pImage);
+
+	IplImage* get() const;
+	//他に参照している人がいれば真(書き換えてはいけない)
+	bool isShared() const;
+
+	SharedImage* retain();
+	void release();
+};
+
+class ImageSaver
+{
+	//保存待ちの画像
+	struct Job
+	{
+		SharedImage* pImage;
+		std::string filename;
+		bool nolog;
+	};
+	Job mJobs[IMAGE_SAVER_QUEUE_SIZE];
+	unsigned int mHead, mCount;
+
+	pthread_t mThread;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mCond;
+	bool mIsRunning;
+
+	//設定(mMutexで保護)
+	int mQuality;//JPEGの画質(0〜100)
+	unsigned int mThumbnailWidth;//この幅に縮小して保存する(0なら縮小しない)
+
+	//統計(mMutexで保護)
+	unsigned int mSavedCount, mDroppedCount, mFailedCount;
+	double mTotalEncodeTime, mMaxEncodeTime;//エンコードと書き込みにかかった時間(秒)
+
+	static void* saverThread(void* arg);
+	void run();
+	//1枚保存する(保存スレッドから呼ぶ)
+	bool write(const Job& job, int quality, unsigned int thumbnailWidth);
+public:
+	//画像を保存待ちにする(pImageの参照は保存が終わるか捨てられたときに解放される)
+	//キューが一杯ならfalseを返す
+	bool push(const std::string& filename, SharedImage* pImage, bool nolog = false);
+	//残りの画像をすべて保存してスレッドを終了する
+	void stop();
+
+	void setQuality(int quality);
+	void setThumbnailWidth(unsigned int width);
+	//保存待ちの数と統計を表示する
+	void showState();
+
+	ImageSaver();
+	~ImageSaver();
+};
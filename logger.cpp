@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include "logger.h"
+
+Logger::Slot Logger::mSlots[LOGGER_RING_SIZE];
+volatile unsigned int Logger::mEnqueuePos = 0;
+unsigned int Logger::mDequeuePos = 0;
+volatile int Logger::mConsumerLock = 0;
+volatile unsigned int Logger::mDropCount = 0;
+unsigned int Logger::mReportedDropCount = 0;
+pthread_once_t Logger::mOnce = PTHREAD_ONCE_INIT;
+pthread_t Logger::mThread;
+sem_t Logger::mSemaphore;
+volatile bool Logger::mIsRunning = false;
+int Logger::mFd = -1;
+
+//異常終了時にログを書き込むシグナル
+const static int LOGGER_FATAL_SIGNALS[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTERM};
+
+void Logger::start()
+{
+	for(unsigned int i = 0;i < LOGGER_RING_SIZE;++i)mSlots[i].sequence = i;
+
+	std::string name;
+	Filename filename("log",".txt");
+	filename.get(name);
+	mFd = open(name.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if(mFd < 0)
+	{
+		fprintf(stderr, "Logger: Unable to open %s\r\n", name.c_str());
+		return;
+	}
+
+	sem_init(&mSemaphore, 0, 0);
+	mIsRunning = true;
+	if(pthread_create(&mThread, NULL, writerThread, NULL) != 0)
+	{
+		//スレッドが作れない場合は呼び出し元で直接書き込む
+		mIsRunning = false;
+		return;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = signalHandler;
+	action.sa_flags = SA_SIGINFO | SA_RESETHAND;
+	sigemptyset(&action.sa_mask);
+	for(unsigned int i = 0;i < sizeof(LOGGER_FATAL_SIGNALS) / sizeof(LOGGER_FATAL_SIGNALS[0]);++i)sigaction(LOGGER_FATAL_SIGNALS[i], &action, NULL);
+	atexit(stop);
+}
+void* Logger::writerThread(void* arg)
+{
+	struct timespec lastSyncTime;
+	clock_gettime(CLOCK_MONOTONIC, &lastSyncTime);
+	bool isDirty = false;
+
+	while(mIsRunning)
+	{
+		//ログが積まれるか一定時間が経つまで待つ
+		struct timespec timeout;
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		unsigned long long nsec = timeout.tv_nsec + LOGGER_WAKE_PERIOD * 1000;
+		timeout.tv_sec += nsec / 1000000000;
+		timeout.tv_nsec = nsec % 1000000000;
+		sem_timedwait(&mSemaphore, &timeout);
+		while(sem_trywait(&mSemaphore) == 0);
+
+		while(__sync_lock_test_and_set(&mConsumerLock, 1))sched_yield();
+		if(drain())isDirty = true;
+		__sync_lock_release(&mConsumerLock);
+
+		//SDへの書き込みは一定間隔でまとめて行う
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(isDirty && Time::dt(now, lastSyncTime) * 1000000 >= LOGGER_SYNC_PERIOD)
+		{
+			fdatasync(mFd);
+			isDirty = false;
+			lastSyncTime = now;
+		}
+	}
+	return NULL;
+}
+bool Logger::drain()
+{
+	static char batch[LOGGER_BATCH_SIZE];
+	unsigned int size = 0;
+	bool isWritten = false;
+	while(true)
+	{
+		Slot& slot = mSlots[mDequeuePos & (LOGGER_RING_SIZE - 1)];
+		if(slot.sequence != mDequeuePos + 1)break;//まだ書き込まれていない
+		__sync_synchronize();
+
+		if(size + slot.length > sizeof(batch))
+		{
+			writeAll(batch, size);
+			size = 0;
+		}
+		memcpy(batch + size, slot.data, slot.length);
+		size += slot.length;
+
+		//読み終わった要素を書き込み側に返す
+		__sync_synchronize();
+		slot.sequence = mDequeuePos + LOGGER_RING_SIZE;
+		++mDequeuePos;
+		isWritten = true;
+	}
+	if(size > 0)writeAll(batch, size);
+	if(mDropCount != mReportedDropCount)
+	{
+		reportDrops();
+		isWritten = true;
+	}
+	return isWritten;
+}
+void Logger::writeAll(const char* buf, unsigned int length)
+{
+	while(length > 0)
+	{
+		ssize_t written = write(mFd, buf, length);
+		if(written < 0)
+		{
+			if(errno == EINTR)continue;
+			return;//SDが抜けた場合などは諦める
+		}
+		buf += written;
+		length -= written;
+	}
+}
+void Logger::reportDrops()
+{
+	unsigned int dropCount = mDropCount;
+	char buf[128];
+	int length = snprintf(buf, sizeof(buf), "Logger: %u messages dropped (total %u)\r\n", dropCount - mReportedDropCount, dropCount);
+	if(length > 0)writeAll(buf, length);
+	mReportedDropCount = dropCount;
+}
+void Logger::signalHandler(int signo, siginfo_t* info, void* context)
+{
+	//書き込みスレッド自身が受信した場合などはロックが取れないため、少しだけ待って諦める
+	bool isLocked = false;
+	for(int i = 0;i < 100 && !(isLocked = !__sync_lock_test_and_set(&mConsumerLock, 1));++i)sched_yield();
+	if(isLocked)
+	{
+		drain();
+		__sync_lock_release(&mConsumerLock);
+	}
+	if(mFd >= 0)fdatasync(mFd);
+
+	//SA_RESETHANDで元の処理に戻っているため、同じシグナルで終了する
+	raise(signo);
+}
+bool Logger::push(const char* buf, unsigned int length)
+{
+	if(length == 0)return true;
+	pthread_once(&mOnce, start);
+	if(mFd < 0)return false;
+	if(length > MAX_STRING_LENGTH)length = MAX_STRING_LENGTH;
+
+	if(!mIsRunning)
+	{
+		//書き込みスレッドが止まった後は直接書き込む
+		writeAll(buf, length);
+		return true;
+	}
+
+	//空いている要素を確保する(他のスレッドと競合した場合はやり直す)
+	unsigned int pos = mEnqueuePos;
+	Slot* pSlot;
+	while(true)
+	{
+		pSlot = &mSlots[pos & (LOGGER_RING_SIZE - 1)];
+		int diff = (int)(pSlot->sequence - pos);
+		if(diff == 0)
+		{
+			if(__sync_bool_compare_and_swap(&mEnqueuePos, pos, pos + 1))break;
+		}else if(diff < 0)
+		{
+			//一杯なので捨てる
+			__sync_fetch_and_add(&mDropCount, 1);
+			return false;
+		}
+		pos = mEnqueuePos;
+	}
+
+	memcpy(pSlot->data, buf, length);
+	pSlot->length = length;
+	__sync_synchronize();
+	pSlot->sequence = pos + 1;
+	sem_post(&mSemaphore);
+	return true;
+}
+void Logger::stop()
+{
+	if(!mIsRunning)return;
+	mIsRunning = false;
+	sem_post(&mSemaphore);
+	pthread_join(mThread, NULL);
+
+	while(__sync_lock_test_and_set(&mConsumerLock, 1))sched_yield();
+	drain();
+	__sync_lock_release(&mConsumerLock);
+	fdatasync(mFd);
+}
+unsigned int Logger::getDropCount()
+{
+	return mDropCount;
+}
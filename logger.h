@@ -0,0 +1,53 @@
+/*
+	ログ書き込みクラス
+
+	Debug::printから渡された文字列をリングバッファに積み、専用のスレッドでまとめてログファイルに書き込みます
+	・書き込み側はロックを取らない(複数スレッドやシグナルハンドラから呼び出しても待たされない)
+	・リングバッファが一杯の場合は書き込まずに捨て、捨てた数をログファイルに記録する
+	・ファイルは開いたままにし、LOGGER_SYNC_PERIODごとにfdatasyncでSDに書き込む
+	・終了時(stopまたはexit)と異常終了のシグナル受信時には残りのログを書き込む
+*/
+#pragma once
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include "utils.h"
+
+class Logger
+{
+	//リングバッファの要素(sequenceが書き込み/読み込みの順番を管理する)
+	struct Slot
+	{
+		volatile unsigned int sequence;
+		unsigned int length;
+		char data[MAX_STRING_LENGTH];
+	};
+	static Slot mSlots[LOGGER_RING_SIZE];
+	static volatile unsigned int mEnqueuePos;
+	static unsigned int mDequeuePos;
+	static volatile int mConsumerLock;//読み出し側は1つのみ(書き込みスレッドかシグナルハンドラ)
+
+	static volatile unsigned int mDropCount;//リングバッファが一杯で捨てたログの数
+	static unsigned int mReportedDropCount;//ログファイルに記録済みのmDropCount
+
+	static pthread_once_t mOnce;
+	static pthread_t mThread;
+	static sem_t mSemaphore;
+	static volatile bool mIsRunning;
+	static int mFd;
+
+	static void start();
+	static void* writerThread(void* arg);
+	//リングバッファの内容をすべてファイルに書き込む(読み出し側のロックを取ってから呼ぶこと)
+	static bool drain();
+	static void writeAll(const char* buf, unsigned int length);
+	static void reportDrops();
+	static void signalHandler(int signo, siginfo_t* info, void* context);
+public:
+	//ログをリングバッファに積む(ファイルへの書き込みは待たない)
+	static bool push(const char* buf, unsigned int length);
+	//書き込みスレッドを止めて残りのログをすべて書き込む(以降のログは呼び出し元で直接書き込む)
+	static void stop();
+
+	static unsigned int getDropCount();
+};
@@ -1,6 +1,5 @@
 #include <stdlib.h>
 #include <unistd.h>
-#include <wiringPi.h>
 #include <signal.h>
 #include <time.h>
 #include <stdio.h>
@@ -9,6 +8,10 @@
 #include <iostream>
 #include "sequence.h"
 #include "utils.h"
+#include "hal.h"
+#include "recorder.h"
+#include "logger.h"
+#include "blackbox.h"
 
 void sigHandler(int p_signame);
 bool setSighandle(int p_signame);
@@ -86,10 +89,20 @@ int main(int argc, char** argv)
 		Debug::print(LOG_SUMMARY,"Failed to set signal!\r\n");
 	}
 
-	//wiring pi初期化
-    if(wiringPiSetup() != 0)
+	//センサ入力の記録/再生(--record [ファイル名] / --replay [ファイル名])
+	for(int i = 1;i + 1 < argc;++i)
 	{
-		Debug::print(LOG_SUMMARY,"Failed to setup wiringPi!\r\n");
+		std::string arg(argv[i]);
+		bool result = true;
+		if(arg.compare("--record") == 0)result = Recorder::startRecording(argv[++i]);
+		else if(arg.compare("--replay") == 0)result = Recorder::startReplay(argv[++i]);
+		if(!result)return -1;
+	}
+
+	//ハードウェア初期化(wiringPiまたはシミュレータ)
+    if(!Hal::setup())
+	{
+		Debug::print(LOG_SUMMARY,"Failed to setup hardware!\r\n");
 		return -1;
 	}
 
@@ -106,19 +119,28 @@ int main(int argc, char** argv)
 	}
 	Debug::print(LOG_SUMMARY, "Ready.\r\n");
 
+	//異常終了時の解析用に直近の状態を記録する(再生中は記録しない)
+	if(!Recorder::isReplaying())BlackBox::start();
+
 	
 	////////////////////////////////////////////
 	//メインループ(ブロックなどせずに短時間で処理を返すこと)
-	while(gIsRunning)
+	while(gIsRunning && !Recorder::isFinished())
 	{
 		//タスク処理(この関数ひとつでタスクが実行される)
 		pTaskMan->update();
+
+		//ブラックボックスに状態を記録(メモリに書き込むだけなので待たされない)
+		BlackBox::update();
 		
-		//CPU処理を占有しないようにWaitをはさむ
-		delay(1);
+		//次のタスクの実行時刻までスリープ(CPU処理を占有しないように)
+		pTaskMan->wait();
 	}
 
 	pTaskMan->clean();
+	BlackBox::stop();
+	Recorder::stop();
+	Logger::stop();
 
 	//書き込まれていないファイルを強制的にSDに書き込み
 	system("sync");
@@ -1,14 +1,15 @@
-#include <wiringPi.h>
-#include <softPwm.h>
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <math.h>
 #include "utils.h"
+#include "hal.h"
 #include "motor.h"
 #include "sensor.h"
 #include "actuator.h"
+#include "telemetry.h"
+#include "sample_bus.h"
 
 MotorDrive gMotorDrive;
 
@@ -20,14 +21,14 @@ bool Motor::init(int powPin, int revPin)
 	//ピンを初期化
     mPowerPin = powPin;
     mReversePin = revPin;
-    pinMode(mPowerPin, OUTPUT);
-    if(softPwmCreate(mPowerPin ,0,100) != 0)
+    Hal::pinMode(mPowerPin, OUTPUT);
+    if(Hal::softPwmCreate(mPowerPin ,0,100) != 0)
 	{
 		Debug::print(LOG_SUMMARY,"Failed to initialize soft-PWM\r\n");
 		return false;
 	}
-    pinMode(mReversePin, OUTPUT);
-    digitalWrite(mReversePin, LOW);
+    Hal::pinMode(mReversePin, OUTPUT);
+    Hal::digitalWrite(mReversePin, LOW);
 
 	//現在の出力を保持
     mCurPower = 0;
@@ -51,16 +52,16 @@ void Motor::update(double elapsedSeconds)
 		}
 
 		//新しいpowerをもとにpinの状態を設定する
-		if(curFrameTarget > 0 && mCurPower <= 0)digitalWrite(mReversePin, HIGH);
-		else if(curFrameTarget < 0 && mCurPower >= 0)digitalWrite(mReversePin, LOW);
+		if(curFrameTarget > 0 && mCurPower <= 0)Hal::digitalWrite(mReversePin, HIGH);
+		else if(curFrameTarget < 0 && mCurPower >= 0)Hal::digitalWrite(mReversePin, LOW);
 		mCurPower = curFrameTarget;
-		softPwmWrite(mPowerPin, fabs(mCurPower));
+		Hal::softPwmWrite(mPowerPin, fabs(mCurPower));
 	}
 }
 void Motor::clean()
 {
-	if(mPowerPin >= 0)softPwmWrite(mPowerPin, 0);
-	if(mReversePin >= 0)digitalWrite(mReversePin, LOW);
+	if(mPowerPin >= 0)Hal::softPwmWrite(mPowerPin, 0);
+	if(mReversePin >= 0)Hal::digitalWrite(mReversePin, LOW);
 	mCurPower = 0;
 }
 void Motor::set(int power)
@@ -104,7 +105,7 @@ bool MotorEncoder::init()
 	mPulseCountL = mPulseCountR = 0;
 
 	//ピンのパルスを監視する
-	if(wiringPiISR(mEncoderPinL, INT_EDGE_RISING, pulseLCallback) == -1 || wiringPiISR(mEncoderPinR, INT_EDGE_RISING, pulseRCallback) == -1)
+	if(Hal::setISR(mEncoderPinL, INT_EDGE_RISING, pulseLCallback) == -1 || Hal::setISR(mEncoderPinR, INT_EDGE_RISING, pulseRCallback) == -1)
 	{
 		Debug::print(LOG_SUMMARY,"Failed to onInitialize Motor encoder\r\n");
 		return false;
@@ -114,14 +115,11 @@ bool MotorEncoder::init()
 void MotorEncoder::clean()
 {
 	//両方のピンの割り込みを無効にする
-	char command [64];
-	sprintf (command, "/usr/local/bin/gpio edge %d none", mEncoderPinL) ;
-    system (command) ;
-	sprintf (command, "/usr/local/bin/gpio edge %d none", mEncoderPinR) ;
-    system (command) ;
+	Hal::clearISR(mEncoderPinL);
+	Hal::clearISR(mEncoderPinR);
 
 	//スレッドが複数残ることを防止するためsleep
-	delay(100);
+	Hal::delay(100);
 }
 unsigned long long MotorEncoder::getL()
 {
@@ -246,6 +244,9 @@ void MotorDrive::onUpdate(const struct timespec& time)
 	//最後の出力更新からの経過時間を取得
 	double dt = Time::dt(time,mLastUpdateTime);
 	mLastUpdateTime = time;
+	unsigned long long encL = mpMotorEncoder->getL(), encR = mpMotorEncoder->getR();
+	Telemetry::writeEncoder(time, encL, encR);
+	gSampleBus.encoder.push(time, VECTOR3(encL, encR, 0));
 	switch(mStabiScheduledMode)
 	{
 	case MOTOR_GO:
@@ -498,6 +499,7 @@ MotorDrive::MotorDrive() : mMotorL(),mMotorR(),mDriveMode(DRIVE_RATIO),mRatioL(1
 {
 	setName("motor");
 	setPriority(TASK_PRIORITY_MOTOR,TASK_INTERVAL_MOTOR);
+	setPeriod(TASK_PERIOD_MOTOR,TASK_DEADLINE_MOTOR);
 
 	mpMotorEncoder = MotorEncoder::getInstance();
 }
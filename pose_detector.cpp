@@ -1,6 +1,7 @@
 #include "pose_detector.h"
 #include "sensor.h"
 #include "motor.h"
+#include "sample_bus.h"
 
 
 PoseDetecting gPoseDetecting;
@@ -22,24 +23,37 @@ bool PoseDetecting::onInit(const struct timespec& time)
 }
 void PoseDetecting::onUpdate(const struct timespec& time)
 {
+	//ジャイロと加速度のサンプルが両方揃っている最新の時刻まで推定を進める(遅れているセンサはSAMPLE_BUS_MAX_SKEWまでしか待たない)
+	TimedSample latestGyro, latestAccel;
+	if(!gSampleBus.gyro.getLatest(latestGyro))return;
+	struct timespec newTime = latestGyro.time;
+	if(gAccelerationSensor.isActive() && gSampleBus.accel.getLatest(latestAccel))
+	{
+		double skew = Time::dt(newTime, latestAccel.time);
+		if(skew > 0 && skew < SAMPLE_BUS_MAX_SKEW)newTime = latestAccel.time;
+	}
+
 	//calc dt
-	struct timespec newTime;
-	Time::get(newTime);
 	double dt = Time::dt(newTime, mLastUpdatedTime);
+	if(dt <= 0)return;
+	struct timespec lastTime = mLastUpdatedTime;
 	mLastUpdatedTime = newTime;
 
 	//get gyro and accel using kalman-filter
 	// VECTOR3 gyro(-gGyroSensor.getRvy() / 180 * M_PI, gGyroSensor.getRvx() / 180 * M_PI, gGyroSensor.getRvz() / 180 * M_PI); //for Gaia Team rover
+	//前回からの区間のサンプルの平均を観測値とする(区間にサンプルが無ければ区間の終わりの値を補間する)
+	VECTOR3 rvel;
+	if(!gSampleBus.gyro.getMean(lastTime, newTime, rvel) && !gSampleBus.gyro.interpolate(newTime, rvel))rvel = latestGyro.value;
 	VECTOR3 accelRaw;
-	bool useAccel = gAccelerationSensor.getAccel(accelRaw);
+	bool useAccel = gAccelerationSensor.isActive() && (gSampleBus.accel.getMean(lastTime, newTime, accelRaw) || gSampleBus.accel.interpolate(newTime, accelRaw));
 	// VECTOR3 accel(accelRaw.y, -accelRaw.x, accelRaw.z); // for Gaia Team rover
 	VECTOR3 gyro;
 	VECTOR3 accel;
 	if (mRoverid == 1)
 	{
-		gyro.x = gGyroSensor.getRvx() / 180 * M_PI;
-		gyro.y = gGyroSensor.getRvy() / 180 * M_PI;
-		gyro.z = gGyroSensor.getRvz() / 180 * M_PI; //for high-ball Team rover 1
+		gyro.x = rvel.x / 180 * M_PI;
+		gyro.y = rvel.y / 180 * M_PI;
+		gyro.z = rvel.z / 180 * M_PI; //for high-ball Team rover 1
 
 		accel.x = -accelRaw.x;
 		accel.y = -accelRaw.y;
@@ -48,9 +62,9 @@ void PoseDetecting::onUpdate(const struct timespec& time)
 	}
 	else if(mRoverid == 2)
 	{
-		gyro.x = -gGyroSensor.getRvy() / 180 * M_PI;
-		gyro.y = gGyroSensor.getRvx() / 180 * M_PI;
-		gyro.z = gGyroSensor.getRvz() / 180 * M_PI; //for high-ball Team rover 1
+		gyro.x = -rvel.y / 180 * M_PI;
+		gyro.y = rvel.x / 180 * M_PI;
+		gyro.z = rvel.z / 180 * M_PI; //for high-ball Team rover 1
 
 		accel.x = accelRaw.y;
 		accel.y = -accelRaw.x;
@@ -59,9 +73,9 @@ void PoseDetecting::onUpdate(const struct timespec& time)
 	}
 	else if(mRoverid == 3)
 	{
-		gyro.x = -gGyroSensor.getRvx() / 180 * M_PI;
-		gyro.y = -gGyroSensor.getRvy() / 180 * M_PI;
-		gyro.z = gGyroSensor.getRvz() / 180 * M_PI; //for high-ball Team rover 1
+		gyro.x = -rvel.x / 180 * M_PI;
+		gyro.y = -rvel.y / 180 * M_PI;
+		gyro.z = rvel.z / 180 * M_PI; //for high-ball Team rover 1
 
 		accel.x = accelRaw.y;
 		accel.y = -accelRaw.x;
@@ -108,8 +122,11 @@ void PoseDetecting::onUpdate(const struct timespec& time)
 		if(dt > 0)
 		{
 			//update course by encoder
-			long long newEncL = gMotorDrive.getL(), newEncR = gMotorDrive.getR();
-			long long deltaEncL = newEncL - mLastEncL, deltaEncR = newEncR - mLastEncR;
+			//ジャイロと同じ時刻のパルス数を補間して使う
+			VECTOR3 enc;
+			if(!gSampleBus.encoder.interpolate(newTime, enc))enc = VECTOR3(gMotorDrive.getL(), gMotorDrive.getR(), 0);
+			double newEncL = enc.x, newEncR = enc.y;
+			double deltaEncL = newEncL - mLastEncL, deltaEncR = newEncR - mLastEncR;
 			mLastEncL = newEncL;
 			mLastEncR = newEncR;
 
@@ -124,8 +141,11 @@ void PoseDetecting::onUpdate(const struct timespec& time)
 	}
 
 	//GPS方角と内部方角の差分を更新
-	VECTOR3 gpsPos;
-	if(gGPSSensor.isActive() && gGPSSensor.get(gpsPos, true) && gGPSSensor.getSpeed() > 0.1 && gGPSSensor.getTime() != mLastGpsSampleTime && !isFlip())
+	//座標、速度、時刻は同じ更新時点の値を使う
+	GPSSensor::Snapshot gps;
+	gGPSSensor.getSnapshot(gps);
+	const VECTOR3& gpsPos = gps.pos;
+	if(gGPSSensor.isActive() && gps.hasPosition() && gps.speed > 0.1 && gps.gpsTime != mLastGpsSampleTime && !isFlip())
 	{
 		if(mLastGpsSampleTime != 0)
 		{
@@ -136,9 +156,9 @@ void PoseDetecting::onUpdate(const struct timespec& time)
 			mEstimatedRelativeGpsCourse += relativeCourse * mGpsCoeff;
 			mEstimatedRelativeGpsCourse = GyroSensor::normalize(mEstimatedRelativeGpsCourse);
 
-			mEstimatedVelocity = mEstimatedVelocity * (1 - mGpsCoeff) + gGPSSensor.getSpeed() * mGpsCoeff;
+			mEstimatedVelocity = mEstimatedVelocity * (1 - mGpsCoeff) + gps.speed * mGpsCoeff;
 		}
-		mLastGpsSampleTime = gGPSSensor.getTime();
+		mLastGpsSampleTime = gps.gpsTime;
 		mLastGpsPos = gpsPos;
 	}
 }
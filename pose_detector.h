@@ -14,7 +14,7 @@ private:
 	QUATERNION mEstimatedAngle, mEstimatedAngleWithLPF;
 	std::tuple<KalmanFilter, KalmanFilter, KalmanFilter> mKalmanGyro;
 	double mEstimatedRelativeGpsCourse, mEstimatedVelocity;
-	long long mLastEncL, mLastEncR;
+	double mLastEncL, mLastEncR;//最後に推定した時刻のエンコーダのパルス数(補間値)
 	bool mIsInitializedAngle;
 	double mAccelCoeff, mEncCoeff, mGpsCoeff;
 	double mAngleLPFCoeff;
@@ -24,7 +24,7 @@ private:
 	VECTOR3 mLastGpsPos;
 	int mLastGpsSampleTime;
 
-	struct timespec mLastUpdatedTime;
+	struct timespec mLastUpdatedTime;//最後に推定した時刻(サンプルの時刻)
 	int mRoverid;
 
 protected:
@@ -0,0 +1,59 @@
+#include "pressure_filter.h"
+#include "constants.h"
+
+void AltitudeFilter::reset(double measurementVariance)
+{
+	mMeasurementVariance = measurementVariance;
+	mAltitude = mSpeed = 0;
+	mCovariance[0][0] = measurementVariance;
+	mCovariance[0][1] = mCovariance[1][0] = 0;
+	mCovariance[1][1] = 1;
+	mInnovationRatio = 1;
+}
+void AltitudeFilter::update(double altitude, double dt)
+{
+	if(dt <= 0)return;
+
+	//予測(速度一定で進み、加速度の分だけ誤差が広がる)
+	double q = PRESSURE_ACCEL_NOISE * PRESSURE_ACCEL_NOISE;
+	double dt2 = dt * dt;
+	mAltitude += mSpeed * dt;
+	double p00 = mCovariance[0][0] + dt * (mCovariance[0][1] + mCovariance[1][0]) + dt2 * mCovariance[1][1] + q * dt2 * dt2 / 4;
+	double p01 = mCovariance[0][1] + dt * mCovariance[1][1] + q * dt2 * dt / 2;
+	double p11 = mCovariance[1][1] + q * dt2;
+
+	//観測(気圧から求めた高度)で補正
+	double s = p00 + mMeasurementVariance;
+	double k0 = p00 / s, k1 = p01 / s;
+	double residual = altitude - mAltitude;
+	mAltitude += k0 * residual;
+	mSpeed += k1 * residual;
+	mCovariance[0][0] = (1 - k0) * p00;
+	mCovariance[0][1] = mCovariance[1][0] = (1 - k0) * p01;
+	mCovariance[1][1] = p11 - k1 * p01;
+
+	//残差が想定した分散より大きければ、その分だけ推定誤差も大きいとみなす
+	double rate = dt / PRESSURE_INNOVATION_TIME;
+	if(rate > 1)rate = 1;
+	mInnovationRatio += (residual * residual / s - mInnovationRatio) * rate;
+}
+double AltitudeFilter::getAltitude() const
+{
+	return mAltitude;
+}
+double AltitudeFilter::getSpeed() const
+{
+	return mSpeed;
+}
+double AltitudeFilter::getSpeedVariance() const
+{
+	return mCovariance[1][1] * (mInnovationRatio > 1 ? mInnovationRatio : 1);
+}
+double AltitudeFilter::getMeasurementVariance() const
+{
+	return mMeasurementVariance;
+}
+AltitudeFilter::AltitudeFilter()
+{
+	reset(0);//観測ノイズが決まるまでは使わない
+}
@@ -0,0 +1,30 @@
+/*
+	気圧高度フィルタ
+
+	気圧から求めた高度を等速度モデルのカルマンフィルタにかけ、高度と鉛直速度を推定します
+	・観測ノイズは基準気圧を求めたサンプルのばらつきから決める(センサの分解能より小さくはしない)
+	・推定誤差の分散は、フィルタの共分散を実際の残差の大きさで補正して返す
+	  (想定よりノイズが大きい、または想定外の加速をしている間は分散が大きくなる)
+*/
+#pragma once
+
+class AltitudeFilter
+{
+	double mAltitude, mSpeed;//推定値(m、m/s 上向きが正)
+	double mCovariance[2][2];//推定値の誤差の共分散
+	double mMeasurementVariance;//観測した高度の分散(m^2)
+	double mInnovationRatio;//残差の2乗と想定した分散の比の移動平均(想定どおりなら1)
+public:
+	//観測した高度の分散を指定して推定をやり直す
+	void reset(double measurementVariance);
+	//dt[s]後に観測した高度で推定値を更新する
+	void update(double altitude, double dt);
+
+	double getAltitude() const;
+	double getSpeed() const;
+	//鉛直速度の推定誤差の分散((m/s)^2)
+	double getSpeedVariance() const;
+	double getMeasurementVariance() const;
+
+	AltitudeFilter();
+};
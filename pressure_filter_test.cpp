@@ -0,0 +1,123 @@
+/*
+	気圧高度フィルタの確認用プログラム(PC上で実行する)
+
+	MPL115A2と同じ分解能で量子化したノイズ入りの気圧をAltitudeFilterにかけ、
+	Fallingと同じ条件(鉛直速度とその標準偏差がFALLING_LANDING_SPEED以下の状態がFALLING_LANDING_TIME続く)で
+	・静止中は着地と判定されること
+	・降下中は着地と判定されず、接地後は判定されること
+	を確かめます。すべて満たせば0を返します
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "pressure_filter.h"
+#include "constants.h"
+
+const static double DT = I2C_PERIOD_PRESSURE / 1000000.0;//サンプリング周期(s)
+const static double GROUND_PRESSURE = 1013.25;//地上の気圧(hPa)
+const static double TEMPERATURE = 25;//気温(℃)
+const static double METER_PER_HPA = 29.27 * (TEMPERATURE + 273.15) / GROUND_PRESSURE;
+
+//平均0、標準偏差1の正規乱数
+static double gaussian()
+{
+	double u1 = (rand() + 1.0) / (RAND_MAX + 2.0), u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+//高度altitude[m]でセンサが返す気圧(ノイズを加えて1カウント単位に量子化する)
+static double measure(double altitude, double noise)
+{
+	double pressure = GROUND_PRESSURE - altitude / METER_PER_HPA + gaussian() * noise * PRESSURE_RESOLUTION;
+	return floor(pressure / PRESSURE_RESOLUTION + 0.5) * PRESSURE_RESOLUTION;
+}
+
+class Landing
+{
+	double mMovingTime;
+public:
+	bool isLanded;
+	void update(const AltitudeFilter& filter, double time)
+	{
+		if(fabs(filter.getSpeed()) > FALLING_LANDING_SPEED || filter.getSpeedVariance() > FALLING_LANDING_SPEED * FALLING_LANDING_SPEED)mMovingTime = time;
+		isLanded = (time - mMovingTime) * 1000 >= FALLING_LANDING_TIME;
+	}
+	Landing(double time) : mMovingTime(time), isLanded(false)
+	{
+	}
+};
+
+//基準気圧のサンプルから観測ノイズを決める(PressureSensorと同じ手順)
+static void calibrate(AltitudeFilter& filter, double noise, double& baseline)
+{
+	double sum = 0, squareSum = 0;
+	for(unsigned int i = 0;i < PRESSURE_BASELINE_COUNT;++i)
+	{
+		double pressure = measure(0, noise);
+		sum += pressure;
+		squareSum += pressure * pressure;
+	}
+	baseline = sum / PRESSURE_BASELINE_COUNT;
+	double variance = squareSum / PRESSURE_BASELINE_COUNT - baseline * baseline;
+	double minimum = PRESSURE_RESOLUTION / 2;
+	if(variance < minimum * minimum)variance = minimum * minimum;
+	filter.reset(variance * METER_PER_HPA * METER_PER_HPA);
+}
+static double toAltitude(double pressure, double baseline)
+{
+	return 29.27 * (TEMPERATURE + 273.15) * log(baseline / pressure);
+}
+
+//静止したまま10秒間、着地と判定されるか
+static bool testStill(double noise)
+{
+	AltitudeFilter filter;
+	double baseline;
+	calibrate(filter, noise, baseline);
+	Landing landing(0);
+	double landedTime = -1;
+	for(double time = 0;time < 10;time += DT)
+	{
+		filter.update(toAltitude(measure(0, noise), baseline), DT);
+		landing.update(filter, time);
+		if(landing.isLanded && landedTime < 0)landedTime = time;
+	}
+	printf("still   noise %.2f count: landed at %.2f s (speed %.2f +- %.2f m/s)\n", noise, landedTime, filter.getSpeed(), sqrt(filter.getSpeedVariance()));
+	return landedTime >= 0 && landedTime < 5;
+}
+
+//100mから5m/sで降下し、接地後5秒以内に着地と判定され、降下中は判定されないか
+static bool testDescent(double noise)
+{
+	AltitudeFilter filter;
+	double baseline;
+	calibrate(filter, noise, baseline);
+	const double height = 100, speed = 5, touchdown = height / speed;
+	Landing landing(0);
+	double landedTime = -1;
+	bool isFalseLanding = false;
+	for(double time = 0;time < touchdown + 10;time += DT)
+	{
+		double altitude = time < touchdown ? height - speed * time : 0;
+		filter.update(toAltitude(measure(altitude, noise), baseline), DT);
+		landing.update(filter, time);
+		if(!landing.isLanded)continue;
+		if(time < touchdown)isFalseLanding = true;
+		else if(landedTime < 0)landedTime = time - touchdown;
+	}
+	printf("descent noise %.2f count: %s, landed %.2f s after touchdown\n", noise, isFalseLanding ? "FALSE LANDING" : "no false landing", landedTime);
+	return !isFalseLanding && landedTime >= 0 && landedTime < 5;
+}
+
+int main()
+{
+	srand(1);
+	bool result = true;
+	const double noises[] = {0, 0.3, 0.5, 1.0};//量子化前のノイズ(カウント)
+	for(unsigned int i = 0;i < sizeof(noises) / sizeof(noises[0]);++i)
+	{
+		result = testStill(noises[i]) && result;
+		result = testDescent(noises[i]) && result;
+	}
+	printf("%s\n", result ? "OK" : "FAILED");
+	return result ? 0 : 1;
+}
@@ -0,0 +1,616 @@
+#include <string.h>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+#include "recorder.h"
+#include "hal.h"
+#include "utils.h"
+
+const static char RECORDER_MAGIC[8] = {'R','O','V','E','R','E','C','1'};
+const static size_t RECORDER_FLUSH_SIZE = 65536;//この大きさを超えたらファイルに書き込む
+
+Recorder::MODE Recorder::mMode = Recorder::MODE_NONE;
+FILE* Recorder::mpFile = NULL;
+std::vector<unsigned char> Recorder::mBuffer;
+size_t Recorder::mReadPos = 0;
+pthread_mutex_t Recorder::mMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_t Recorder::mMainThread;
+struct timespec Recorder::mLastTime;
+int Recorder::mPendingISRPin = -1;
+unsigned int Recorder::mPendingISRCount = 0;
+void (*Recorder::mpReplayISR[Recorder::ISR_PIN_COUNT])(void);
+IplImage* Recorder::mpReplayFrame = NULL;
+bool Recorder::mIsFinished = false;
+unsigned long long Recorder::mEventCount = 0;
+struct timespec Recorder::mStartTime;
+
+//////////////////////////////////////////////
+// Recording Backend
+//////////////////////////////////////////////
+//記録時に登録された割り込み処理
+static void (*gRecordingISR[Recorder::ISR_PIN_COUNT])(void);
+
+//ピンごとに割り込みを記録してから本来の処理を呼び出す関数
+template<int PIN> void recordingISR()
+{
+	Recorder::recordISR(PIN);
+	if(gRecordingISR[PIN] != NULL)gRecordingISR[PIN]();
+}
+template<int N> struct RecordingISRTable
+{
+	static void fill(void (**pTable)(void))
+	{
+		pTable[N - 1] = &recordingISR<N - 1>;
+		RecordingISRTable<N - 1>::fill(pTable);
+	}
+};
+template<> struct RecordingISRTable<0>
+{
+	static void fill(void (**pTable)(void))
+	{
+	}
+};
+
+//実際のバックエンドを呼び出し、読み込んだ値を記録する
+class RecordingBackend : public HalBackend
+{
+	HalBackend* mpBackend;
+	void (*mpISRTable[Recorder::ISR_PIN_COUNT])(void);
+public:
+	virtual bool setup()
+	{
+		return Recorder::value(Recorder::EVENT_HAL_SETUP, 0, mpBackend->setup()) != 0;
+	}
+
+	virtual int i2cSetup(int address)
+	{
+		return Recorder::value(Recorder::EVENT_I2C_SETUP, address, mpBackend->i2cSetup(address));
+	}
+	virtual int i2cReadReg8(int fd, int reg)
+	{
+		return Recorder::value(Recorder::EVENT_I2C_READ, reg, mpBackend->i2cReadReg8(fd, reg));
+	}
+	virtual int i2cWriteReg8(int fd, int reg, int data)
+	{
+		return mpBackend->i2cWriteReg8(fd, reg, data);
+	}
+	virtual void i2cClose(int fd)
+	{
+		mpBackend->i2cClose(fd);
+	}
+	virtual int i2cReadBlock(int fd, int reg, unsigned char* pData, int length)
+	{
+		return Recorder::block(Recorder::EVENT_I2C_BLOCK, reg, mpBackend->i2cReadBlock(fd, reg, pData, length), pData, length);
+	}
+
+	virtual void pinMode(int pin, int mode)
+	{
+		mpBackend->pinMode(pin, mode);
+	}
+	virtual int digitalRead(int pin)
+	{
+		return Recorder::value(Recorder::EVENT_GPIO_READ, pin, mpBackend->digitalRead(pin));
+	}
+	virtual void digitalWrite(int pin, int value)
+	{
+		mpBackend->digitalWrite(pin, value);
+	}
+
+	virtual int softPwmCreate(int pin, int initialValue, int range)
+	{
+		return Recorder::value(Recorder::EVENT_PWM_CREATE, pin, mpBackend->softPwmCreate(pin, initialValue, range));
+	}
+	virtual void softPwmWrite(int pin, int value)
+	{
+		mpBackend->softPwmWrite(pin, value);
+	}
+
+	virtual void pwmSetMode(int mode)
+	{
+		mpBackend->pwmSetMode(mode);
+	}
+	virtual void pwmSetRange(unsigned int range)
+	{
+		mpBackend->pwmSetRange(range);
+	}
+	virtual void pwmSetClock(int divisor)
+	{
+		mpBackend->pwmSetClock(divisor);
+	}
+	virtual void pwmWrite(int pin, int value)
+	{
+		mpBackend->pwmWrite(pin, value);
+	}
+
+	virtual int setISR(int pin, int edgeType, void (*function)(void))
+	{
+		if(pin < 0 || pin >= Recorder::ISR_PIN_COUNT)return Recorder::value(Recorder::EVENT_ISR_SETUP, pin, -1);
+		gRecordingISR[pin] = function;
+		return Recorder::value(Recorder::EVENT_ISR_SETUP, pin, mpBackend->setISR(pin, edgeType, mpISRTable[pin]));
+	}
+	virtual void clearISR(int pin)
+	{
+		mpBackend->clearISR(pin);
+	}
+
+	//エッジは別スレッドで待つため、登録結果のみ記録する
+	virtual int edgeOpen(int pin, int edgeType)
+	{
+		return Recorder::value(Recorder::EVENT_EDGE_SETUP, pin, mpBackend->edgeOpen(pin, edgeType));
+	}
+	virtual int edgeWait(int handle, int timeout, int& value, struct timespec& time)
+	{
+		return mpBackend->edgeWait(handle, timeout, value, time);
+	}
+	virtual void edgeClose(int handle)
+	{
+		mpBackend->edgeClose(handle);
+	}
+
+	virtual void delay(unsigned int ms)
+	{
+		mpBackend->delay(ms);
+	}
+
+	RecordingBackend(HalBackend* pBackend) : mpBackend(pBackend)
+	{
+		RecordingISRTable<Recorder::ISR_PIN_COUNT>::fill(mpISRTable);
+	}
+};
+
+//////////////////////////////////////////////
+// Replay Backend
+//////////////////////////////////////////////
+//ハードウェアにはアクセスせず、記録された値を返す
+class ReplayBackend : public HalBackend
+{
+public:
+	virtual bool setup()
+	{
+		return Recorder::value(Recorder::EVENT_HAL_SETUP, 0, 1) != 0;
+	}
+
+	virtual int i2cSetup(int address)
+	{
+		return Recorder::value(Recorder::EVENT_I2C_SETUP, address, -1);
+	}
+	virtual int i2cReadReg8(int fd, int reg)
+	{
+		return Recorder::value(Recorder::EVENT_I2C_READ, reg, 0);
+	}
+	virtual int i2cWriteReg8(int fd, int reg, int data)
+	{
+		return 0;
+	}
+	virtual void i2cClose(int fd)
+	{
+	}
+	virtual int i2cReadBlock(int fd, int reg, unsigned char* pData, int length)
+	{
+		return Recorder::block(Recorder::EVENT_I2C_BLOCK, reg, -1, pData, length);
+	}
+
+	virtual void pinMode(int pin, int mode)
+	{
+	}
+	virtual int digitalRead(int pin)
+	{
+		return Recorder::value(Recorder::EVENT_GPIO_READ, pin, LOW);
+	}
+	virtual void digitalWrite(int pin, int value)
+	{
+	}
+
+	virtual int softPwmCreate(int pin, int initialValue, int range)
+	{
+		return Recorder::value(Recorder::EVENT_PWM_CREATE, pin, 0);
+	}
+	virtual void softPwmWrite(int pin, int value)
+	{
+	}
+
+	virtual void pwmSetMode(int mode)
+	{
+	}
+	virtual void pwmSetRange(unsigned int range)
+	{
+	}
+	virtual void pwmSetClock(int divisor)
+	{
+	}
+	virtual void pwmWrite(int pin, int value)
+	{
+	}
+
+	virtual int setISR(int pin, int edgeType, void (*function)(void))
+	{
+		Recorder::setReplayISR(pin, function);
+		return Recorder::value(Recorder::EVENT_ISR_SETUP, pin, 0);
+	}
+	virtual void clearISR(int pin)
+	{
+		Recorder::setReplayISR(pin, NULL);
+	}
+
+	virtual int edgeOpen(int pin, int edgeType)
+	{
+		return Recorder::value(Recorder::EVENT_EDGE_SETUP, pin, 0);
+	}
+	virtual int edgeWait(int handle, int timeout, int& value, struct timespec& time)
+	{
+		//エッジは再生できないため、常にタイムアウトする
+		usleep(timeout * 1000);
+		return 0;
+	}
+	virtual void edgeClose(int handle)
+	{
+	}
+
+	virtual void delay(unsigned int ms)
+	{
+		//再生時は待たない
+	}
+};
+
+//////////////////////////////////////////////
+// Recorder
+//////////////////////////////////////////////
+bool Recorder::startRecording(const char* filename)
+{
+	if(mMode != MODE_NONE)return false;
+	mpFile = fopen(filename, "wb");
+	if(mpFile == NULL)
+	{
+		Debug::print(LOG_SUMMARY, "Recorder: Unable to open %s\r\n", filename);
+		return false;
+	}
+	mBuffer.clear();
+	mBuffer.reserve(RECORDER_FLUSH_SIZE * 2);
+	mBuffer.insert(mBuffer.end(), RECORDER_MAGIC, RECORDER_MAGIC + sizeof(RECORDER_MAGIC));
+	memset(&mLastTime, 0, sizeof(mLastTime));
+	mPendingISRPin = -1;
+	mPendingISRCount = 0;
+	mEventCount = 0;
+	mMainThread = pthread_self();
+	clock_gettime(CLOCK_MONOTONIC_RAW, &mStartTime);
+
+	//今のバックエンドを記録用のバックエンドで包む
+	static RecordingBackend* pBackend = new RecordingBackend(Hal::getBackend());
+	Hal::setBackend(pBackend);
+
+	mMode = MODE_RECORD;
+	Debug::print(LOG_SUMMARY, "Recording inputs to %s\r\n", filename);
+	return true;
+}
+bool Recorder::startReplay(const char* filename)
+{
+	if(mMode != MODE_NONE)return false;
+	FILE* pFile = fopen(filename, "rb");
+	if(pFile == NULL)
+	{
+		Debug::print(LOG_SUMMARY, "Recorder: Unable to open %s\r\n", filename);
+		return false;
+	}
+	//ファイル全体を読み込む
+	mBuffer.clear();
+	unsigned char buf[65536];
+	size_t size;
+	while((size = fread(buf, 1, sizeof(buf), pFile)) > 0)mBuffer.insert(mBuffer.end(), buf, buf + size);
+	fclose(pFile);
+
+	if(mBuffer.size() < sizeof(RECORDER_MAGIC) || memcmp(&mBuffer[0], RECORDER_MAGIC, sizeof(RECORDER_MAGIC)) != 0)
+	{
+		Debug::print(LOG_SUMMARY, "Recorder: %s is not a record file\r\n", filename);
+		mBuffer.clear();
+		return false;
+	}
+	mReadPos = sizeof(RECORDER_MAGIC);
+	memset(&mLastTime, 0, sizeof(mLastTime));
+	memset(mpReplayISR, 0, sizeof(mpReplayISR));
+	mIsFinished = false;
+	mEventCount = 0;
+	mMainThread = pthread_self();
+	clock_gettime(CLOCK_MONOTONIC_RAW, &mStartTime);
+
+	static ReplayBackend backend;
+	Hal::setBackend(&backend);
+
+	mMode = MODE_REPLAY;
+	Debug::print(LOG_SUMMARY, "Replaying %s (%u bytes)\r\n", filename, (unsigned int)mBuffer.size());
+	return true;
+}
+void Recorder::stop()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	if(mMode == MODE_RECORD)
+	{
+		pthread_mutex_lock(&mMutex);
+		flushPendingISR();
+		flush();
+		fclose(mpFile);
+		mpFile = NULL;
+		mMode = MODE_NONE;
+		pthread_mutex_unlock(&mMutex);
+		Debug::print(LOG_SUMMARY, "Recorder: %llu events recorded in %f s\r\n", mEventCount, Time::dt(now, mStartTime));
+	}else if(mMode == MODE_REPLAY)
+	{
+		finishReplay("stopped");
+		Debug::print(LOG_SUMMARY, "Recorder: %llu events replayed in %f s\r\n", mEventCount, Time::dt(now, mStartTime));
+		mMode = MODE_NONE;
+		mBuffer.clear();
+		if(mpReplayFrame != NULL)cvReleaseImage(&mpReplayFrame);
+	}
+}
+Recorder::MODE Recorder::getMode()
+{
+	return mMode;
+}
+bool Recorder::isRecording()
+{
+	return mMode == MODE_RECORD;
+}
+bool Recorder::isReplaying()
+{
+	return mMode == MODE_REPLAY;
+}
+bool Recorder::isFinished()
+{
+	return mMode == MODE_REPLAY && mIsFinished;
+}
+bool Recorder::isTarget()
+{
+	return pthread_equal(pthread_self(), mMainThread) != 0;
+}
+
+void Recorder::writeByte(unsigned char value)
+{
+	mBuffer.push_back(value);
+}
+void Recorder::writeVarint(unsigned long long value)
+{
+	while(value >= 0x80)
+	{
+		mBuffer.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	mBuffer.push_back((unsigned char)value);
+}
+void Recorder::writeSigned(long long value)
+{
+	writeVarint(((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+void Recorder::beginEvent(EVENT type)
+{
+	flushPendingISR();
+	writeByte(type);
+	++mEventCount;
+}
+void Recorder::flushPendingISR()
+{
+	if(mPendingISRCount == 0)return;
+	writeByte(EVENT_ISR);
+	writeVarint(mPendingISRPin);
+	writeVarint(mPendingISRCount);
+	++mEventCount;
+	mPendingISRCount = 0;
+}
+void Recorder::flush()
+{
+	if(mBuffer.empty())return;
+	fwrite(&mBuffer[0], 1, mBuffer.size(), mpFile);
+	mBuffer.clear();
+}
+
+bool Recorder::readByte(unsigned char& value)
+{
+	if(mReadPos >= mBuffer.size())return false;
+	value = mBuffer[mReadPos++];
+	return true;
+}
+bool Recorder::readVarint(unsigned long long& value)
+{
+	value = 0;
+	for(unsigned int shift = 0;shift < 64;shift += 7)
+	{
+		unsigned char byte;
+		if(!readByte(byte))return false;
+		value |= (unsigned long long)(byte & 0x7f) << shift;
+		if(!(byte & 0x80))return true;
+	}
+	return false;
+}
+bool Recorder::readSigned(long long& value)
+{
+	unsigned long long raw;
+	if(!readVarint(raw))return false;
+	value = (long long)(raw >> 1) ^ -(long long)(raw & 1);
+	return true;
+}
+bool Recorder::beginReplayEvent(EVENT type)
+{
+	if(mIsFinished)return false;
+	while(true)
+	{
+		unsigned char event;
+		if(!readByte(event))
+		{
+			finishReplay("end of record");
+			return false;
+		}
+		++mEventCount;
+		if(event == EVENT_ISR)
+		{
+			//記録されたときと同じ位置で割り込み処理を呼び出す
+			unsigned long long pin, count;
+			if(!readVarint(pin) || !readVarint(count))
+			{
+				finishReplay("broken record");
+				return false;
+			}
+			if(pin < ISR_PIN_COUNT && mpReplayISR[pin] != NULL)
+			{
+				for(unsigned long long i = 0;i < count;++i)mpReplayISR[pin]();
+			}
+			continue;
+		}
+		if(event != type)
+		{
+			Debug::print(LOG_SUMMARY, "Recorder: expected event %d but found %d at %u\r\n", type, event, (unsigned int)mReadPos - 1);
+			finishReplay("replay diverged from the record");
+			return false;
+		}
+		return true;
+	}
+}
+void Recorder::finishReplay(const char* reason)
+{
+	if(mIsFinished)return;
+	mIsFinished = true;
+	Debug::print(LOG_SUMMARY, "Replay finished: %s\r\n", reason);
+}
+
+void Recorder::recordTime(const struct timespec& time)
+{
+	if(mMode != MODE_RECORD || !isTarget())return;
+	pthread_mutex_lock(&mMutex);
+	beginEvent(EVENT_TIME);
+	writeSigned((long long)(time.tv_sec - mLastTime.tv_sec) * 1000000000LL + (time.tv_nsec - mLastTime.tv_nsec));
+	mLastTime = time;
+	if(mBuffer.size() > RECORDER_FLUSH_SIZE)flush();
+	pthread_mutex_unlock(&mMutex);
+}
+bool Recorder::replayTime(struct timespec& time)
+{
+	long long delta;
+	if(!isTarget() || !beginReplayEvent(EVENT_TIME) || !readSigned(delta))
+	{
+		//再生が終わった後は最後の時刻のまま
+		time = mLastTime;
+		return false;
+	}
+	long long nsec = mLastTime.tv_nsec + delta;
+	time.tv_sec = mLastTime.tv_sec + nsec / 1000000000LL;
+	time.tv_nsec = nsec % 1000000000LL;
+	if(time.tv_nsec < 0)
+	{
+		time.tv_nsec += 1000000000LL;
+		--time.tv_sec;
+	}
+	mLastTime = time;
+	return true;
+}
+int Recorder::value(EVENT type, int key, int value)
+{
+	if(mMode == MODE_NONE || !isTarget())return value;
+	if(mMode == MODE_RECORD)
+	{
+		pthread_mutex_lock(&mMutex);
+		beginEvent(type);
+		writeSigned(key);
+		writeSigned(value);
+		if(mBuffer.size() > RECORDER_FLUSH_SIZE)flush();
+		pthread_mutex_unlock(&mMutex);
+		return value;
+	}
+
+	long long recordedKey, recordedValue;
+	if(!beginReplayEvent(type) || !readSigned(recordedKey) || !readSigned(recordedValue))return value;
+	if(recordedKey != key)
+	{
+		Debug::print(LOG_SUMMARY, "Recorder: expected key %d but found %lld for event %d\r\n", key, recordedKey, type);
+		finishReplay("replay diverged from the record");
+		return value;
+	}
+	return (int)recordedValue;
+}
+int Recorder::block(EVENT type, int key, int result, unsigned char* pData, int length)
+{
+	if(mMode == MODE_NONE || !isTarget())return result;
+	if(mMode == MODE_RECORD)
+	{
+		pthread_mutex_lock(&mMutex);
+		beginEvent(type);
+		writeSigned(key);
+		writeSigned(result);
+		if(result > 0)mBuffer.insert(mBuffer.end(), pData, pData + result);
+		if(mBuffer.size() > RECORDER_FLUSH_SIZE)flush();
+		pthread_mutex_unlock(&mMutex);
+		return result;
+	}
+
+	long long recordedKey, recordedResult;
+	if(!beginReplayEvent(type) || !readSigned(recordedKey) || !readSigned(recordedResult))return result;
+	if(recordedKey != key || recordedResult > length || mReadPos + (recordedResult > 0 ? recordedResult : 0) > mBuffer.size())
+	{
+		Debug::print(LOG_SUMMARY, "Recorder: expected key %d but found %lld for event %d\r\n", key, recordedKey, type);
+		finishReplay("replay diverged from the record");
+		return result;
+	}
+	if(recordedResult > 0)
+	{
+		memcpy(pData, &mBuffer[mReadPos], recordedResult);
+		mReadPos += recordedResult;
+	}
+	return (int)recordedResult;
+}
+void Recorder::recordISR(int pin)
+{
+	if(mMode != MODE_RECORD)return;
+	pthread_mutex_lock(&mMutex);
+	//同じピンの割り込みが続く場合は回数だけを数える
+	if(mPendingISRCount > 0 && mPendingISRPin != pin)flushPendingISR();
+	mPendingISRPin = pin;
+	++mPendingISRCount;
+	pthread_mutex_unlock(&mMutex);
+}
+void Recorder::setReplayISR(int pin, void (*function)(void))
+{
+	if(pin < 0 || pin >= ISR_PIN_COUNT)return;
+	mpReplayISR[pin] = function;
+}
+IplImage* Recorder::frame(IplImage* pImage)
+{
+	if(mMode == MODE_NONE || !isTarget())return pImage;
+	if(mMode == MODE_RECORD)
+	{
+		pthread_mutex_lock(&mMutex);
+		beginEvent(EVENT_FRAME);
+		if(pImage == NULL)writeVarint(0);
+		else
+		{
+			writeVarint(pImage->imageSize);
+			writeVarint(pImage->width);
+			writeVarint(pImage->height);
+			writeVarint(pImage->depth);
+			writeVarint(pImage->nChannels);
+			writeVarint(pImage->widthStep);
+			mBuffer.insert(mBuffer.end(), (unsigned char*)pImage->imageData, (unsigned char*)pImage->imageData + pImage->imageSize);
+		}
+		if(mBuffer.size() > RECORDER_FLUSH_SIZE)flush();
+		pthread_mutex_unlock(&mMutex);
+		return pImage;
+	}
+
+	unsigned long long size, width, height, depth, channels, widthStep;
+	if(!beginReplayEvent(EVENT_FRAME) || !readVarint(size))return NULL;
+	if(size == 0)return NULL;
+	if(!readVarint(width) || !readVarint(height) || !readVarint(depth) || !readVarint(channels) || !readVarint(widthStep) || mReadPos + size > mBuffer.size())
+	{
+		finishReplay("broken record");
+		return NULL;
+	}
+
+	//前回と同じ形式の画像なら使いまわす
+	if(mpReplayFrame != NULL && (mpReplayFrame->width != (int)width || mpReplayFrame->height != (int)height || mpReplayFrame->depth != (int)depth
+		|| mpReplayFrame->nChannels != (int)channels || mpReplayFrame->imageSize != (int)size))cvReleaseImage(&mpReplayFrame);
+	if(mpReplayFrame == NULL)mpReplayFrame = cvCreateImage(cvSize(width, height), depth, channels);
+	if(mpReplayFrame->widthStep != (int)widthStep || mpReplayFrame->imageSize != (int)size)
+	{
+		finishReplay("unsupported frame format");
+		mReadPos += size;
+		return NULL;
+	}
+	memcpy(mpReplayFrame->imageData, &mBuffer[mReadPos], size);
+	mReadPos += size;
+	return mpReplayFrame;
+}
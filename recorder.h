@@ -0,0 +1,111 @@
+/*
+	記録/再生クラス
+
+	ドライバが読み込んだ値とTaskManagerが使った時刻をバイナリファイルに記録し、あとから同じ順番で再生します
+	・記録：./out --record [ファイル名]
+	・再生：./out --replay [ファイル名]
+	・記録するもの：I2Cレジスタの読み込み値(連続読み込みを含む)、GPIOの読み込み値、エンコーダの割り込み、カメラ画像、
+	  シリアルからの入力、Time::getが返した時刻(onUpdateに渡される時刻を含む)
+	・再生中はハードウェアに一切アクセスせず、記録された時刻を仮想時計として使います
+	  TaskManagerはスリープしないため、実時間より速く実行されます
+	・記録/再生の対象はメインスレッドからの呼び出しと割り込みのみです
+	  別スレッドで値を読むタスク(DistanceSensorのエッジ検出など)は再生時には値を得られません
+	・記録/再生中は非同期初期化(setAsyncInit)も同期的に行います
+
+	ファイル形式：先頭にRECORDER_MAGIC、以降は[種類(1byte)][可変長の値...]のイベントが続く
+	数値は可変長整数(7bitずつ、符号付きの値はzigzag符号化)で保存します
+*/
+#pragma once
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <vector>
+
+typedef struct _IplImage IplImage;
+
+class Recorder
+{
+public:
+	enum MODE {MODE_NONE, MODE_RECORD, MODE_REPLAY};
+	enum EVENT
+	{
+		EVENT_TIME = 1,		//Time::getが返した時刻(前回との差、ns)
+		EVENT_HAL_SETUP,	//Hal::setupの結果
+		EVENT_I2C_SETUP,	//I2Cのファイルハンドル(キーはアドレス)
+		EVENT_I2C_READ,		//I2Cレジスタの値(キーはレジスタ番号)
+		EVENT_GPIO_READ,	//GPIOの値(キーはピン番号)
+		EVENT_PWM_CREATE,	//ソフトウェアPWMの作成結果(キーはピン番号)
+		EVENT_ISR_SETUP,	//割り込みの登録結果(キーはピン番号)
+		EVENT_ISR,			//割り込み(ピン番号と回数)
+		EVENT_INPUT,		//シリアルから入力された文字
+		EVENT_CAMERA,		//カメラの初期化結果(キー0)やデバイス番号(キー1)
+		EVENT_FRAME,		//カメラ画像
+		EVENT_I2C_BLOCK,	//I2Cの連続読み込み(キーはレジスタ番号、値は結果と読み込んだデータ)
+		EVENT_EDGE_SETUP	//エッジ検出の登録結果(キーはピン番号)
+	};
+	const static int ISR_PIN_COUNT = 64;
+private:
+	static MODE mMode;
+	static FILE* mpFile;
+	static std::vector<unsigned char> mBuffer;//記録時は書き込み待ちのデータ、再生時はファイル全体
+	static size_t mReadPos;
+	static pthread_mutex_t mMutex;
+	static pthread_t mMainThread;
+	static struct timespec mLastTime;
+	static int mPendingISRPin;//まとめて書き込む割り込みのピン番号と回数
+	static unsigned int mPendingISRCount;
+	static void (*mpReplayISR[ISR_PIN_COUNT])(void);
+	static IplImage* mpReplayFrame;
+	static bool mIsFinished;
+	static unsigned long long mEventCount;
+	static struct timespec mStartTime;
+
+	//記録用(mMutexをロックしてから呼ぶこと)
+	static void writeByte(unsigned char value);
+	static void writeVarint(unsigned long long value);
+	static void writeSigned(long long value);
+	static void beginEvent(EVENT type);
+	static void flushPendingISR();
+	static void flush();
+
+	//再生用
+	static bool readByte(unsigned char& value);
+	static bool readVarint(unsigned long long& value);
+	static bool readSigned(long long& value);
+	//次のイベントを読み込む(途中の割り込みは呼び出す)、種類が違う場合は再生を終了してfalseを返す
+	static bool beginReplayEvent(EVENT type);
+	static void finishReplay(const char* reason);
+
+	//記録/再生の対象となる呼び出しか(メインスレッドのみ)
+	static bool isTarget();
+public:
+	//記録/再生を開始する(Halを使う前に呼び出すこと)
+	static bool startRecording(const char* filename);
+	static bool startReplay(const char* filename);
+	//記録/再生を終了する(記録時はファイルに書き込む)
+	static void stop();
+
+	static MODE getMode();
+	static bool isRecording();
+	static bool isReplaying();
+	//再生が最後まで終わったか
+	static bool isFinished();
+
+	//時刻を記録する/記録された時刻を返す
+	static void recordTime(const struct timespec& time);
+	static bool replayTime(struct timespec& time);
+
+	//値を記録してそのまま返す/記録された値を返す(記録/再生中でなければvalueをそのまま返す)
+	static int value(EVENT type, int key, int value);
+
+	//連続読み込みの結果とデータを記録してそのまま返す/記録された結果を返してpDataに記録されたデータを書き込む
+	static int block(EVENT type, int key, int result, unsigned char* pData, int length);
+
+	//割り込みを記録する(割り込みのスレッドから呼ばれる)
+	static void recordISR(int pin);
+	//再生時に呼び出す割り込み処理を登録する
+	static void setReplayISR(int pin, void (*function)(void));
+
+	//カメラ画像を記録してそのまま返す/記録された画像を返す(画像は次の呼び出しまで有効)
+	static IplImage* frame(IplImage* pImage);
+};
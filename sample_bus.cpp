@@ -0,0 +1,35 @@
+#include "sample_bus.h"
+
+SampleBus gSampleBus;
+
+template<unsigned int N> static void showChannel(const char* name, const SampleChannel<N>& channel, const struct timespec& time)
+{
+	TimedSample sample;
+	if(!channel.getLatest(sample))
+	{
+		Debug::print(LOG_SUMMARY, " %-9s %10u          -\r\n", name, channel.getCount());
+		return;
+	}
+	Debug::print(LOG_SUMMARY, " %-9s %10u %10.1f  (%f %f %f)\r\n", name, channel.getCount(), Time::dt(time, sample.time) * 1000, sample.value.x, sample.value.y, sample.value.z);
+}
+bool SampleBus::onCommand(const std::vector<std::string>& args)
+{
+	//チャンネルごとのサンプル数と最新のサンプルの古さ、値を表示
+	struct timespec time;
+	Time::get(time);
+	Debug::print(LOG_SUMMARY, "SampleBus:\r\n Channel       Count    Age(ms)  Latest value\r\n");
+	showChannel("gyro", gyro, time);
+	showChannel("accel", accel, time);
+	showChannel("encoder", encoder, time);
+	showChannel("gps", gps, time);
+	showChannel("pressure", pressure, time);
+	return true;
+}
+SampleBus::SampleBus() : gyro(), accel(), encoder(), gps(), pressure()
+{
+	setName("samplebus");
+	setPriority(UINT_MAX,UINT_MAX);
+}
+SampleBus::~SampleBus()
+{
+}
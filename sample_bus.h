@@ -0,0 +1,182 @@
+/*
+	センササンプルバス
+
+	各ドライバが読み込んだサンプルを時刻付きでチャンネルごとのリングバッファに積み、
+	融合処理などが同じ時刻のサンプルを揃えて使えるようにします
+	・書き込むスレッドはチャンネルごとに1つだけにすること(ドライバのonUpdateなど)
+	・読み込み側はロックを取らず、書き込み側を待たせない(上書きされたサンプルは読み飛ばす)
+	・期間内のサンプルをすべて取得するか、任意の時刻の値を前後のサンプルから線形補間して取得する
+	・samplebusコマンドでチャンネルごとのサンプル数、最新の時刻と値を表示します
+*/
+#pragma once
+#include <time.h>
+#include "task.h"
+#include "utils.h"
+#include "seqlock.h"
+
+//時刻付きのサンプル
+struct TimedSample
+{
+	struct timespec time;//サンプリング時刻
+	VECTOR3 value;
+};
+
+//1種類のセンサのサンプルを保持するリングバッファ(Nは保持するサンプル数、2のべき乗にすること)
+template<unsigned int N> class SampleChannel
+{
+	struct Slot
+	{
+		unsigned int index;//何番目のサンプルか(上書きの検出用)
+		TimedSample sample;
+	};
+	Seqlock<Slot> mSlots[N];
+	volatile unsigned int mCount;//これまでに積んだサンプルの総数
+
+	//index番目のサンプルを読み込む(上書きされていればfalse)
+	bool readSlot(unsigned int index, TimedSample& sample) const
+	{
+		Slot slot;
+		mSlots[index % N].read(slot);
+		if(slot.index != index)return false;
+		sample = slot.sample;
+		return true;
+	}
+	//時刻がtime以降の最初のサンプルの番号を探す(無ければcountを返す)
+	unsigned int lowerBound(const struct timespec& time, unsigned int begin, unsigned int count) const
+	{
+		unsigned int low = begin, high = count;
+		while(low < high)
+		{
+			unsigned int mid = low + (high - low) / 2;
+			TimedSample sample;
+			if(!readSlot(mid, sample) || Time::dt(sample.time, time) < 0)low = mid + 1;
+			else high = mid;
+		}
+		return low;
+	}
+	//上書きされていない最も古いサンプルの番号
+	unsigned int getOldest(unsigned int count) const
+	{
+		//書き込み中のスロットを避けるため1つ余分に空ける
+		return count > N - 1 ? count - (N - 1) : 0;
+	}
+public:
+	//サンプルを積む(書き込み側のスレッドから呼ぶこと)
+	void push(const struct timespec& time, const VECTOR3& value)
+	{
+		Slot slot;
+		slot.index = mCount;
+		slot.sample.time = time;
+		slot.sample.value = value;
+		mSlots[slot.index % N].write(slot);
+		__sync_synchronize();
+		mCount = slot.index + 1;
+	}
+
+	//最新のサンプルを取得する(サンプルが無ければfalse)
+	bool getLatest(TimedSample& sample) const
+	{
+		unsigned int count = mCount;
+		__sync_synchronize();
+		return count > 0 && readSlot(count - 1, sample);
+	}
+
+	//時刻がbeginより後でend以前のサンプルを古い順にpSamplesに最大maxCount個書き込み、書き込んだ数を返す
+	unsigned int getWindow(const struct timespec& begin, const struct timespec& end, TimedSample* pSamples, unsigned int maxCount) const
+	{
+		unsigned int count = mCount;
+		__sync_synchronize();
+		unsigned int index = lowerBound(begin, getOldest(count), count);
+		unsigned int written = 0;
+		for(;index < count && written < maxCount;++index)
+		{
+			TimedSample sample;
+			if(!readSlot(index, sample))continue;
+			if(Time::dt(sample.time, begin) <= 0)continue;
+			if(Time::dt(sample.time, end) > 0)break;
+			pSamples[written++] = sample;
+		}
+		return written;
+	}
+
+	//時刻がbeginより後でend以前のサンプルの平均を求める(サンプルが無ければfalse)
+	bool getMean(const struct timespec& begin, const struct timespec& end, VECTOR3& mean) const
+	{
+		unsigned int count = mCount;
+		__sync_synchronize();
+		unsigned int index = lowerBound(begin, getOldest(count), count);
+		VECTOR3 sum;
+		unsigned int used = 0;
+		for(;index < count;++index)
+		{
+			TimedSample sample;
+			if(!readSlot(index, sample))continue;
+			if(Time::dt(sample.time, begin) <= 0)continue;
+			if(Time::dt(sample.time, end) > 0)break;
+			sum += sample.value;
+			++used;
+		}
+		if(used == 0)return false;
+		mean = sum / used;
+		return true;
+	}
+
+	//時刻timeの値を前後のサンプルから線形補間して求める(保持しているサンプルの範囲外ならfalse)
+	bool interpolate(const struct timespec& time, VECTOR3& value) const
+	{
+		unsigned int count = mCount;
+		__sync_synchronize();
+		unsigned int oldest = getOldest(count);
+		unsigned int index = lowerBound(time, oldest, count);
+		TimedSample after, before;
+		if(index >= count || !readSlot(index, after))return false;
+		double dtAfter = Time::dt(after.time, time);
+		if(dtAfter <= 0)
+		{
+			//ちょうどその時刻のサンプル
+			value = after.value;
+			return true;
+		}
+		if(index == oldest || !readSlot(index - 1, before))return false;
+		double span = Time::dt(after.time, before.time);
+		if(span <= 0)
+		{
+			value = after.value;
+			return true;
+		}
+		value = before.value + (after.value - before.value) * (1 - dtAfter / span);
+		return true;
+	}
+
+	//これまでに積んだサンプルの総数
+	unsigned int getCount() const
+	{
+		return mCount;
+	}
+
+	SampleChannel() : mCount(0)
+	{
+	}
+};
+
+class SampleBus : public TaskBase
+{
+protected:
+	virtual bool onCommand(const std::vector<std::string>& args);
+public:
+	//補正済みの角速度(dps)
+	SampleChannel<SAMPLE_BUS_GYRO_SIZE> gyro;
+	//加速度(G)
+	SampleChannel<SAMPLE_BUS_ACCEL_SIZE> accel;
+	//エンコーダのパルス数(x:左 y:右)
+	SampleChannel<SAMPLE_BUS_ENCODER_SIZE> encoder;
+	//GPSの座標(経度、緯度、高度)、新しい座標を受信したときのみ
+	SampleChannel<SAMPLE_BUS_GPS_SIZE> gps;
+	//気圧(x:気圧(hPa) y:基準気圧からの高度(m) z:鉛直速度(m/s)、基準気圧が決まるまではy,zは0)
+	SampleChannel<SAMPLE_BUS_PRESSURE_SIZE> pressure;
+
+	SampleBus();
+	~SampleBus();
+};
+
+extern SampleBus gSampleBus;
@@ -1,6 +1,4 @@
 //ttb
-#include <wiringPiI2C.h>
-#include <wiringPi.h>
 #include <time.h>
 #include <string.h>
 #include <sstream>
@@ -13,7 +11,12 @@
 #include <sys/ioctl.h>
 #include "sensor.h"
 #include "utils.h"
+#include "hal.h"
+#include "recorder.h"
+#include "telemetry.h"
+#include "sample_bus.h"
 #include "pose_detector.h"
+#include "motor.h"
 
 PressureSensor gPressureSensor;
 GPSSensor gGPSSensor;
@@ -74,21 +77,24 @@ AccelerationSensor gAccelerationSensor;
 //  return ioctl (fd, I2C_SMBUS, &args) ;
 //}
 
-unsigned int wiringPiI2CReadReg32LE(int fd, int address)
+//FIFOの最後のサンプルを転送時刻とし、出力データレートの間隔でさかのぼってcount個中index番目のサンプルの時刻を求める
+static void estimateFifoSampleTime(struct timespec& sample_time, const struct timespec& time, unsigned int index, unsigned int count, double period)
 {
-	return (unsigned int)((unsigned long)wiringPiI2CReadReg8(fd, address + 3) << 24 | (unsigned int)wiringPiI2CReadReg8(fd, address + 2) << 16 | (unsigned int)wiringPiI2CReadReg8(fd, address + 1) << 8 | (unsigned int)wiringPiI2CReadReg8(fd, address));
-}
-unsigned short wiringPiI2CReadReg16BE(int fd, int address)
-{
-	return (unsigned short)((unsigned short)wiringPiI2CReadReg8(fd, address) << 8 | (unsigned short)wiringPiI2CReadReg8(fd, address + 1));
-}
-unsigned short wiringPiI2CReadReg16LE(int fd, int address)
-{
-	return (unsigned short)((unsigned short)wiringPiI2CReadReg8(fd, address) | (unsigned short)wiringPiI2CReadReg8(fd, address + 1) << 8);
+	sample_time = time;
+	long long offset = (long long)((count - 1 - index) * period * 1000000000);
+	long long nsec = (long long)sample_time.tv_nsec - offset;
+	sample_time.tv_sec += nsec / 1000000000;
+	sample_time.tv_nsec = nsec % 1000000000;
+	if(sample_time.tv_nsec < 0)
+	{
+		sample_time.tv_nsec += 1000000000;
+		--sample_time.tv_sec;
+	}
 }
 
 
 
+
 //////////////////////////////////////////////
 // Pressure Sensor
 //////////////////////////////////////////////
@@ -100,14 +106,14 @@ float PressureSensor::val2float(unsigned int val, int total_bits, int fractional
 
 bool PressureSensor::onInit(const struct timespec& time)
 {
-	if((mFileHandle = wiringPiI2CSetup(0x60)) == -1)
+	if((mFileHandle = Hal::i2cSetup(0x60)) == -1)
 	{
 		Debug::print(LOG_SUMMARY,"Failed to setup Pressure Sensor\r\n");
 		return false;
 	}
 
 	//気圧センサーの動作を確認(0xc - 0xfに0が入っているか確かめる)
-	if(wiringPiI2CReadReg32LE(mFileHandle,0x0c) != 0)
+	if(Hal::i2cReadReg32LE(mFileHandle,0x0c) != 0)
 	{
 		//close(mFileHandle);
 		Debug::print(LOG_SUMMARY,"Failed to verify Pressure Sensor\r\n");
@@ -115,17 +121,20 @@ bool PressureSensor::onInit(const struct timespec& time)
 	}
 
 	//気圧計算用の係数を取得
-	mA0 = val2float(wiringPiI2CReadReg16BE(mFileHandle,0x04),16,3,0);
-	mB1 = val2float(wiringPiI2CReadReg16BE(mFileHandle,0x06),16,13,0);
-	mB2 = val2float(wiringPiI2CReadReg16BE(mFileHandle,0x08),16,14,0);
-	mC12 = val2float(wiringPiI2CReadReg16BE(mFileHandle,0x0A),14,13,9);
+	mA0 = val2float(Hal::i2cReadReg16BE(mFileHandle,0x04),16,3,0);
+	mB1 = val2float(Hal::i2cReadReg16BE(mFileHandle,0x06),16,13,0);
+	mB2 = val2float(Hal::i2cReadReg16BE(mFileHandle,0x08),16,14,0);
+	mC12 = val2float(Hal::i2cReadReg16BE(mFileHandle,0x0A),14,13,9);
+
+	//最初のサンプルから基準気圧を求める
+	setBaseline();
 
 	//気圧取得要求
 	requestSample();
 
-	//気圧更新リクエスト
-	mLastUpdateRequest = time;
-	requestSample();
+	//以降の読み込みと気圧取得要求はI2Cバスのスレッドで行う
+	mTransfer.mFileHandle = mFileHandle;
+	gI2CBus.add(&mTransfer);
 
 	Debug::print(LOG_SUMMARY,"Pressure Sensor is Ready!: (%f %f %f %f)\r\n",mA0,mB1,mB2,mC12);
 	return true;
@@ -133,44 +142,114 @@ bool PressureSensor::onInit(const struct timespec& time)
 
 void PressureSensor::onClean()
 {
-	close(mFileHandle);
+	gI2CBus.remove(&mTransfer);
+	Hal::i2cClose(mFileHandle);
 }
 void PressureSensor::requestSample()
 {
 	//新しい気圧取得要求(3ms後に値が読み込まれてレジスタに格納される)
-	wiringPiI2CWriteReg8(mFileHandle,0x12,0x01);
+	Hal::i2cWriteReg8(mFileHandle,0x12,0x01);
 }
 void PressureSensor::onUpdate(const struct timespec& time)
 {
-	if(Time::dt(time,mLastUpdateRequest) > 0.003)//前回のデータ要請から3ms以上経過している場合値を読み取って更新する
-	{
-		//気圧値計算
-		unsigned int Padc = wiringPiI2CReadReg8(mFileHandle,0x00) << 2 | wiringPiI2CReadReg8(mFileHandle,0x01) >> 6;
-		unsigned int Tadc = wiringPiI2CReadReg8(mFileHandle,0x02) << 2 | wiringPiI2CReadReg8(mFileHandle,0x03) >> 6;
+	//I2Cバスのスレッドが読み込んだ値があれば気圧を更新する
+	gI2CBus.poll(&mTransfer, time);
+	Sample sample;
+	if(!mTransfer.receive(sample))return;
 
-		float Pcomp = mA0 + (mB1 + mC12 * Tadc) * Padc + mB2 * Tadc;
-		mPressure = (Pcomp * (115 - 50) / 1023.0 + 50) * 10;
+	//気圧値計算(温度補正込み)
+	float Pcomp = mA0 + (mB1 + mC12 * sample.tadc) * sample.padc + mB2 * sample.tadc;
+	float pressure = (Pcomp * (115 - 50) / 1023.0 + 50) * 10;
+	float temperature = 25 + (sample.tadc - 498.0) / -5.35;//MPL115A2の温度(-5.35count/℃、498countで25℃)
+	Telemetry::writePressure(time, sample.padc, sample.tadc, pressure);
 
-		//気圧更新要請
-		requestSample();
-
-		//気圧更新要請時刻を記録
-		mLastUpdateRequest = time;
+	if(mBaselineCount < PRESSURE_BASELINE_COUNT)
+	{
+		//基準気圧を決めるためのサンプルを集める
+		mBaselineSum += pressure;
+		mBaselineSquareSum += (double)pressure * pressure;
+		if(++mBaselineCount == PRESSURE_BASELINE_COUNT)
+		{
+			mBaselinePressure = mBaselineSum / PRESSURE_BASELINE_COUNT;
+
+			//観測ノイズは基準気圧のサンプルのばらつきとする
+			//(隣り合うカウントを行き来するだけでも半カウント程度はずれるため、それより小さくはしない)
+			double variance = mBaselineSquareSum / PRESSURE_BASELINE_COUNT - mBaselinePressure * mBaselinePressure;
+			double minimum = PRESSURE_RESOLUTION / 2;
+			if(variance < minimum * minimum)variance = minimum * minimum;
+			double scale = 29.27 * (temperature + 273.15) / mBaselinePressure;//気圧1hPaあたりの高度(m)
+			mFilter.reset(variance * scale * scale);
+			mLastSampleTime = sample.time;
+			Debug::print(LOG_SUMMARY, "Pressure: baseline %.2f hPa (%.1f C), noise %.1f m\r\n", mBaselinePressure, temperature, sqrt(mFilter.getMeasurementVariance()));
+		}
+	}else
+	{
+		//測高公式(気温が一定の層とみなす)で基準気圧からの高度に変換し、フィルタにかける
+		double altitude = 29.27 * (temperature + 273.15) * log(mBaselinePressure / pressure);//29.27 = 乾燥空気の気体定数 / 重力加速度(m/K)
+		mFilter.update(altitude, Time::dt(sample.time, mLastSampleTime));
+		mLastSampleTime = sample.time;
 	}
+	gSampleBus.pressure.push(sample.time, mBaselineCount >= PRESSURE_BASELINE_COUNT ? VECTOR3(pressure, mFilter.getAltitude(), mFilter.getSpeed()) : VECTOR3(pressure, 0, 0));
+
+	Snapshot snapshot;
+	snapshot.time = time;
+	snapshot.pressure = pressure;
+	snapshot.exactPressure = pressure;
+	snapshot.temperature = temperature;
+	snapshot.isBaselineReady = mBaselineCount >= PRESSURE_BASELINE_COUNT;
+	snapshot.altitude = mFilter.getAltitude();
+	snapshot.verticalSpeed = mFilter.getSpeed();
+	snapshot.verticalSpeedVariance = mFilter.getSpeedVariance();
+	mSnapshot.write(snapshot);
+}
+bool PressureSensor::Transfer::transfer(Sample& result, const struct timespec& time)
+{
+	unsigned char data[4];
+	if(Hal::i2cReadBlock(mFileHandle,0x00,data,4) != 4)return false;
+	result.padc = data[0] << 2 | data[1] >> 6;
+	result.tadc = data[2] << 2 | data[3] >> 6;
+	result.time = time;
+
+	//次の気圧取得要求(3ms後に値が読み込まれてレジスタに格納される)
+	Hal::i2cWriteReg8(mFileHandle,0x12,0x01);
+	return true;
+}
+PressureSensor::Transfer::Transfer() : I2CTransaction<Sample>("pressure", I2C_PRIORITY_PRESSURE, I2C_PERIOD_PRESSURE), mFileHandle(-1)
+{
 }
 
 bool PressureSensor::onCommand(const std::vector<std::string>& args)
 {
 	if(!isActive())return false;
-	Debug::print(LOG_SUMMARY, "Pressure: %d\r\n",mPressure);
+	if(args.size() == 2 && args[1].compare("baseline") == 0)
+	{
+		setBaseline();
+		return true;
+	}
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	Debug::print(LOG_SUMMARY, "Pressure: %d (%.2f hPa, %.1f C)\r\n",snapshot.pressure,snapshot.exactPressure,snapshot.temperature);
+	if(snapshot.isBaselineReady)Debug::print(LOG_SUMMARY, "Altitude: %.1f m, Vertical speed: %.2f +- %.2f m/s\r\n",snapshot.altitude,snapshot.verticalSpeed,sqrt(snapshot.verticalSpeedVariance));
+	Debug::print(LOG_PRINT, "pressure baseline : reset altitude to 0\r\n");
 	return true;
 }
 
+void PressureSensor::getSnapshot(Snapshot& snapshot) const
+{
+	mSnapshot.read(snapshot);
+}
 int PressureSensor::get()
 {
-	return mPressure;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.pressure;
+}
+void PressureSensor::setBaseline()
+{
+	mBaselineSum = mBaselineSquareSum = 0;
+	mBaselineCount = 0;
 }
-PressureSensor::PressureSensor() : mA0(0),mB1(0),mB2(0),mC12(0),mPressure(0),mFileHandle(-1)
+PressureSensor::PressureSensor() : mA0(0),mB1(0),mB2(0),mC12(0),mFileHandle(-1),mBaselinePressure(0),mBaselineSum(0),mBaselineSquareSum(0),mBaselineCount(0),mFilter(),mSnapshot()
 {
 	setName("pressure");
 	setPriority(TASK_PRIORITY_SENSOR,TASK_INTERVAL_SENSOR);
@@ -185,81 +264,128 @@ PressureSensor::~PressureSensor()
 bool GPSSensor::onInit(const struct timespec& time)
 {
 	mLastCheckTime = time;
-	if ((mFileHandle = wiringPiI2CSetup(0x20)) == -1)
+	if ((mFileHandle = Hal::i2cSetup(0x20)) == -1)
 	{
 		Debug::print(LOG_SUMMARY, "Failed to setup GPS Sensor\r\n");
 		return false;
 	}
 
 	//座標を更新するように設定(一応2回書き込み)
-	wiringPiI2CWriteReg8(mFileHandle, 0x01, 0x05);
-	wiringPiI2CWriteReg8(mFileHandle, 0x01, 0x05);
+	Hal::i2cWriteReg8(mFileHandle, 0x01, 0x05);
+	Hal::i2cWriteReg8(mFileHandle, 0x01, 0x05);
 
 	//バージョン情報を表示
-	Debug::print(LOG_SUMMARY, "GPS Firmware Version:%d\r\n", wiringPiI2CReadReg8(mFileHandle, 0x03));
+	Debug::print(LOG_SUMMARY, "GPS Firmware Version:%d\r\n", Hal::i2cReadReg8(mFileHandle, 0x03));
 
 	mPos.x = mPos.y = mPos.z = 0;
-	mIsNewData = false;
+	mReadDataCount = mNewDataCount;
+	publish(time);
 	mIsLogger = false; //20150826仲田 testingに入ったらtrueにする
+
+	//以降のレジスタの読み込みはI2Cバスのスレッドで行う
+	mTransfer.mFileHandle = mFileHandle;
+	gI2CBus.add(&mTransfer);
 	return true;
 }
 void GPSSensor::onClean()
 {
+	gI2CBus.remove(&mTransfer);
+
 	//動作を停止するコマンドを発行
-	wiringPiI2CWriteReg8(mFileHandle, 0x01, 0x06);
+	Hal::i2cWriteReg8(mFileHandle, 0x01, 0x06);
 
-	close(mFileHandle);
+	Hal::i2cClose(mFileHandle);
+}
+//読み込んだレジスタからリトルエンディアンの値を取り出す
+static unsigned int gpsRegister32(const unsigned char* pRegisters, int reg)
+{
+	return (unsigned int)pRegisters[reg] | (unsigned int)pRegisters[reg + 1] << 8 | (unsigned int)pRegisters[reg + 2] << 16 | (unsigned int)pRegisters[reg + 3] << 24;
+}
+static unsigned short gpsRegister16(const unsigned char* pRegisters, int reg)
+{
+	return (unsigned short)(pRegisters[reg] | pRegisters[reg + 1] << 8);
+}
+bool GPSSensor::Transfer::transfer(Registers& result, const struct timespec& time)
+{
+	//レジスタ全体を1回の転送で2回読み込む(読み取り時のデータ乱れ防止用)
+	for(int i = 0;i < 2;++i)
+	{
+		if(Hal::i2cReadBlock(mFileHandle, 0x00, result.data[i], REGISTER_COUNT) != REGISTER_COUNT)return false;
+	}
+	return true;
+}
+GPSSensor::Transfer::Transfer() : I2CTransaction<Registers>("gps", I2C_PRIORITY_GPS, I2C_PERIOD_GPS), mFileHandle(-1)
+{
 }
 void GPSSensor::onUpdate(const struct timespec& time)
 {
-	unsigned char status = wiringPiI2CReadReg8(mFileHandle, 0x00);
+	//I2Cバスのスレッドが読み込んだレジスタがあれば座標などを更新する
+	gI2CBus.poll(&mTransfer, time);
+	Registers registers;
+	if(mTransfer.receive(registers))decode(registers, time);
+
+	if (mIsLogger)
+	{
+		//1秒ごとにGPS座標を表示する
+		if (Time::dt(time, mLastCheckTime) > 1)
+		{
+			mLastCheckTime = time;
+			showState();
+		}
+	}
+}
+void GPSSensor::decode(const Registers& registers, const struct timespec& time)
+{
+	//2回読み込んだレジスタで等しい値が取れた場合のみ採用する
+	const unsigned char* pFirst = registers.data[0];
+	const unsigned char* pSecond = registers.data[1];
+	unsigned char status = pFirst[0x00];
 	if (status & 0x06)// Found Position
 	{
-		//座標を更新(読み取り時のデータ乱れ防止用に2回読み取って等しい値が取れた場合のみ採用する)
-
 		//経度
-		int read = (int)wiringPiI2CReadReg32LE(mFileHandle, 0x07);
-		if (read == (int)wiringPiI2CReadReg32LE(mFileHandle, 0x07))mPos.x = read / 10000000.0;
+		if (memcmp(pFirst + 0x07, pSecond + 0x07, 4) == 0)mPos.x = (int)gpsRegister32(pFirst, 0x07) / 10000000.0;
 
 		//緯度
-		read = (int)wiringPiI2CReadReg32LE(mFileHandle, 0x0B);
-		if (read == (int)wiringPiI2CReadReg32LE(mFileHandle, 0x0B))mPos.y = read / 10000000.0;
+		if (memcmp(pFirst + 0x0B, pSecond + 0x0B, 4) == 0)mPos.y = (int)gpsRegister32(pFirst, 0x0B) / 10000000.0;
 
 		//高度
-		read = (short)wiringPiI2CReadReg16LE(mFileHandle, 0x21);
-		if (read == (short)wiringPiI2CReadReg16LE(mFileHandle, 0x21))mPos.z = read;
+		if (memcmp(pFirst + 0x21, pSecond + 0x21, 2) == 0)mPos.z = (short)gpsRegister16(pFirst, 0x21);
 
 		//Ground course
-		read = (short)wiringPiI2CReadReg16LE(mFileHandle, 35);
-		if (read == (short)wiringPiI2CReadReg16LE(mFileHandle, 35))mGpsCourse = read / 10.0f;
+		if (memcmp(pFirst + 35, pSecond + 35, 2) == 0)mGpsCourse = (short)gpsRegister16(pFirst, 35) / 10.0f;
 
 		//Ground speed
-		read = (short)wiringPiI2CReadReg16LE(mFileHandle, 31);
-		if (read == (short)wiringPiI2CReadReg16LE(mFileHandle, 31))mGpsSpeed = read / 100.0f;
+		if (memcmp(pFirst + 31, pSecond + 31, 2) == 0)mGpsSpeed = (short)gpsRegister16(pFirst, 31) / 100.0f;
 
 		//新しいデータが届いたことを記録する
-		if (status & 0x01)mIsNewData = true;
+		if (status & 0x01)
+		{
+			++mNewDataCount;
+			Telemetry::writeGPS(time, lround(mPos.x * 10000000), lround(mPos.y * 10000000), mPos.z, lround(mGpsCourse * 10), lround(mGpsSpeed * 100), mSatelites);
+			gSampleBus.gps.push(time, mPos);
+		}
 	}
-	//衛星個数を更新(読み取り時のデータ乱れ防止用に2回読み取って等しい値が取れた場合のみ採用する)
-	if (wiringPiI2CReadReg8(mFileHandle, 0x00) == status)mSatelites = (unsigned char)status >> 4;
+	//衛星個数を更新
+	if (pSecond[0x00] == status)mSatelites = status >> 4;
 
 	if(mSatelites > 0)
 	{
 		//Time
-		int read = (int)wiringPiI2CReadReg32LE(mFileHandle, 39);
-		if (read == (int)wiringPiI2CReadReg32LE(mFileHandle, 39))mGpsTime = read;
-	}
-
-
-	if (mIsLogger)
-	{
-		//1秒ごとにGPS座標を表示する
-		if (Time::dt(time, mLastCheckTime) > 1)
-		{
-			mLastCheckTime = time;
-			showState();
-		}
+		if (memcmp(pFirst + 39, pSecond + 39, 4) == 0)mGpsTime = (int)gpsRegister32(pFirst, 39);
 	}
+	publish(time);
+}
+void GPSSensor::publish(const struct timespec& time)
+{
+	Snapshot snapshot;
+	snapshot.time = time;
+	snapshot.pos = mPos;
+	snapshot.satelites = mSatelites;
+	snapshot.gpsTime = mGpsTime;
+	snapshot.speed = mGpsSpeed;
+	snapshot.course = mGpsCourse;
+	snapshot.newDataCount = mNewDataCount;
+	mSnapshot.write(snapshot);
 }
 bool GPSSensor::onCommand(const std::vector<std::string>& args)
 {
@@ -291,42 +417,60 @@ gps start: GPS logger start\r\n\
 gps stop : GPS logger stop\r\n");
 	return true;
 }
+void GPSSensor::getSnapshot(Snapshot& snapshot) const
+{
+	mSnapshot.read(snapshot);
+}
 bool GPSSensor::get(VECTOR3& pos, bool disableNewFlag)
 {
-	if (mSatelites >= 4 && !(mPos.x == 0 && mPos.y == 0 && mPos.z == 0))//3D fix
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	if (snapshot.hasPosition())//3D fix
 	{
-		if (!disableNewFlag)mIsNewData = false;//データを取得したことを記録
-		pos = mPos;//引数のposに代入
+		if (!disableNewFlag)mReadDataCount = snapshot.newDataCount;//データを取得したことを記録
+		pos = snapshot.pos;//引数のposに代入
 		return true;
 	}
 	return false;//Invalid Position
 }
 bool GPSSensor::isNewPos() const
 {
-	return mIsNewData;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.newDataCount != mReadDataCount;
 }
 int GPSSensor::getTime() const
 {
-	return mGpsTime;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.gpsTime;
 }
 int GPSSensor::getSatelites() const
 {
-	return mSatelites;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.satelites;
 }
 float GPSSensor::getCourse() const
 {
-	return GyroSensor::normalize(mGpsCourse);
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return GyroSensor::normalize(snapshot.course);
 }
 float GPSSensor::getSpeed() const
 {
-	return mGpsSpeed;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.speed;
 }
 void GPSSensor::showState() const
 {
-	if (mSatelites < 4) Debug::print(LOG_SUMMARY, "Unknown Position\r\nSatelites: %d\r\n", mSatelites);
-	else Debug::print(LOG_SUMMARY, "Satelites: %d \r\nPosition: %f %f %f,\r\nTime: %d\r\nCourse: %f\r\nSpeed: %f\r\n", mSatelites, mPos.x, mPos.y, mPos.z, mGpsTime, mGpsCourse, mGpsSpeed);
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	if (snapshot.satelites < 4) Debug::print(LOG_SUMMARY, "Unknown Position\r\nSatelites: %d\r\n", snapshot.satelites);
+	else Debug::print(LOG_SUMMARY, "Satelites: %d \r\nPosition: %f %f %f,\r\nTime: %d\r\nCourse: %f\r\nSpeed: %f\r\n", snapshot.satelites, snapshot.pos.x, snapshot.pos.y, snapshot.pos.z, snapshot.gpsTime, snapshot.course, snapshot.speed);
 }
-GPSSensor::GPSSensor() : mFileHandle(-1), mPos(), mSatelites(0), mIsNewData(false)
+GPSSensor::GPSSensor() : mFileHandle(-1), mPos(), mSatelites(0), mGpsTime(0), mGpsSpeed(0), mGpsCourse(0), mNewDataCount(0), mReadDataCount(0), mSnapshot()
 {
 	setName("gps");
 	setPriority(TASK_PRIORITY_SENSOR, TASK_INTERVAL_SENSOR);
@@ -344,114 +488,204 @@ bool GyroSensor::onInit(const struct timespec& time)
 	mRVel.x = mRVel.y = mRVel.z = 0;
 	mRAngle.x = mRAngle.y = mRAngle.z = 0;
 	memset(&mLastSampleTime,0,sizeof(mLastSampleTime));
+	mLastSample = VECTOR3();
+	mIsStill = false;
+	beginWindow();
+	publish(time);
 
-	if((mFileHandle = wiringPiI2CSetup(0x6b)) == -1)
+	if((mFileHandle = Hal::i2cSetup(0x6b)) == -1)
 	{
 		Debug::print(LOG_SUMMARY,"Failed to setup Gyro Sensor\r\n");
 		return false;
 	}
 
 	//ジャイロセンサーが正常動作中か確認
-	if(wiringPiI2CReadReg8(mFileHandle,0x0F) != 0xD4)
+	if(Hal::i2cReadReg8(mFileHandle,0x0F) != 0xD4)
 	{
-		close(mFileHandle);
+		Hal::i2cClose(mFileHandle);
 		Debug::print(LOG_SUMMARY,"Failed to verify Gyro Sensor\r\n");
 		return false;
 	}
 	//データサンプリング無効化
-	wiringPiI2CWriteReg8(mFileHandle,0x20,0x00);
+	Hal::i2cWriteReg8(mFileHandle,0x20,0x00);
 
 	//ビッグエンディアンでのデータ出力に設定&スケールを2000dpsに変更
-	wiringPiI2CWriteReg8(mFileHandle,0x23,0x40 | 0x20);
+	Hal::i2cWriteReg8(mFileHandle,0x23,0x40 | 0x20);
 
 	//FIFO有効化(ストリームモード)
-	wiringPiI2CWriteReg8(mFileHandle,0x24,0x40);
-	wiringPiI2CWriteReg8(mFileHandle,0x2E,0x40);
+	Hal::i2cWriteReg8(mFileHandle,0x24,0x40);
+	Hal::i2cWriteReg8(mFileHandle,0x2E,0x40);
 
-	//データサンプリング有効化
-	wiringPiI2CWriteReg8(mFileHandle,0x20,0x0f);
+	//データサンプリング有効化(出力データレート95Hz)
+	Hal::i2cWriteReg8(mFileHandle,0x20,0x0f);
 
+	//FIFOの読み込みはI2Cバスのスレッドで行う
+	mTransfer.mFileHandle = mFileHandle;
+	mTransfer.mSamplePeriod = 1.0 / 95;
+	gI2CBus.add(&mTransfer);
 	return true;
 }
 
 void GyroSensor::onClean()
 {
+	gI2CBus.remove(&mTransfer);
+
 	//データサンプリング無効化
-	wiringPiI2CWriteReg8(mFileHandle,0x20,0x00);
+	Hal::i2cWriteReg8(mFileHandle,0x20,0x00);
 
-	close(mFileHandle);
+	Hal::i2cClose(mFileHandle);
 }
 
+bool GyroSensor::Transfer::transfer(Samples& result, const struct timespec& time)
+{
+	//FIFOに溜まっているサンプル数を確認
+	result.count = 0;
+	int fifo_src = Hal::i2cReadReg8(mFileHandle,0x2F);
+	if(fifo_src == -1)return false;
+	if(fifo_src & 0x20)return true;//FIFOが空
+	unsigned int data_samples = (fifo_src & 0x40) ? GYRO_FIFO_SIZE : (fifo_src & 0x1F);//オーバーランしていれば満杯
+	if(data_samples == 0)return true;
+
+	//FIFO内のサンプルをすべて1回の転送で読み込む(0x28|0x80でアドレスを自動で進め、OUT_Z_Hの次はOUT_X_Lに戻る)
+	unsigned char buf[GYRO_FIFO_SIZE * 6];
+	if(Hal::i2cReadBlock(mFileHandle,0x28 | 0x80,buf,data_samples * 6) != (int)(data_samples * 6))return false;
+
+	for(unsigned int i = 0;i < data_samples;++i)
+	{
+		estimateFifoSampleTime(result.times[i], time, i, data_samples, mSamplePeriod);
+
+		//ビッグエンディアン
+		const unsigned char* pData = buf + i * 6;
+		result.raw[i][0] = (short)(pData[0] << 8 | pData[1]);
+		result.raw[i][1] = (short)(pData[2] << 8 | pData[3]);
+		result.raw[i][2] = (short)(pData[4] << 8 | pData[5]);
+	}
+	result.count = data_samples;
+	return true;
+}
+void GyroSensor::Transfer::merge(Samples& pending, const Samples& result)
+{
+	//メインループが受け取るまでサンプルを追記する(溢れた分は古いものから捨てる)
+	unsigned int overflow = pending.count + result.count > SAMPLE_BUFFER_SIZE ? pending.count + result.count - SAMPLE_BUFFER_SIZE : 0;
+	if(overflow > 0)
+	{
+		pending.count -= overflow;
+		memmove(pending.times, pending.times + overflow, sizeof(pending.times[0]) * pending.count);
+		memmove(pending.raw, pending.raw + overflow, sizeof(pending.raw[0]) * pending.count);
+	}
+	memcpy(pending.times + pending.count, result.times, sizeof(result.times[0]) * result.count);
+	memcpy(pending.raw + pending.count, result.raw, sizeof(result.raw[0]) * result.count);
+	pending.count += result.count;
+}
+GyroSensor::Transfer::Transfer() : I2CTransaction<Samples>("gyro", I2C_PRIORITY_GYRO, I2C_PERIOD_GYRO), mFileHandle(-1), mSamplePeriod(1.0 / 95)
+{
+}
 void GyroSensor::onUpdate(const struct timespec& time)
 {
-	int status_reg;
-	int data_samples = 0;
-	VECTOR3 newRv;
+	//I2Cバスのスレッドが読み込んだサンプルを受け取る
+	gI2CBus.poll(&mTransfer, time);
+	Samples samples;
+	if(!mTransfer.receive(samples) || samples.count == 0)return;
 
-	//蓄えられたサンプルの平均値を現時点での速度とする
-	while((status_reg = wiringPiI2CReadReg8(mFileHandle,0x27)) & 0x08)
+	VECTOR3 newRv;
+	for(unsigned int i = 0;i < samples.count;++i)
 	{
-		if(status_reg == -1)
-		{
-			Debug::print(LOG_DETAIL,"Gyro reading error!\r\n");
-			return;
-		}
-		//if(status_reg & 0x70)Debug::print(LOG_DETAIL,"Gyro Data Overrun!\r\n");
+		const short* pRaw = samples.raw[i];
+		Telemetry::writeGyro(samples.times[i], pRaw[0], pRaw[1], pRaw[2]);
 
-		//ジャイロのFIFO内のデータをすべて読み込み、和を取る
 		VECTOR3 sample;
-		sample.x = (short)wiringPiI2CReadReg16BE(mFileHandle,0x28) * 0.070;
-		sample.y = (short)wiringPiI2CReadReg16BE(mFileHandle,0x2A) * 0.070;
-		sample.z = (short)wiringPiI2CReadReg16BE(mFileHandle,0x2C) * 0.070;
-		newRv += sample;
+		sample.x = pRaw[0] * 0.070;
+		sample.y = pRaw[1] * 0.070;
+		sample.z = pRaw[2] * 0.070;
+		addSample(sample, samples.times[i]);
+		newRv += mLastSample;
+		gSampleBus.gyro.push(samples.times[i], mLastSample);
+	}
 
-		//ドリフト誤差計算中であれば配列にデータを突っ込む
-		if(mIsCalculatingOffset)
-		{
-			mRVelHistory.push_back(sample);
-			if(mRVelHistory.size() >= GYRO_SAMPLE_COUNT_FOR_CALCULATE_OFFSET)//必要なサンプル数がそろった
-			{
-				//平均値を取ってみる
-				std::list<VECTOR3>::iterator it = mRVelHistory.begin();
-				while(it != mRVelHistory.end())
-				{
-					mRVelOffset += *it;
-					++it;
-				}
-				mRVelOffset /= mRVelHistory.size();//ドリフト誤差補正量を適用
-				mRVelHistory.clear();
-				mIsCalculatingOffset = false;
-				Debug::print(LOG_SUMMARY, "Gyro: offset is (%f %f %f)\r\n",mRVelOffset.x,mRVelOffset.y,mRVelOffset.z);
-			}
-		}
+	//読み込んだサンプルの平均値を現時点での角速度とする
+	mRVel = newRv / samples.count;
+	publish(time);
+}
+void GyroSensor::publish(const struct timespec& time)
+{
+	Snapshot snapshot;
+	snapshot.time = time;
+	snapshot.rvel = mRVel;
+	snapshot.rangle = mRAngle;
+	mSnapshot.write(snapshot);
+}
+void GyroSensor::addSample(const VECTOR3& sample, const struct timespec& time)
+{
+	updateOffset(sample);
 
-		//ドリフト誤差を補正
-		newRv -= mRVelOffset;
+	//ドリフト誤差を補正
+	VECTOR3 rv = sample - mRVelOffset;
 
-		++data_samples;
-	}
+	//ドリフト誤差修正 2015/08/30
+	rv.x = abs(rv.x) < mCutOffThreshold ? 0 : rv.x;
+	rv.y = abs(rv.y) < mCutOffThreshold ? 0 : rv.y;
+	rv.z = abs(rv.z) < mCutOffThreshold ? 0 : rv.z;
 
-	//データが来ていたら現在の角速度と角度を更新
-	if(data_samples != 0)
+	//サンプルごとに台形積分
+	if(mLastSampleTime.tv_sec != 0 || mLastSampleTime.tv_nsec != 0)
 	{
-		//平均
-		newRv /= data_samples;
-
-		//ドリフト誤差修正 2015/08/30
-		newRv.x = abs(newRv.x) < mCutOffThreshold ? 0 : newRv.x;
-		newRv.y = abs(newRv.y) < mCutOffThreshold ? 0 : newRv.y;
-		newRv.z = abs(newRv.z) < mCutOffThreshold ? 0 : newRv.z;
-
-		//積分
-		if(mLastSampleTime.tv_sec != 0 || mLastSampleTime.tv_nsec != 0 )
+		double dt = Time::dt(time,mLastSampleTime);
+		if(dt > 0)
 		{
-			double dt = Time::dt(time,mLastSampleTime);
-			mRAngle += (newRv + mRVel) / 2 * dt;
+			mRAngle += (rv + mLastSample) / 2 * dt;
 			normalize(mRAngle);
 		}
-		mRVel = newRv;
-		mLastSampleTime = time;
 	}
+	mLastSample = rv;
+	mLastSampleTime = time;
+}
+void GyroSensor::beginWindow()
+{
+	mWindowStatistics.reset();
+	mWindowEncoderL = gMotorDrive.getL();
+	mWindowEncoderR = gMotorDrive.getR();
+	mIsWindowAccelStill = true;
+}
+void GyroSensor::updateOffset(const VECTOR3& sample)
+{
+	mWindowStatistics.add(sample);
+
+	//加速度の大きさが1Gから離れていれば動いている
+	if(gAccelerationSensor.isActive())
+	{
+		AccelerationSensor::Snapshot accel;
+		gAccelerationSensor.getSnapshot(accel);
+		double magnitude = sqrt(pow(accel.accel.x, 2) + pow(accel.accel.y, 2) + pow(accel.accel.z, 2));
+		if(fabs(magnitude - 1) > GYRO_STILL_ACCEL_TOLERANCE)mIsWindowAccelStill = false;
+	}
+	if(mWindowStatistics.getCount() < GYRO_STILL_WINDOW)return;
+
+	//角速度のばらつきが小さく、加速度が1G付近で、エンコーダが動いていなければ静止中
+	VECTOR3 variance = mWindowStatistics.getVariance();
+	bool isStill = variance.x < GYRO_STILL_VARIANCE && variance.y < GYRO_STILL_VARIANCE && variance.z < GYRO_STILL_VARIANCE && mIsWindowAccelStill;
+	if(gMotorDrive.isActive() && (gMotorDrive.getL() != mWindowEncoderL || gMotorDrive.getR() != mWindowEncoderR))isStill = false;
+
+	//ばらつきが小さくても、平均がドリフト誤差の推定値から離れていれば一定の角速度で回転している(パラシュートでの回転など)
+	const VECTOR3& mean = mWindowStatistics.getMean();
+	VECTOR3 reference = mBiasStatistics.getCount() > 0 || mIsOffsetFixed ? mRVelOffset : VECTOR3();
+	double tolerance = mBiasStatistics.getCount() > 0 || mIsOffsetFixed ? GYRO_BIAS_TOLERANCE : GYRO_BIAS_MAX;
+	if(fabs(mean.x - reference.x) > tolerance || fabs(mean.y - reference.y) > tolerance || fabs(mean.z - reference.z) > tolerance)isStill = false;
+	if(isStill != mIsStill)Debug::print(LOG_DETAIL, "Gyro: %s\r\n", isStill ? "still" : "moving");
+	mIsStill = isStill;
+
+	if((isStill && !mIsOffsetFixed) || mIsCalculatingOffset)
+	{
+		//静止していた区間の平均をドリフト誤差の推定値に加える
+		mBiasStatistics.merge(mWindowStatistics);
+		mBiasStatistics.limit(GYRO_BIAS_SAMPLE_LIMIT);
+		mRVelOffset = mBiasStatistics.getMean();
+		if(mIsCalculatingOffset)
+		{
+			mIsCalculatingOffset = false;
+			Debug::print(LOG_SUMMARY, "Gyro: offset is (%f %f %f)\r\n",mRVelOffset.x,mRVelOffset.y,mRVelOffset.z);
+		}
+	}
+	beginWindow();
 }
 bool GyroSensor::onCommand(const std::vector<std::string>& args)
 {
@@ -486,66 +720,101 @@ bool GyroSensor::onCommand(const std::vector<std::string>& args)
 			mRVelOffset.x = atof(args[2].c_str());
 			mRVelOffset.y = atof(args[3].c_str());
 			mRVelOffset.z = atof(args[4].c_str());
-			Debug::print(LOG_SUMMARY, "Gyro: offset is (%f %f %f)\r\n",mRVelOffset.x,mRVelOffset.y,mRVelOffset.z);
+			mBiasStatistics.reset();
+			mIsOffsetFixed = true;
+			Debug::print(LOG_SUMMARY, "Gyro: offset is fixed to (%f %f %f)\r\n",mRVelOffset.x,mRVelOffset.y,mRVelOffset.z);
 			return true;
 		}
 		return false;
 	}
-	Debug::print(LOG_SUMMARY, "Angle: %f %f %f\r\nAngle Velocity: %f %f %f\r\n\
-gyro reset  : set angle to zero point\r\n\
-gyro calib  : calibrate gyro *do NOT move*\r\n\
-gyro calib [x_offset] [y_offset] [z_offset] : calibrate gyro by specified params\r\n",getRx(),getRy(),getRz(),getRvx(),getRvy(),getRvz());
+	Debug::print(LOG_SUMMARY, "Angle: %f %f %f\r\nAngle Velocity: %f %f %f\r\n",getRx(),getRy(),getRz(),getRvx(),getRvy(),getRvz());
+	Debug::print(LOG_SUMMARY, "Offset: %f %f %f (%s, %s, %u samples)\r\n",mRVelOffset.x,mRVelOffset.y,mRVelOffset.z,mIsOffsetFixed ? "fixed" : "auto",mIsStill ? "still" : "moving",mBiasStatistics.getCount());
+	Debug::print(LOG_PRINT, "gyro reset  : set angle to zero point\r\n\
+gyro calib  : calibrate gyro *do NOT move* (offset is also updated automatically while still)\r\n\
+gyro calib [x_offset] [y_offset] [z_offset] : fix offset to specified params (until gyro calib)\r\n");
 	return true;
 }
+void GyroSensor::getSnapshot(Snapshot& snapshot) const
+{
+	mSnapshot.read(snapshot);
+}
 bool GyroSensor::getRVel(VECTOR3& vel)
 {
 	if(isActive())
 	{
-		vel = mRVel;
+		Snapshot snapshot;
+		mSnapshot.read(snapshot);
+		vel = snapshot.rvel;
 		return true;
 	}
 	return false;
 }
 double GyroSensor::getRvx()
 {
-	return mRVel.x;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.rvel.x;
 }
 double GyroSensor::getRvy()
 {
-	return mRVel.y;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.rvel.y;
 }
 double GyroSensor::getRvz()
 {
-	return mRVel.z;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.rvel.z;
 }
 void GyroSensor::setZero()
 {
 	mRAngle.x = mRAngle.y = mRAngle.z = 0;
+
+	struct timespec time;
+	Time::get(time);
+	publish(time);
 }
 bool GyroSensor::getRPos(VECTOR3& pos)
 {
 	if(isActive())
 	{
-		pos = mRAngle;
+		Snapshot snapshot;
+		mSnapshot.read(snapshot);
+		pos = snapshot.rangle;
 		return true;
 	}
 	return false;
 }
 double GyroSensor::getRx()
 {
-	return mRAngle.x;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.rangle.x;
 }
 double GyroSensor::getRy()
 {
-	return mRAngle.y;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.rangle.y;
 }
 double GyroSensor::getRz()
 {
-	return mRAngle.z;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.rangle.z;
 }
 void GyroSensor::calibrate()
 {
+	//次の区間だけでドリフト誤差を求め直す
+	mBiasStatistics.reset();
+	beginWindow();
 	mIsCalculatingOffset = true;
+	mIsOffsetFixed = false;
+}
+bool GyroSensor::isStill() const
+{
+	return mIsStill;
 }
 double GyroSensor::normalize(double pos)
 {
@@ -558,10 +827,11 @@ void GyroSensor::normalize(VECTOR3& pos)
 	pos.y = normalize(pos.y);
 	pos.z = normalize(pos.z);
 }
-GyroSensor::GyroSensor() : mFileHandle(-1),mRVel(),mRAngle(),mRVelHistory(),mRVelOffset(), mCutOffThreshold(0.1),mIsCalculatingOffset(false)
+GyroSensor::GyroSensor() : mFileHandle(-1),mRVel(),mRAngle(),mLastSample(),mRVelOffset(), mCutOffThreshold(0.1),mIsCalculatingOffset(false),mIsOffsetFixed(false),mWindowStatistics(),mBiasStatistics(),mWindowEncoderL(0),mWindowEncoderR(0),mIsWindowAccelStill(true),mIsStill(false),mSnapshot()
 {
 	setName("gyro");
 	setPriority(TASK_PRIORITY_SENSOR,TASK_INTERVAL_GYRO);
+	setPeriod(TASK_PERIOD_GYRO,TASK_DEADLINE_GYRO);
 }
 GyroSensor::~GyroSensor()
 {
@@ -573,26 +843,62 @@ GyroSensor::~GyroSensor()
 //
 bool AccelerationSensor::onInit(const struct timespec& time)
 {
-	mAccel.x = mAccel.y = mAccel.z = 0;
+	Snapshot snapshot;
+	snapshot.time = time;
+	snapshot.accel = VECTOR3();
+	mSnapshot.write(snapshot);
 
-	if((mFileHandle = wiringPiI2CSetup(0x1d)) == -1)
+	if((mFileHandle = Hal::i2cSetup(0x1d)) == -1)
 	{
 		Debug::print(LOG_SUMMARY,"Failed to setup Acceleration Sensor\r\n");
 		return false;
 	}
 
-	//データサンプリング有効化
-	wiringPiI2CWriteReg8(mFileHandle,0x16,0x09); // 64 LSB/g
-	wiringPiI2CWriteReg8(mFileHandle,0x18,0x38);
+	mTransfer.mFileHandle = mFileHandle;
+	if(Hal::i2cReadReg8(mFileHandle,0x0D) == 0x1A)//WHO_AM_I
+	{
+		//MMA8451Q: 設定はスタンバイ中に行う
+		Hal::i2cWriteReg8(mFileHandle,0x2A,0x00);
+
+		//±8G(14bitで1024LSB/G)
+		Hal::i2cWriteReg8(mFileHandle,0x0E,0x02);
+
+		//FIFO有効化(満杯になったら古いサンプルから上書き)
+		Hal::i2cWriteReg8(mFileHandle,0x09,0x40);
+
+		//出力データレートを選んでデータサンプリング有効化
+		const static double ODR[8] = {800, 400, 200, 100, 50, 12.5, 6.25, 1.56};
+		int dr = 0;
+		while(dr < 7 && ODR[dr + 1] >= ACCEL_DATA_RATE)++dr;
+		Hal::i2cWriteReg8(mFileHandle,0x2A,dr << 3 | 0x01);
+
+		mTransfer.mIsFifo = true;
+		mTransfer.mSamplePeriod = 1.0 / ODR[dr];
+		Debug::print(LOG_SUMMARY,"Acceleration Sensor: MMA8451Q FIFO (%.2f Hz)\r\n",ODR[dr]);
+	}else
+	{
+		//FIFOの無い旧センサ: データサンプリング有効化
+		Hal::i2cWriteReg8(mFileHandle,0x16,0x09); // 64 LSB/g
+		Hal::i2cWriteReg8(mFileHandle,0x18,0x38);
+
+		mTransfer.mIsFifo = false;
+		Debug::print(LOG_SUMMARY,"Acceleration Sensor: legacy mode (no FIFO)\r\n");
+	}
+
+	//加速度の読み込みはI2Cバスのスレッドで行う
+	gI2CBus.add(&mTransfer);
 	return true;
 }
 
 void AccelerationSensor::onClean()
 {
+	gI2CBus.remove(&mTransfer);
+
 	//データサンプリング無効化
-	wiringPiI2CWriteReg8(mFileHandle,0x16,0x00);
+	if(mTransfer.mIsFifo)Hal::i2cWriteReg8(mFileHandle,0x2A,0x00);
+	else Hal::i2cWriteReg8(mFileHandle,0x16,0x00);
 
-	close(mFileHandle);
+	Hal::i2cClose(mFileHandle);
 }
 
 short ushortTo10BitShort(unsigned short val)
@@ -600,6 +906,59 @@ short ushortTo10BitShort(unsigned short val)
   if(val & 0x200)val |= 0xfc00;
   return (short)val;
 }
+bool AccelerationSensor::Transfer::transfer(Samples& result, const struct timespec& time)
+{
+	result.count = 0;
+	if(!mIsFifo)
+	{
+		//旧センサ: X,Y,Zの出力レジスタ(0x00〜0x05)を1回の転送で読み込む(10bit、64LSB/G)
+		unsigned char buf[6];
+		if(Hal::i2cReadBlock(mFileHandle, 0x00, buf, sizeof(buf)) != (int)sizeof(buf))return false;
+		result.times[0] = time;
+		for(int i = 0;i < 3;++i)result.raw[0][i] = ushortTo10BitShort((unsigned short)(buf[i * 2] | buf[i * 2 + 1] << 8)) * 16;
+		result.count = 1;
+		return true;
+	}
+
+	//FIFOに溜まっているサンプル数を確認(F_STATUSのF_CNT)
+	int f_status = Hal::i2cReadReg8(mFileHandle,0x00);
+	if(f_status == -1)return false;
+	unsigned int data_samples = f_status & 0x3F;
+	if(data_samples > ACCEL_FIFO_SIZE)data_samples = ACCEL_FIFO_SIZE;
+	if(data_samples == 0)return true;
+
+	//FIFO内のサンプルをすべて1回の転送で読み込む(FIFO有効時はOUT_Z_LSBの次はOUT_X_MSBに戻る)
+	unsigned char buf[ACCEL_FIFO_SIZE * 6];
+	if(Hal::i2cReadBlock(mFileHandle,0x01,buf,data_samples * 6) != (int)(data_samples * 6))return false;
+
+	for(unsigned int i = 0;i < data_samples;++i)
+	{
+		estimateFifoSampleTime(result.times[i], time, i, data_samples, mSamplePeriod);
+
+		//ビッグエンディアン、14bit左詰め
+		const unsigned char* pData = buf + i * 6;
+		for(int j = 0;j < 3;++j)result.raw[i][j] = (short)(pData[j * 2] << 8 | pData[j * 2 + 1]) >> 2;
+	}
+	result.count = data_samples;
+	return true;
+}
+void AccelerationSensor::Transfer::merge(Samples& pending, const Samples& result)
+{
+	//メインループが受け取るまでサンプルを追記する(溢れた分は古いものから捨てる)
+	unsigned int overflow = pending.count + result.count > SAMPLE_BUFFER_SIZE ? pending.count + result.count - SAMPLE_BUFFER_SIZE : 0;
+	if(overflow > 0)
+	{
+		pending.count -= overflow;
+		memmove(pending.times, pending.times + overflow, sizeof(pending.times[0]) * pending.count);
+		memmove(pending.raw, pending.raw + overflow, sizeof(pending.raw[0]) * pending.count);
+	}
+	memcpy(pending.times + pending.count, result.times, sizeof(result.times[0]) * result.count);
+	memcpy(pending.raw + pending.count, result.raw, sizeof(result.raw[0]) * result.count);
+	pending.count += result.count;
+}
+AccelerationSensor::Transfer::Transfer() : I2CTransaction<Samples>("accel", I2C_PRIORITY_ACCEL, I2C_PERIOD_ACCEL), mFileHandle(-1), mIsFifo(false), mSamplePeriod(1.0 / ACCEL_DATA_RATE)
+{
+}
 void AccelerationSensor::onUpdate(const struct timespec& time)
 {
   //union i2c_smbus_data data;
@@ -607,13 +966,26 @@ void AccelerationSensor::onUpdate(const struct timespec& time)
 	//mAccel.x = ((signed char)data.block[1]);
 	//mAccel.y = ((signed char)data.block[2]);
 	//mAccel.z = ((signed char)data.block[3]);
-  short x = ushortTo10BitShort(wiringPiI2CReadReg16LE(mFileHandle, 0x00));
-  short y = ushortTo10BitShort(wiringPiI2CReadReg16LE(mFileHandle, 0x02));
-  short z = ushortTo10BitShort(wiringPiI2CReadReg16LE(mFileHandle, 0x04));
-
-  mAccel.x = x / 64.0f;
-  mAccel.y = y / 64.0f;
-  mAccel.z = z / 64.0f;
+  //I2Cバスのスレッドが読み込んだサンプルを受け取る
+  gI2CBus.poll(&mTransfer, time);
+  Samples samples;
+  if(!mTransfer.receive(samples) || samples.count == 0)return;
+
+  VECTOR3 accel;
+  for(unsigned int i = 0;i < samples.count;++i)
+  {
+    const short* pRaw = samples.raw[i];
+    Telemetry::writeAccel(samples.times[i], pRaw[0], pRaw[1], pRaw[2]);
+
+    accel = VECTOR3(pRaw[0] / 1024.0, pRaw[1] / 1024.0, pRaw[2] / 1024.0);
+    gSampleBus.accel.push(samples.times[i], accel);
+  }
+
+  //最後のサンプルを現時点での加速度とする
+  Snapshot snapshot;
+  snapshot.time = time;
+  snapshot.accel = accel;
+  mSnapshot.write(snapshot);
 }
 bool AccelerationSensor::onCommand(const std::vector<std::string>& args)
 {
@@ -626,40 +998,61 @@ bool AccelerationSensor::onCommand(const std::vector<std::string>& args)
 	Debug::print(LOG_SUMMARY, "Accel. angle: %f %f %f\r\n",getTheta() / M_PI * 180,getPsi() / M_PI * 180,getPhi() / M_PI * 180);
 	return true;
 }
+void AccelerationSensor::getSnapshot(Snapshot& snapshot) const
+{
+	mSnapshot.read(snapshot);
+}
 bool AccelerationSensor::getAccel(VECTOR3& acc)
 {
 	if(isActive())
 	{
-		acc = mAccel;
+		Snapshot snapshot;
+		mSnapshot.read(snapshot);
+		acc = snapshot.accel;
 		return true;
 	}
 	return false;
 }
 double AccelerationSensor::getAx()
 {
-	return mAccel.x;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.accel.x;
 }
 double AccelerationSensor::getAy()
 {
-	return mAccel.y;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.accel.y;
 }
 double AccelerationSensor::getAz()
 {
-	return mAccel.z;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	return snapshot.accel.z;
 }
 double AccelerationSensor::getTheta()
 {
-    return atan2f(mAccel.x, sqrt(pow(mAccel.y, 2) + pow(mAccel.z, 2)));
+    Snapshot snapshot;
+    mSnapshot.read(snapshot);
+    const VECTOR3& a = snapshot.accel;
+    return atan2f(a.x, sqrt(pow(a.y, 2) + pow(a.z, 2)));
 }
 double AccelerationSensor::getPsi()
 {
-    return atan2f(mAccel.y, sqrt(pow(mAccel.x, 2) + pow(mAccel.z, 2)));
+    Snapshot snapshot;
+    mSnapshot.read(snapshot);
+    const VECTOR3& a = snapshot.accel;
+    return atan2f(a.y, sqrt(pow(a.x, 2) + pow(a.z, 2)));
 }
 double AccelerationSensor::getPhi()
 {
-    return atan2f(sqrt(pow(mAccel.x, 2) + pow(mAccel.y, 2)), mAccel.z);
+    Snapshot snapshot;
+    mSnapshot.read(snapshot);
+    const VECTOR3& a = snapshot.accel;
+    return atan2f(sqrt(pow(a.x, 2) + pow(a.y, 2)), a.z);
 }
-AccelerationSensor::AccelerationSensor() : mFileHandle(-1),mAccel()
+AccelerationSensor::AccelerationSensor() : mFileHandle(-1),mSnapshot()
 {
 	setName("accel");
 	setPriority(TASK_PRIORITY_SENSOR,TASK_INTERVAL_SENSOR);
@@ -671,13 +1064,39 @@ AccelerationSensor::~AccelerationSensor()
 ///////////////////////////////////////////////
 // CdS Sensor
 ///////////////////////////////////////////////
+void LightSensor::edgeCallback()
+{
+	__sync_fetch_and_add(&gLightSensor.mEdgeCount, 1);
+}
 bool LightSensor::onInit(const struct timespec& time)
 {
-	pinMode(mPin, INPUT);
+	Hal::pinMode(mPin, INPUT);
+
+	mEdgeCount = mLastEdgeCount = 0;
+	mLastState = get();
+	mLastChangeTime = time;
+	if(Hal::setISR(mPin, INT_EDGE_BOTH, edgeCallback) == -1)
+	{
+		//割り込みが使えない場合はonUpdateの周期で変化を検出する
+		Debug::print(LOG_SUMMARY, "LightSensor: Unable to setup ISR\r\n");
+	}
 	return true;
 }
 void LightSensor::onClean()
 {
+	Hal::clearISR(mPin);
+}
+void LightSensor::onUpdate(const struct timespec& time)
+{
+	//前回から割り込みがあったか、明るさが変わっていれば変化した時刻を更新する
+	unsigned int edgeCount = mEdgeCount;
+	bool state = get();
+	if(edgeCount != mLastEdgeCount || state != mLastState)
+	{
+		mLastEdgeCount = edgeCount;
+		mLastState = state;
+		mLastChangeTime = time;
+	}
 }
 bool LightSensor::onCommand(const std::vector<std::string>& args)
 {
@@ -688,12 +1107,18 @@ bool LightSensor::onCommand(const std::vector<std::string>& args)
 }
 bool LightSensor::get()
 {
-	return digitalRead(mPin) == 0;
+	return Hal::digitalRead(mPin) == 0;
+}
+bool LightSensor::getStable(const struct timespec& time, unsigned int duration, bool& state)
+{
+	state = mLastState;
+	if(!isActive() || mEdgeCount != mLastEdgeCount)return false;//まだonUpdateで検出していない変化がある
+	return Time::dt(time, mLastChangeTime) * 1000 >= duration;
 }
-LightSensor::LightSensor() : mPin(PIN_LIGHT_SENSOR)
+LightSensor::LightSensor() : mPin(PIN_LIGHT_SENSOR), mEdgeCount(0), mLastEdgeCount(0), mLastState(false), mLastChangeTime()
 {
 	setName("light");
-	setPriority(TASK_PRIORITY_SENSOR,UINT_MAX);
+	setPriority(TASK_PRIORITY_SENSOR,TASK_INTERVAL_SENSOR);
 }
 LightSensor::~LightSensor()
 {
@@ -723,43 +1148,48 @@ bool WebCamera::onCommand(const std::vector<std::string>& args)
 		}
 	}else
 	{
+		mRecorder.showState();
 		Debug::print(LOG_PRINT, "capture start [filename] : save movie to filename\r\n\
 capture stop             : stop capturing movie\r\n");
 		return true;
 	}
 	return false;
 }
+void WebCamera::onUpdate(const struct timespec& time)
+{
+	if(!mRecorder.isRecording())return;
+
+	//新しいフレームが取り込まれていれば記録する(変換済みの画像は画像処理と共有する)
+	const CameraCapture::Frame* pFrame = gCameraCapture.getLatestFrame();
+	if(pFrame == NULL || pFrame->sequence == mLastSequence)return;
+	mLastSequence = pFrame->sequence;
+	SharedImage* pImage = gCameraCapture.getSharedFrame(*pFrame);
+	if(pImage != NULL)mRecorder.push(pImage, pFrame->time);
+}
 void WebCamera::onClean()
 {
 	stop();
 }
 void WebCamera::start(const char* filename)
 {
-	time_t timer = time(NULL);
-	std::stringstream ss;
 	std::string name;
-	if(filename == NULL)
-	{
-		name = ctime(&timer) + std::string(".avi");
-	}else
-	{
-		name = filename;
-	}
+	if(filename == NULL)mFilename.get(name);
+	else name = filename;
 
-	ss << "mencoder tv:// -tv width=320:height=240:device=/dev/video0 -nosound -ovc lavc -o \"" << name << "\" 1> /dev/null 2>&1 &";
-	system(ss.str().c_str());
+	//フレームはカメラのタスクから受け取る
+	gCameraCapture.setRunMode(true);
+	mLastSequence = 0;
+	if(!mRecorder.start(name))Debug::print(LOG_SUMMARY, "Failed to start capturing\r\n");
 }
 void WebCamera::stop()
 {
-	//Todo: 末尾が5秒くらい保存されない問題
-	system("killall -15 mencoder 1> /dev/null 2>&1 ");
-	Debug::print(LOG_DETAIL, "Send kill signal to mencoder\r\n");
+	mRecorder.stop();
 }
 
-WebCamera::WebCamera()
+WebCamera::WebCamera() : mFilename("video",".avi"), mLastSequence(0)
 {
 	setName("capture");
-	setPriority(UINT_MAX,UINT_MAX);
+	setPriority(TASK_PRIORITY_SENSOR,TASK_INTERVAL_SENSOR);
 }
 WebCamera::~WebCamera()
 {
@@ -768,62 +1198,97 @@ WebCamera::~WebCamera()
 void* DistanceSensor::waitingThread(void* arg)
 {
 	DistanceSensor& parent = *reinterpret_cast<DistanceSensor*>(arg);
-	struct timespec newTime;
+	Snapshot snapshot;
+	parent.mSnapshot.read(snapshot);
 
+	pthread_mutex_lock(&parent.mMutex);
 	while(1)
 	{
-		while(!parent.mIsCalculating)usleep(1000);
+		//pingが呼ばれるまでスリープする
+		while(parent.mIsRunning && !parent.mIsCalculating)pthread_cond_wait(&parent.mCond, &parent.mMutex);
+		if(!parent.mIsRunning)break;
+		pthread_mutex_unlock(&parent.mMutex);
 
-		//Send Ping
-		pinMode(PIN_DISTANCE, OUTPUT);
-		digitalWrite(PIN_DISTANCE, HIGH);
-		clock_gettime(CLOCK_MONOTONIC_RAW,&parent.mLastSampleTime);
-		do
-		{
-			clock_gettime(CLOCK_MONOTONIC_RAW,&newTime);
-		}while(Time::dt(newTime,parent.mLastSampleTime) < 0.000001);
-		digitalWrite(PIN_DISTANCE, LOW);
+		double delay = parent.measure();
+		snapshot.distance = delay < 0 ? -1 : delay * 100 * 3 / 2;
 
-		//Wait For Result
-		pinMode(PIN_DISTANCE, INPUT);
-		do
-		{
-			clock_gettime(CLOCK_MONOTONIC_RAW,&newTime);
-			if(Time::dt(newTime,parent.mLastSampleTime) > 0.001)
-			{
-				//Timeout
-				parent.mIsCalculating = false;
-				parent.mLastDistance = -1;
-				break;
-			}
-		}while(digitalRead(PIN_DISTANCE) == LOW);
-		parent.mLastSampleTime = newTime;
-		do
-		{
-			clock_gettime(CLOCK_MONOTONIC_RAW,&newTime);
-			if(Time::dt(newTime,parent.mLastSampleTime) > 0.02)
-			{
-				//Timeout
-				parent.mIsCalculating = false;
-				parent.mLastDistance = -1;
-				break;
-			}
-		}while(digitalRead(PIN_DISTANCE) == HIGH);
-		clock_gettime(CLOCK_MONOTONIC_RAW,&newTime);
+		//計測結果を公開する
+		clock_gettime(CLOCK_MONOTONIC_RAW, &snapshot.time);
+		++snapshot.sequence;
+		parent.mSnapshot.write(snapshot);
 
-		double delay = Time::dt(newTime,parent.mLastSampleTime);
-		parent.mLastDistance = delay * 100 * 3 / 2;
-		if(delay > 0.019)parent.mLastDistance = -1;
-		parent.mIsNewData = true;
+		pthread_mutex_lock(&parent.mMutex);
 		parent.mIsCalculating = false;
 	}
+	pthread_mutex_unlock(&parent.mMutex);
 	return NULL;
 }
+double DistanceSensor::measure()
+{
+	//前回の計測で残ったエッジを捨てる
+	int value;
+	struct timespec edgeTime, riseTime, startTime, newTime;
+	while(Hal::edgeWait(mEdgeHandle, 0, value, edgeTime) == 1);
+
+	//Send Ping
+	Hal::pinMode(PIN_DISTANCE, OUTPUT);
+	Hal::digitalWrite(PIN_DISTANCE, HIGH);
+	clock_gettime(CLOCK_MONOTONIC_RAW,&startTime);
+	do
+	{
+		clock_gettime(CLOCK_MONOTONIC_RAW,&newTime);
+	}while(Time::dt(newTime,startTime) < 0.000001);
+	Hal::digitalWrite(PIN_DISTANCE, LOW);
+	Hal::pinMode(PIN_DISTANCE, INPUT);
+
+	//Wait For Result
+	//エコーの立ち上がりと立ち下がりのエッジを待ち、カーネルが記録した時刻の差をエコーの長さとする
+	//(トリガーパルス自身のエッジも検出されるが、エコーより十分短いので無視する)
+	bool isHigh = false;
+	while(1)
+	{
+		clock_gettime(CLOCK_MONOTONIC_RAW,&newTime);
+		int timeout = DISTANCE_ECHO_TIMEOUT - (int)(Time::dt(newTime,startTime) * 1000);
+		if(timeout <= 0)return -1;//Timeout
+
+		int result = Hal::edgeWait(mEdgeHandle, timeout, value, edgeTime);
+		if(result < 0)return -1;
+		if(result == 0)continue;
+
+		if(value == HIGH)
+		{
+			riseTime = edgeTime;
+			isHigh = true;
+		}else if(isHigh)
+		{
+			isHigh = false;
+			double delay = Time::dt(edgeTime,riseTime);
+			if(delay < DISTANCE_MIN_ECHO_WIDTH)continue;//トリガーパルス
+			if(delay > DISTANCE_MAX_ECHO_WIDTH)return -1;
+			return delay;
+		}
+	}
+}
 bool DistanceSensor::onInit(const struct timespec& time)
 {
-	mLastDistance = -1;
+	Snapshot snapshot;
+	snapshot.time = time;
+	snapshot.distance = -1;
+	snapshot.sequence = 0;
+	mSnapshot.write(snapshot);
+	mReadSequence = 0;
+
+	if((mEdgeHandle = Hal::edgeOpen(PIN_DISTANCE, INT_EDGE_BOTH)) == -1)
+	{
+		Debug::print(LOG_SUMMARY, "DistanceSensor: Unable to open edge detection!\r\n");
+		return false;
+	}
+	mIsRunning = true;
+	mIsCalculating = false;
 	if(pthread_create(&mPthread, NULL, waitingThread, this) != 0)
 	{
+		mIsRunning = false;
+		Hal::edgeClose(mEdgeHandle);
 		Debug::print(LOG_SUMMARY, "DistanceSensor: Unable to create thread!\r\n");
 		return false;
 	}
@@ -831,10 +1296,22 @@ bool DistanceSensor::onInit(const struct timespec& time)
 }
 void DistanceSensor::onClean()
 {
-	if(mIsCalculating)pthread_cancel(mPthread);
-	mLastDistance = -1;
+	//計測スレッドを終了させる(計測中でもタイムアウトまでには終わる)
+	pthread_mutex_lock(&mMutex);
+	mIsRunning = false;
+	pthread_cond_broadcast(&mCond);
+	pthread_mutex_unlock(&mMutex);
+	pthread_join(mPthread, NULL);
+	Hal::edgeClose(mEdgeHandle);
 	mIsCalculating = false;
-	mIsNewData = false;
+
+	//計測スレッドは終了しているため、ここで書き込んでも競合しない
+	Snapshot snapshot;
+	Time::get(snapshot.time);
+	snapshot.distance = -1;
+	snapshot.sequence = 0;
+	mSnapshot.write(snapshot);
+	mReadSequence = 0;
 }
 
 void DistanceSensor::onUpdate(const struct timespec& time)
@@ -846,8 +1323,10 @@ bool DistanceSensor::onCommand(const std::vector<std::string>& args)
 	if(!isActive())return false;
 	if(args.size() == 1)
 	{
-		Debug::print(LOG_SUMMARY, "Last Distance: %f m\r\n",mLastDistance);
-		if(ping())Debug::print(LOG_SUMMARY, "Calculating New Distance!\n",mLastDistance);
+		Snapshot snapshot;
+		mSnapshot.read(snapshot);
+		Debug::print(LOG_SUMMARY, "Last Distance: %f m\r\n",snapshot.distance);
+		if(ping())Debug::print(LOG_SUMMARY, "Calculating New Distance!\n");
 		return true;
 	}
 	return false;
@@ -855,66 +1334,198 @@ bool DistanceSensor::onCommand(const std::vector<std::string>& args)
 
 bool DistanceSensor::ping()
 {
-	if(mIsCalculating)return false;//すでに計測を開始している
-	mIsCalculating = true;
-	return true;
+	pthread_mutex_lock(&mMutex);
+	bool ret = mIsRunning && !mIsCalculating;//すでに計測を開始していればfalse
+	if(ret)
+	{
+		//計測スレッドを起こす
+		mIsCalculating = true;
+		pthread_cond_signal(&mCond);
+	}
+	pthread_mutex_unlock(&mMutex);
+	return ret;
+}
+void DistanceSensor::getSnapshot(Snapshot& snapshot) const
+{
+	mSnapshot.read(snapshot);
 }
 bool DistanceSensor::getDistance(double& distance)
 {
-	bool ret = mIsNewData;
-	mIsNewData = false;
-	distance = mLastDistance;
+	Snapshot snapshot;
+	mSnapshot.read(snapshot);
+	bool ret = snapshot.sequence != mReadSequence;
+	mReadSequence = snapshot.sequence;
+	distance = snapshot.distance;
 	return ret;
 }
 
-DistanceSensor::DistanceSensor() : mLastDistance(-1), mIsCalculating(false), mIsNewData(false)
+DistanceSensor::DistanceSensor() : mIsRunning(false), mIsCalculating(false), mEdgeHandle(-1), mReadSequence(0), mSnapshot()
 {
 	setName("distance");
 	setPriority(TASK_PRIORITY_SENSOR,TASK_INTERVAL_SENSOR);
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mCond, NULL);
 }
 DistanceSensor::~DistanceSensor()
 {
+	pthread_cond_destroy(&mCond);
+	pthread_mutex_destroy(&mMutex);
 }
 
 //////////////////////////////////////////////
 // Web Camera
 //////////////////////////////////////////////
 
+//カメラのデバイス番号(/dev/video*)を探す(見つからなければ-1)
+static int findVideoDevice()
+{
+	struct stat st;
+	for(int i = 0;i < 32;++i)
+	{
+		std::stringstream filename;
+		filename << "/dev/video" << i;
+		if(stat(filename.str().c_str(), &st) == 0)return i;
+	}
+	return -1;
+}
 bool CameraCapture::onInit(const struct timespec& time)
 {
-	const static int WIDTH = 320,HEIGHT = 240;
-
-	mpCapture = cvCreateCameraCapture(-1);
-	if(mpCapture == NULL)
+	//再生中はカメラを開かず、記録された画像を使う
+	if(!Recorder::isReplaying())
+	{
+		//カメラが無ければ代わりのファイルを使う
+		std::string path = CAMERA_FILE_DEVICE;
+		int deviceId = findVideoDevice();
+		if(deviceId >= 0)
+		{
+			std::stringstream filename;
+			filename << "/dev/video" << deviceId;
+			path = filename.str();
+		}
+		mpDevice = CameraDevice::create(path.c_str());
+		if(mpDevice != NULL && !mpDevice->open(path.c_str(), WIDTH, HEIGHT, CAMERA_USE_MJPEG ? CameraBuffer::FORMAT_MJPEG : CameraBuffer::FORMAT_YUYV))
+		{
+			delete mpDevice;
+			mpDevice = NULL;
+		}
+	}
+	if(Recorder::value(Recorder::EVENT_CAMERA, 0, mpDevice != NULL) == 0)
 	{
 		Debug::print(LOG_SUMMARY, "Unable to initialize camera\r\n");
 		return false;
 	}
-	cvSetCaptureProperty(mpCapture, CV_CAP_PROP_FRAME_WIDTH, WIDTH); //撮影サイズを指定
-	cvSetCaptureProperty(mpCapture, CV_CAP_PROP_FRAME_HEIGHT, HEIGHT);
 
-	mIsWarming = false;
 	verifyCamera(false);
 
+	//フレームの取り込みは専用のスレッドで行う
+	releaseFrames();
+	if(mpDevice != NULL && !isInline())
+	{
+		mIsWaitingFirstFrame = true;
+		mIsCapturing = true;
+		if(pthread_create(&mThread, NULL, captureThread, this) != 0)
+		{
+			mIsCapturing = false;
+			delete mpDevice;
+			mpDevice = NULL;
+			Debug::print(LOG_SUMMARY, "Camera: Failed to start capture thread\r\n");
+			return false;
+		}
+	}
+
 	return true;
 }
 void CameraCapture::onClean()
 {
-	cvReleaseCapture(&mpCapture);
-	mpCapture = NULL;
+	if(mIsCapturing)
+	{
+		mIsCapturing = false;
+		pthread_join(mThread, NULL);
+	}
+	//保存待ちの画像をすべて保存する
+	mSaver.stop();
+
+	//デバイスを閉じるとバッファも解放される
+	delete mpDevice;
+	mpDevice = NULL;
+	releaseFrames();
+	if(mpConvertedImage != NULL)mpConvertedImage->release();
+	mpConvertedImage = NULL;
+	if(mpGrayImage != NULL)cvReleaseImage(&mpGrayImage);
+}
+void CameraCapture::releaseFrames()
+{
+	for(int i = 0;i < 3;++i)
+	{
+		mFrames[i].raw.pData = NULL;
+		mFrames[i].sequence = 0;
+	}
+	mBack = 0;
+	mMiddle = 1;
+	mFront = 2;
+	mCaptureCount = 0;
+	mInlineFrame.raw.pData = NULL;
+	mInlineFrame.sequence = 0;
+	mpImage = NULL;
+	mImageSequence = mGraySequence = 0;
+}
+bool CameraCapture::isInline()
+{
+	return Recorder::getMode() != Recorder::MODE_NONE;
+}
+void* CameraCapture::captureThread(void* arg)
+{
+	CameraCapture& parent = *(CameraCapture*)arg;
+	while(parent.mIsCapturing)
+	{
+		//取り込めなければ少し待って再試行する(カメラが外れた場合はgetFrameのverifyCameraで検出する)
+		if(!parent.capture())usleep(CAMERA_RETRY_PERIOD);
+	}
+	return NULL;
+}
+bool CameraCapture::capture()
+{
+	//次のフレームが届くまで待つ(onCleanで止められるように待ち時間は短くする)
+	CameraBuffer buffer;
+	if(!mpDevice->dequeue(buffer, CAMERA_RETRY_PERIOD / 1000))return false;
+
+	//mBackにあったフレームは読み込み側に渡らなかったか、読み込み側が使い終わったものなのでデバイスに返す
+	Frame& frame = mFrames[mBack];
+	if(frame.raw.pData != NULL)mpDevice->requeue(frame.raw);
+	frame.raw = buffer;
+	frame.time = buffer.time;
+	frame.sequence = ++mCaptureCount;
+
+	//完成したフレームを最新のフレームとして公開し、前の最新のフレームを次の書き込みに使う
+	__sync_synchronize();
+	mBack = __sync_lock_test_and_set(&mMiddle, mBack | FRAME_NEW) & ~FRAME_NEW;
+	if(frame.sequence == 1)
+	{
+		pthread_mutex_lock(&mMutex);
+		pthread_cond_broadcast(&mCond);
+		pthread_mutex_unlock(&mMutex);
+	}
+	return true;
 }
 bool CameraCapture::onCommand(const std::vector<std::string>& args)
 {
 	if(!isActive())return false;
-	if(args.size() == 2)
+	if(args.size() == 1)
+	{
+		const Frame* pFrame = getLatestFrame();
+		struct timespec time;
+		Time::get(time);
+		if(pFrame == NULL)Debug::print(LOG_SUMMARY, "Camera: no frame (%s)\r\n", mIsCapturing ? "capturing" : "inline");
+		else Debug::print(LOG_SUMMARY, "Camera: frame #%u %ux%u %s (%.0f ms ago, %s)\r\n", pFrame->sequence, pFrame->raw.width, pFrame->raw.height,
+			pFrame->raw.pData == NULL ? "replay" : (pFrame->raw.format == CameraBuffer::FORMAT_MJPEG ? "MJPEG" : "YUYV"), Time::dt(time, pFrame->time) * 1000, mIsCapturing ? "capturing" : "inline");
+	}else if(args.size() == 2)
 	{
 		if(args[1].compare("save") == 0)
 		{
 			save();
-			startWarming();
-		}else if(args[1].compare("warm") == 0)
+		}else if(args[1].compare("queue") == 0)
 		{
-			startWarming();
+			mSaver.showState();
 		}
 		return true;
 	}else if(args.size() == 3)
@@ -922,38 +1533,33 @@ bool CameraCapture::onCommand(const std::vector<std::string>& args)
 		if(args[1].compare("save") == 0)
 		{
 			save(&args[2]);
-			startWarming();
+		}else if(args[1].compare("quality") == 0)
+		{
+			mSaver.setQuality(atoi(args[2].c_str()));
+			mSaver.showState();
+		}else if(args[1].compare("thumbnail") == 0)
+		{
+			mSaver.setThumbnailWidth(atoi(args[2].c_str()));
+			mSaver.showState();
 		}
 		return true;
 	}
-	Debug::print(LOG_SUMMARY, "camera warm  : stand by for capturing\r\n\
+	Debug::print(LOG_SUMMARY, "camera       : show latest frame\r\n\
 camera save  : take picture\r\n\
-camera save [name] : take picture as name\r\n");
+camera save [name] : take picture as name\r\n\
+camera queue : show saving queue\r\n\
+camera quality [0-100] : set JPEG quality\r\n\
+camera thumbnail [width] : save pictures resized to width (0: original size)\r\n");
 	return false;
 }
-void CameraCapture::onUpdate(const struct timespec& time)
-{
-	if(mIsWarming)
-	{
-		getFrame();
-		mIsWarming = true;
-	}
-}
 void CameraCapture::verifyCamera(bool reinitialize)
 {
-	unsigned int deviceId = 0;
-	bool exist = false;
-	struct stat st;
-	do
-	{
-		std::stringstream filename;
-		filename << "/dev/video" << deviceId++;
-		exist = stat(filename.str().c_str(), &st) == 0;
-		if(deviceId > 32)return;//失敗
-	}while(!exist);
-	--deviceId;
+	int deviceId = -1;
+	if(!Recorder::isReplaying())deviceId = findVideoDevice();
+	deviceId = Recorder::value(Recorder::EVENT_CAMERA, 1, deviceId);
+	if(deviceId < 0)return;//失敗
 
-	if(deviceId != mCurVideoDeviceID && reinitialize)
+	if((unsigned int)deviceId != mCurVideoDeviceID && reinitialize)
 	{
 		Debug::print(LOG_SUMMARY, "Camera: not available, trying to reinitialize\r\n");
 		setRunMode(false);
@@ -962,10 +1568,6 @@ void CameraCapture::verifyCamera(bool reinitialize)
 	}
 	mCurVideoDeviceID = deviceId;
 }
-void CameraCapture::startWarming()
-{
-	mIsWarming = true;
-}
 void CameraCapture::save(const std::string* name,IplImage* pImage,bool nolog)
 {
 	if(!isActive())return;
@@ -973,28 +1575,170 @@ void CameraCapture::save(const std::string* name,IplImage* pImage,bool nolog)
 	if(name != NULL)filename.assign(*name);
 	else mFilename.get(filename);
 	if(pImage == NULL)pImage = getFrame();
-	cvSaveImage(filename.c_str(), pImage);
+	if(pImage == NULL)return;
 
-	if(!nolog)Debug::print(LOG_SUMMARY, "Captured image was saved as %s\r\n", filename.c_str());
+	mSaver.push(filename, share(pImage), nolog);
 }
-IplImage* CameraCapture::getFrame()
+SharedImage* CameraCapture::share(IplImage* pImage)
+{
+	//変換済みのフレームなら参照を渡し、それ以外の画像(再生中の画像など)は書き換えられる前にコピーする
+	return mpConvertedImage != NULL && mpConvertedImage->get() == pImage ? mpConvertedImage->retain() : SharedImage::clone(pImage);
+}
+SharedImage* CameraCapture::getSharedFrame()
+{
+	const Frame* pFrame = getLatestFrame();
+	return pFrame == NULL ? NULL : getSharedFrame(*pFrame);
+}
+SharedImage* CameraCapture::getSharedFrame(const Frame& frame)
+{
+	IplImage* pImage = getImage(frame);
+	return pImage == NULL ? NULL : share(pImage);
+}
+const CameraCapture::Frame* CameraCapture::getLatestFrame()
 {
 	if(!isActive())return NULL;
-	mIsWarming = false;
 
 	verifyCamera();
-	IplImage* pImage = cvQueryFrame(mpCapture);
-	if(pImage == NULL)
+	if(!mIsCapturing)
+	{
+		//記録/再生中はその場で取り込み、BGRに変換したものを記録する
+		IplImage* pImage = NULL;
+		if(!Recorder::isReplaying() && mpDevice != NULL)
+		{
+			if(mInlineFrame.raw.pData != NULL)mpDevice->requeue(mInlineFrame.raw);
+			if(mpDevice->dequeue(mInlineFrame.raw, CAMERA_FIRST_FRAME_TIMEOUT))pImage = convert(mInlineFrame.raw);
+			else mInlineFrame.raw.pData = NULL;
+		}
+		pImage = Recorder::frame(pImage);
+		if(pImage == NULL)return NULL;
+		if(mInlineFrame.raw.pData == NULL)
+		{
+			mInlineFrame.raw.width = pImage->width;
+			mInlineFrame.raw.height = pImage->height;
+		}
+		Time::get(mInlineFrame.time);
+		mpImage = pImage;
+		mImageSequence = ++mInlineFrame.sequence;
+		return &mInlineFrame;
+	}
+
+	//まだ1枚も受け取っていなければ最初のフレームが取り込まれるまで待つ
+	//(カメラが止まっている場合に毎回待たされないよう、待つのはonInit後の1回だけ)
+	if(mFrames[mFront].sequence == 0 && mIsWaitingFirstFrame)
+	{
+		mIsWaitingFirstFrame = false;
+		struct timespec timeout;
+		clock_gettime(CLOCK_MONOTONIC, &timeout);
+		timeout.tv_sec += CAMERA_FIRST_FRAME_TIMEOUT / 1000;
+		timeout.tv_nsec += (CAMERA_FIRST_FRAME_TIMEOUT % 1000) * 1000000;
+		if(timeout.tv_nsec >= 1000000000)
+		{
+			timeout.tv_nsec -= 1000000000;
+			++timeout.tv_sec;
+		}
+		pthread_mutex_lock(&mMutex);
+		while(!(mMiddle & FRAME_NEW) && pthread_cond_timedwait(&mCond, &mMutex, &timeout) == 0);
+		pthread_mutex_unlock(&mMutex);
+	}
+
+	//新しいフレームがあれば読み込み側のバッファと交換する
+	if(mMiddle & FRAME_NEW)
+	{
+		mFront = __sync_lock_test_and_set(&mMiddle, mFront) & ~FRAME_NEW;
+		__sync_synchronize();
+	}
+	const Frame& frame = mFrames[mFront];
+	return frame.sequence == 0 ? NULL : &frame;
+}
+IplImage* CameraCapture::convert(const CameraBuffer& raw)
+{
+	if(raw.pData == NULL)return NULL;
+	if(mpConvertedImage != NULL && (mpConvertedImage->isShared() || mpConvertedImage->get()->width != (int)raw.width || mpConvertedImage->get()->height != (int)raw.height))
+	{
+		mpConvertedImage->release();
+		mpConvertedImage = NULL;
+	}
+	if(mpConvertedImage == NULL)mpConvertedImage = SharedImage::create(cvSize(raw.width, raw.height), IPL_DEPTH_8U, 3);
+
+	cv::Mat dst = cv::cvarrToMat(mpConvertedImage->get());
+	if(raw.format == CameraBuffer::FORMAT_YUYV)
+	{
+		cv::cvtColor(cv::Mat(raw.height, raw.width, CV_8UC2, (void*)raw.pData, raw.stride), dst, CV_YUV2BGR_YUYV);
+	}else
+	{
+		cv::Mat decoded = cv::imdecode(cv::Mat(1, raw.size, CV_8UC1, (void*)raw.pData), CV_LOAD_IMAGE_COLOR);
+		if(decoded.empty() || decoded.cols != (int)raw.width || decoded.rows != (int)raw.height)return NULL;
+		decoded.copyTo(dst);
+	}
+	return mpConvertedImage->get();
+}
+IplImage* CameraCapture::getImage(const Frame& frame)
+{
+	if(mImageSequence != frame.sequence)
 	{
-		//エラー返してくれない
+		mpImage = convert(frame.raw);
+		mImageSequence = frame.sequence;
 	}
-	return pImage;
+	return mpImage;
 }
-CameraCapture::CameraCapture() : mpCapture(NULL), mIsWarming(false), mFilename("capture",".jpg")
+IplImage* CameraCapture::getFrame()
+{
+	const Frame* pFrame = getLatestFrame();
+	return pFrame == NULL ? NULL : getImage(*pFrame);
+}
+IplImage* CameraCapture::getGrayFrame()
+{
+	const Frame* pFrame = getLatestFrame();
+	if(pFrame == NULL)return NULL;
+	if(mGraySequence == pFrame->sequence)return mpGrayImage;
+
+	const CameraBuffer& raw = pFrame->raw;
+	IplImage* pImage = NULL;
+	if(raw.pData == NULL || raw.format != CameraBuffer::FORMAT_YUYV)
+	{
+		//MJPEGや再生中はBGRから変換する
+		if((pImage = getImage(*pFrame)) == NULL)return NULL;
+	}
+	int width = pImage != NULL ? pImage->width : raw.width, height = pImage != NULL ? pImage->height : raw.height;
+	if(mpGrayImage != NULL && (mpGrayImage->width != width || mpGrayImage->height != height))cvReleaseImage(&mpGrayImage);
+	if(mpGrayImage == NULL)mpGrayImage = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+
+	if(pImage != NULL)cvCvtColor(pImage, mpGrayImage, CV_BGR2GRAY);
+	else
+	{
+		//YUYVのY成分を取り出す
+		for(int y = 0;y < height;++y)
+		{
+			unsigned char* pDst = (unsigned char*)mpGrayImage->imageData + y * mpGrayImage->widthStep;
+			for(int x = 0;x < width;++x)pDst[x] = raw.getY(x, y);
+		}
+	}
+	mGraySequence = pFrame->sequence;
+	return mpGrayImage;
+}
+CameraCapture::CameraCapture() : mpDevice(NULL), mFilename("capture",".jpg"), mCurVideoDeviceID(0), mMiddle(1), mBack(0), mFront(2), mCaptureCount(0), mIsCapturing(false), mIsWaitingFirstFrame(false), mpConvertedImage(NULL), mpImage(NULL), mImageSequence(0), mpGrayImage(NULL), mGraySequence(0)
 {
 	setName("camera");
-	setPriority(UINT_MAX,5);
+	setPriority(UINT_MAX,UINT_MAX);
+	setAsyncInit(true);//カメラの初期化は数百msかかるため別スレッドで行う
+
+	for(int i = 0;i < 3;++i)
+	{
+		mFrames[i].raw.pData = NULL;
+		mFrames[i].sequence = 0;
+	}
+	mInlineFrame.raw.pData = NULL;
+	mInlineFrame.sequence = 0;
+
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&mCond, &attr);
+	pthread_condattr_destroy(&attr);
 }
 CameraCapture::~CameraCapture()
 {
+	pthread_cond_destroy(&mCond);
+	pthread_mutex_destroy(&mMutex);
 }
@@ -7,8 +7,10 @@
 #pragma once
 #include "task.h"
 #include "utils.h"
+#include "i2c_bus.h"
+#include "seqlock.h"
+#include "pressure_filter.h"
 #include <pthread.h>
-#include <list>
 
 //MPL115A2からデータを取得するクラス
 //気圧の値はhPa単位で+-10hPaの誤差あり
@@ -16,10 +18,31 @@ class PressureSensor : public TaskBase
 {
 private:
 	float mA0,mB1,mB2,mC12;//気圧計算用の係数
-	int mPressure;//最後に取得した気圧
 	int mFileHandle;//winringPi i2c　のファイルハンドラ
 
-	struct timespec mLastUpdateRequest;//最後に気圧の更新をMPL115A2に指示した時刻
+	//I2Cバスのスレッドで気圧と温度のADC値を読み込み、次の変換を開始する
+	struct Sample
+	{
+		unsigned int padc, tadc;
+		struct timespec time;//読み込んだ時刻
+	};
+	class Transfer : public I2CTransaction<Sample>
+	{
+	protected:
+		virtual bool transfer(Sample& result, const struct timespec& time);
+	public:
+		int mFileHandle;
+		Transfer();
+	} mTransfer;
+
+	//基準気圧(放出前の地上の気圧、最初のPRESSURE_BASELINE_COUNTサンプルの平均)
+	double mBaselinePressure;
+	double mBaselineSum, mBaselineSquareSum;//観測ノイズを求めるため2乗和も集める
+	unsigned int mBaselineCount;
+
+	//高度と鉛直速度のカルマンフィルタ(等速度モデル)
+	struct timespec mLastSampleTime;
+	AltitudeFilter mFilter;
 
 	float val2float(unsigned int val, int total_bits, int fractional_bits, int zero_pad);
 	void requestSample();
@@ -35,9 +58,29 @@ protected:
 	//コマンドを処理する
 	virtual bool onCommand(const std::vector<std::string>& args);
 public:
+	//最後にアップデートされた気圧(他のスレッドからも一貫した値を読み込める)
+	struct Snapshot
+	{
+		struct timespec time;//更新時刻
+		int pressure;//気圧(hPa)
+		float exactPressure;//小数部を含む気圧(hPa、変化率の計算用)
+		float temperature;//センサの温度(℃)
+		bool isBaselineReady;//基準気圧が決まっているか(falseなら以下の値は無効)
+		float altitude;//基準気圧からの高度(m)
+		float verticalSpeed;//鉛直速度(m/s、上昇が正)
+		float verticalSpeedVariance;//鉛直速度の推定誤差の分散((m/s)^2)
+	};
+private:
+	Seqlock<Snapshot> mSnapshot;
+public:
+	void getSnapshot(Snapshot& snapshot) const;
+
 	//最後にアップデートされた気圧を返す
 	int get();
 
+	//現在の気圧を基準高度とし直す(次のPRESSURE_BASELINE_COUNTサンプルの平均を使う)
+	void setBaseline();
+
 	PressureSensor();
 	~PressureSensor();
 };
@@ -53,9 +96,29 @@ private:
 	int mGpsTime;
 	float mGpsSpeed;
 	float mGpsCourse;
-	bool mIsNewData;//新しい座標データがあれば真
+	unsigned int mNewDataCount;//新しい座標データを受信した回数
+	volatile unsigned int mReadDataCount;//getで座標を取得した時点のmNewDataCount
 	bool mIsLogger;//真なら1秒ごとにgpsコマンドを実行
 
+	//I2Cバスのスレッドでレジスタ(0x00〜0x2A)全体を2回読み込む
+	const static int REGISTER_COUNT = 0x2B;
+	struct Registers
+	{
+		unsigned char data[2][REGISTER_COUNT];
+	};
+	class Transfer : public I2CTransaction<Registers>
+	{
+	protected:
+		virtual bool transfer(Registers& result, const struct timespec& time);
+	public:
+		int mFileHandle;
+		Transfer();
+	} mTransfer;
+	//読み込んだレジスタから座標などを更新する
+	void decode(const Registers& registers, const struct timespec& time);
+	//現在の座標などをスナップショットとして公開する
+	void publish(const struct timespec& time);
+
 	void showState()const;//補足した衛星数と座標を表示
 	void sendState() ;//GPSを送信　８－７村上
 protected:
@@ -69,6 +132,28 @@ protected:
 	virtual bool onCommand(const std::vector<std::string>& args);
 
 public:
+	//最後にアップデートされた座標など(他のスレッドからも一貫した値を読み込める)
+	struct Snapshot
+	{
+		struct timespec time;//更新時刻
+		VECTOR3 pos;//座標(経度、緯度、高度)
+		int satelites;//補足した衛星の数
+		int gpsTime;
+		float speed;
+		float course;
+		unsigned int newDataCount;//新しい座標データを受信した回数
+
+		//3D fixしていれば真
+		bool hasPosition() const
+		{
+			return satelites >= 4 && !(pos.x == 0 && pos.y == 0 && pos.z == 0);
+		}
+	};
+private:
+	Seqlock<Snapshot> mSnapshot;
+public:
+	void getSnapshot(Snapshot& snapshot) const;
+
 	//現在の座標を取得する(falseを返した場合は場所が不明)
 	//disableNewFlagをfalseにすると座標が新しいという情報を削除
 	bool get(VECTOR3& pos, bool disableNewFlag = false);
@@ -92,13 +177,46 @@ private:
 	int mFileHandle;//winringPi i2c　のファイルハンドラ
 	VECTOR3 mRVel;//角速度
 	VECTOR3 mRAngle;//角度
-	struct timespec mLastSampleTime;
+	struct timespec mLastSampleTime;//最後のサンプルの時刻(出力データレートから推定)
+	VECTOR3 mLastSample;//最後のサンプルの角速度(積分用)
 
 	//ドリフト誤差補正用
-	std::list<VECTOR3> mRVelHistory;//過去の角速度
 	VECTOR3 mRVelOffset;//サンプルあたりのドリフト誤差の推定値
 	double mCutOffThreshold;
-	bool mIsCalculatingOffset;//ドリフト誤差計算中フラグ
+	bool mIsCalculatingOffset;//calibrateが呼ばれたので、次の区間は静止判定をせずにドリフト誤差の推定に使う
+	bool mIsOffsetFixed;//ドリフト誤差がコマンドで指定されたので、calibrateが呼ばれるまで自動で推定しない
+	RunningStatistics mWindowStatistics;//静止判定中の区間の角速度(補正前)
+	RunningStatistics mBiasStatistics;//静止していた区間の角速度(補正前)
+	unsigned long long mWindowEncoderL,mWindowEncoderR;//区間の開始時のエンコーダの値
+	bool mIsWindowAccelStill;//区間内の加速度がすべて1G付近だったか
+	bool mIsStill;//最後に判定した区間で静止していたか
+
+	//I2Cバスのスレッドで読み込んだFIFOのサンプル(受け取るまでは追記される)
+	const static unsigned int SAMPLE_BUFFER_SIZE = GYRO_FIFO_SIZE * 2;
+	struct Samples
+	{
+		unsigned int count;
+		struct timespec times[SAMPLE_BUFFER_SIZE];//出力データレートから推定した各サンプルの時刻
+		short raw[SAMPLE_BUFFER_SIZE][3];
+	};
+	class Transfer : public I2CTransaction<Samples>
+	{
+	protected:
+		virtual bool transfer(Samples& result, const struct timespec& time);
+		virtual void merge(Samples& pending, const Samples& result);
+	public:
+		int mFileHandle;
+		double mSamplePeriod;
+		Transfer();
+	} mTransfer;
+
+	//1サンプル分のドリフト誤差補正と積分を行う
+	void addSample(const VECTOR3& sample, const struct timespec& time);
+	//区間ごとに静止判定を行い、静止していればドリフト誤差の推定値を更新する
+	void updateOffset(const VECTOR3& sample);
+	void beginWindow();
+	//現在の角速度と角度をスナップショットとして公開する
+	void publish(const struct timespec& time);
 protected:
 	//ジャイロセンサを初期化
 	virtual bool onInit(const struct timespec& time);
@@ -111,6 +229,18 @@ protected:
 	//コマンドを処理する
 	virtual bool onCommand(const std::vector<std::string>& args);
 public:
+	//最後にアップデートされたデータ(他のスレッドからも一貫した値を読み込める)
+	struct Snapshot
+	{
+		struct timespec time;//更新時刻
+		VECTOR3 rvel;//角速度
+		VECTOR3 rangle;//角度(-180〜+180)
+	};
+private:
+	Seqlock<Snapshot> mSnapshot;
+public:
+	void getSnapshot(Snapshot& snapshot) const;
+
 	//最後にアップデートされたデータを返す
 	bool getRVel(VECTOR3& vel);
 	double getRvx();
@@ -129,8 +259,10 @@ public:
 	double getRy();
 	double getRz();
 
-	//ドリフト誤差を補正する(静止状態で呼び出すこと)
+	//ドリフト誤差を補正する(静止状態で呼び出すこと、静止中は自動でも補正される。コマンドで指定したドリフト誤差の固定も解除する)
 	void calibrate();
+	//最後に判定した区間で静止していたか
+	bool isStill() const;
 
 	//引数のベクトルを(-180〜+180)の範囲に修正
 	static void normalize(VECTOR3& pos);
@@ -145,13 +277,44 @@ class AccelerationSensor : public TaskBase
 {
 private:
 	int mFileHandle;//winringPi i2c　のファイルハンドラ
-	VECTOR3 mAccel;//加速度
+
+	//I2Cバスのスレッドで読み込んだFIFOのサンプル(1/1024G/LSB、受け取るまでは追記される)
+	const static unsigned int SAMPLE_BUFFER_SIZE = ACCEL_FIFO_SIZE * 2;
+	struct Samples
+	{
+		unsigned int count;
+		struct timespec times[SAMPLE_BUFFER_SIZE];//出力データレートから推定した各サンプルの時刻
+		short raw[SAMPLE_BUFFER_SIZE][3];
+	};
+	class Transfer : public I2CTransaction<Samples>
+	{
+	protected:
+		virtual bool transfer(Samples& result, const struct timespec& time);
+		virtual void merge(Samples& pending, const Samples& result);
+	public:
+		int mFileHandle;
+		bool mIsFifo;//MMA8451QのFIFOを使うか(falseなら旧センサのレジスタを1回ずつ読む)
+		double mSamplePeriod;
+		Transfer();
+	} mTransfer;
 protected:
 	virtual bool onInit(const struct timespec& time);
 	virtual void onClean();
 	virtual void onUpdate(const struct timespec& time);
 	virtual bool onCommand(const std::vector<std::string>& args);
 public:
+	//最後にアップデートされた加速度(他のスレッドからも一貫した値を読み込める)
+	struct Snapshot
+	{
+		struct timespec time;//更新時刻
+		VECTOR3 accel;//加速度
+	};
+private:
+	Seqlock<Snapshot> mSnapshot;
+public:
+	void getSnapshot(Snapshot& snapshot) const;
+	//個々のサンプルはgSampleBus.accelから取得できる
+
 	//最後にアップデートされたデータを返す
 	bool getAccel(VECTOR3& acc);
 	double getAx();
@@ -167,15 +330,24 @@ public:
 };
 
 //Cdsからデータを取得するクラス
+//明るさの変化は割り込みで検出するため、onUpdateの間の短い変化も見逃さない
 class LightSensor : public TaskBase
 {
 private:
 	int mPin;
+	volatile unsigned int mEdgeCount;//割り込みで数えたエッジの数
+	unsigned int mLastEdgeCount;//前回のonUpdateでのmEdgeCount
+	bool mLastState;//前回のonUpdateでの明るさ
+	struct timespec mLastChangeTime;//最後に明るさの変化を検出した時刻
+
+	static void edgeCallback();
 protected:
 	//初期化
 	virtual bool onInit(const struct timespec& time);
 	//センサの使用を終了する
 	virtual void onClean();
+	//明るさの変化を確認する
+	virtual void onUpdate(const struct timespec& time);
 	//コマンドを処理する
 	virtual bool onCommand(const std::vector<std::string>& args);
 
@@ -183,18 +355,31 @@ public:
 	//現在の明るさを取得する
 	bool get();
 
+	//明るさがduration[ms]以上変化していなければtrueを返し、stateにその明るさを書き込む(チャタリング除去)
+	//変化はonUpdateの周期単位で検出するため、実際より短く判定されることはない
+	bool getStable(const struct timespec& time, unsigned int duration, bool& state);
+
 	LightSensor();
 	~LightSensor();
 };
 
+#include "video_recorder.h"
+
 //Webカメラの動画をキャプチャするクラス
+//CameraCaptureが取り込んだフレームを受け取って記録するため、カメラを別に開くことはない
 class WebCamera : public TaskBase
 {
+	VideoRecorder mRecorder;
+	Filename mFilename;
+	unsigned int mLastSequence;//最後に記録したフレームの番号
 protected:
 	virtual bool onCommand(const std::vector<std::string>& args);
+	virtual void onUpdate(const struct timespec& time);
 	virtual void onClean();
 public:
+	//記録を開始する(filenameを省略すると連番のファイル名にする)
 	void start(const char* filename = NULL);
+	//記録を終了する(残りのフレームは記録スレッドが書き込むので待たない)
 	void stop();
 
 	WebCamera();
@@ -204,19 +389,36 @@ public:
 //距離センサーを操作するクラス
 class DistanceSensor : public TaskBase
 {
-	double mLastDistance;
-	struct timespec mLastSampleTime;
 	pthread_t mPthread;
-	volatile bool mIsCalculating;
-	volatile bool mIsNewData;
-
+	pthread_mutex_t mMutex;
+	pthread_cond_t mCond;//計測の指示と終了を計測スレッドに知らせる
+	bool mIsRunning;//計測スレッドを動かすか(mMutexで保護)
+	bool mIsCalculating;//計測中(mMutexで保護)
+	int mEdgeHandle;//エコーのエッジ検出のハンドル
+	unsigned int mReadSequence;//getDistanceで取得した時点の計測回数
+
+	//計測の指示があるまでスリープし、エッジの時刻からエコーの長さを求める
 	static void* waitingThread(void* arg);
+	//1回計測してエコーの長さ(秒)を返す(計測不能であれば-1)
+	double measure();
 protected:
 	virtual bool onInit(const struct timespec& time);
 	virtual void onClean();
 	virtual void onUpdate(const struct timespec& time);
 	virtual bool onCommand(const std::vector<std::string>& args);
 public:
+	//最後に計測された距離(計測スレッドが書き込み、他のスレッドからも一貫した値を読み込める)
+	struct Snapshot
+	{
+		struct timespec time;//計測時刻
+		double distance;//距離(計測不能であれば-1)
+		unsigned int sequence;//計測回数
+	};
+private:
+	Seqlock<Snapshot> mSnapshot;
+public:
+	void getSnapshot(Snapshot& snapshot) const;
+
 	bool ping();//距離センサーに計測を指示する
 
 	//計測された距離を返す(新しいデータであればtrueを返す)
@@ -230,25 +432,90 @@ public:
 #include <opencv2/opencv.hpp>
 #include <opencv/cvaux.h>
 #include <opencv/highgui.h>
+#include "camera_device.h"
+#include "image_saver.h"
+//カメラの画像を取得するクラス
+//V4L2のバッファ(YUYV/MJPEG)をそのまま使い、BGRへの変換は必要になったときだけ行う
+//専用のスレッドでフレームを取り込み続け、getFrameは最新のフレームを待たずに返す
+//記録/再生中(Recorder)はスレッドを使わず、getFrameを呼んだときにメインスレッドで取り込む
 class CameraCapture : public TaskBase
 {
-	CvCapture* mpCapture;
-	bool mIsWarming;
+public:
+	//取り込んだフレーム
+	struct Frame
+	{
+		CameraBuffer raw;//カメラから受け取ったままのデータ(再生中はpDataがNULL)
+		struct timespec time;//取り込んだ時刻
+		unsigned int sequence;//取り込んだ順番(1から)
+	};
+private:
+	CameraDevice* mpDevice;
 	Filename mFilename;
 	unsigned int mCurVideoDeviceID;//現在使用しているカメラのデバイス番号(/dev/video*)
 
+	//取り込みスレッドからメインスレッドへフレームを受け渡すトリプルバッファ
+	//取り込みスレッドがmBack、読み込み側がmFrontを持ち、最新の完成したフレーム(mMiddle)と交換する
+	//取り込みスレッドは使われなくなったフレームのバッファをデバイスに返す
+	const static unsigned int FRAME_NEW = 0x100;//mMiddleがまだ読み込み側に渡していないフレームであることを示すフラグ
+	Frame mFrames[3];
+	volatile unsigned int mMiddle;
+	unsigned int mBack, mFront;
+	unsigned int mCaptureCount;//取り込んだフレームの数(取り込みスレッドのみが書き込む)
+	Frame mInlineFrame;//記録/再生中にその場で取り込んだフレーム
+
+	pthread_t mThread;
+	volatile bool mIsCapturing;//取り込みスレッドを動かすか
+	bool mIsWaitingFirstFrame;//最初のフレームを待つか(onInitごとに1回だけ待ち、タイムアウトした後は待たない)
+	pthread_mutex_t mMutex;
+	pthread_cond_t mCond;//最初のフレームが取り込まれたことを知らせる
+
+	//必要になったときに変換した画像(変換元のフレームの番号が同じなら使い回す)
+	//保存待ちになった画像は書き換えず、次の変換では新しい画像を使う
+	SharedImage* mpConvertedImage;
+	IplImage* mpImage;//getFrameで返す画像(mpConvertedImageか再生中の画像)
+	unsigned int mImageSequence;
+	IplImage* mpGrayImage;
+	unsigned int mGraySequence;
+
+	ImageSaver mSaver;//saveで渡された画像を別スレッドで保存する
+
 	const static int WIDTH = 320,HEIGHT = 240;
+
+	static void* captureThread(void* arg);
+	//フレームを1枚受け取ってmBackに書き込み、mMiddleと交換する
+	bool capture();
+	//記録/再生中はスレッドを使わない
+	static bool isInline();
+	void releaseFrames();
+	//rawをBGRに変換する(失敗時はNULL)
+	IplImage* convert(const CameraBuffer& raw);
+	//frameをBGRにした画像を返す(変換済みなら使い回す)
+	IplImage* getImage(const Frame& frame);
+	//pImageを参照カウント付きにする(変換済みの画像なら参照を増やし、それ以外はコピーする)
+	SharedImage* share(IplImage* pImage);
 protected:
 	virtual bool onInit(const struct timespec& time);
 	virtual void onClean();
 	virtual bool onCommand(const std::vector<std::string>& args);
-	virtual void onUpdate(const struct timespec& time);
 
 	void verifyCamera(bool reinitialize = true);
 public:
-	void startWarming();//getFrameする少し前に呼び出すこと.古い画像が取得されるのを防止できる
+	//最新のフレームを返す(コピーせず、次にgetLatestFrameかgetFrameを呼ぶまで有効、メインスレッドから呼ぶこと)
+	//取り込みスレッドがまだ1枚も取り込んでいなければ最大CAMERA_FIRST_FRAME_TIMEOUT[ms]待つ(onInit後の最初の1回だけ、以降はNULLを返す)
+	const Frame* getLatestFrame();
+	//最新のフレームをBGRで返す
 	IplImage* getFrame();
+	//最新のフレームの輝度を返す(YUYVならY成分をそのまま使い、色の変換は行わない)
+	//輝度だけで済む処理向け。ImageProcの検出処理は色相で空や色を判定するためgetFrameを使う
+	IplImage* getGrayFrame();
+
+	//最新のフレームをBGRで参照カウント付きで返す(変換済みの画像をコピーせずに共有する、使い終わったらreleaseすること)
+	SharedImage* getSharedFrame();
+	//getLatestFrameで取得したframeをBGRで参照カウント付きで返す(改めてフレームを取り込まない)
+	SharedImage* getSharedFrame(const Frame& frame);
 
+	//画像を保存待ちにする(エンコードと書き込みは別スレッドで行い、呼び出し元は待たない)
+	//pImageを省略すると最新のフレームを保存する。getFrameで取得した画像はコピーせずに参照を渡す
 	void save(const std::string* name = NULL,IplImage* pImage = NULL, bool nolog = false);
 
 	CameraCapture();
@@ -0,0 +1,44 @@
+/*
+	シーケンスロック
+
+	1つのスレッドが書き込んだ値を、他のスレッドがロックせずに一貫した状態で読み込むためのクラスです
+	・書き込むスレッドは1つだけにすること(センサのonUpdateなど)
+	・書き込み中は通し番号が奇数になり、読み込み側は通し番号が変わらずに値をコピーできるまで再試行する
+	・読み込み側は書き込み側を待たせず、メモリの確保も行わない
+	・Tはポインタを含まない単純な構造体にすること(コピー中に値が書き換わることがあるため)
+*/
+#pragma once
+#include <sched.h>
+
+template<class T> class Seqlock
+{
+	volatile unsigned int mSequence;//通し番号(奇数なら書き込み中)
+	T mData;
+public:
+	//値を書き込む
+	void write(const T& data)
+	{
+		mSequence = mSequence + 1;
+		__sync_synchronize();
+		mData = data;
+		__sync_synchronize();
+		mSequence = mSequence + 1;
+	}
+	//一貫した値をdataにコピーする
+	void read(T& data) const
+	{
+		unsigned int sequence;
+		do
+		{
+			//書き込み中なら書き込み側に実行を譲る(シングルコアで書き込み側が中断された場合に備える)
+			while((sequence = mSequence) & 1)sched_yield();
+			__sync_synchronize();
+			data = mData;
+			__sync_synchronize();
+		}while(sequence != mSequence);
+	}
+
+	Seqlock() : mSequence(0), mData()
+	{
+	}
+};
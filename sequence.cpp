@@ -30,7 +30,7 @@ Separating gSeparatingState;
 
 bool Testing::onInit(const struct timespec& time)
 {
-	TaskManager::getInstance()->setRunMode(false);
+	TaskManager::getInstance()->beginTransition();
 	setRunMode(true);
 	gBuzzer.setRunMode(true);
 	gParaServo.setRunMode(true);
@@ -131,11 +131,136 @@ Testing::Testing()
 	setName("testing");
 //能代用のため　コメントアウト	setPriority(UINT_MAX,UINT_MAX);
 	setPriority(TASK_PRIORITY_SEQUENCE,TASK_INTERVAL_SEQUENCE);
+	setPeriod(TASK_PERIOD_SEQUENCE,TASK_DEADLINE_SEQUENCE);
 }
 Testing::~Testing()
 {
 }
 
+//////////////////////////////////////////////
+// ReleaseDetector
+//////////////////////////////////////////////
+const char* ReleaseDetector::getSignalName(SIGNAL signal)
+{
+	const static char* NAMES[SIGNAL_COUNT] = {"freefall", "pressure", "light"};
+	return signal < SIGNAL_COUNT ? NAMES[signal] : "";
+}
+void ReleaseDetector::reset(const struct timespec& time)
+{
+	mDescentSpeed = mDescentSigma = 0;
+	mLastPressureTime = mLastAccelTime = time;
+	mIsFreefall = false;
+	mFreefallStartTime = time;
+	mConfidence = 0;
+	for(unsigned int i = 0;i < SIGNAL_COUNT;++i)
+	{
+		mIsDetected[i] = mIsVoting[i] = false;
+		mLastDetectedTime[i] = time;
+	}
+}
+void ReleaseDetector::updateFreefall(const struct timespec& time)
+{
+	//新しい加速度が届いたときのみ確認する
+	AccelerationSensor::Snapshot accel;
+	gAccelerationSensor.getSnapshot(accel);
+	if(!gAccelerationSensor.isActive() || Time::dt(accel.time, mLastAccelTime) <= 0)return;
+	mLastAccelTime = accel.time;
+
+	//加速度の大きさが0g付近の状態が一定時間続いたら自由落下
+	if(sqrt(pow(accel.accel.x, 2) + pow(accel.accel.y, 2) + pow(accel.accel.z, 2)) < RELEASE_FREEFALL_THRESHOLD)
+	{
+		if(!mIsFreefall)
+		{
+			mIsFreefall = true;
+			mFreefallStartTime = accel.time;
+		}
+	}else mIsFreefall = false;
+	mIsDetected[SIGNAL_FREEFALL] = mIsFreefall && Time::dt(accel.time, mFreefallStartTime) * 1000 >= RELEASE_FREEFALL_TIME;
+}
+void ReleaseDetector::updatePressure(const struct timespec& time)
+{
+	//新しい気圧が届いたときのみ確認する
+	PressureSensor::Snapshot pressure;
+	gPressureSensor.getSnapshot(pressure);
+	if(!gPressureSensor.isActive() || Time::dt(pressure.time, mLastPressureTime) <= 0)return;
+	mLastPressureTime = pressure.time;
+
+	//フィルタで推定した鉛直速度を使い、推定誤差に対して十分大きく下降しているときのみ降下中とする
+	//(基準気圧が決まるまでは判定しない)
+	mDescentSpeed = -pressure.verticalSpeed;
+	mDescentSigma = sqrt(pressure.verticalSpeedVariance);
+	mIsDetected[SIGNAL_PRESSURE] = pressure.isBaselineReady && mDescentSpeed >= RELEASE_DESCENT_SPEED && mDescentSpeed >= RELEASE_DESCENT_SIGMA * mDescentSigma;
+}
+void ReleaseDetector::updateLight(const struct timespec& time)
+{
+	bool isBright;
+	mIsDetected[SIGNAL_LIGHT] = gLightSensor.getStable(time, RELEASE_LIGHT_TIME, isBright) && isBright;
+}
+bool ReleaseDetector::update(const struct timespec& time)
+{
+	updateFreefall(time);
+	updatePressure(time);
+	updateLight(time);
+
+	//検出したセンサは一定時間投票に加え、重みの割合を確信度とする
+	double total = 0, votes = 0;
+	for(unsigned int i = 0;i < SIGNAL_COUNT;++i)
+	{
+		if(mIsDetected[i])mLastDetectedTime[i] = time;
+		bool isVoting = mIsDetected[i] || (mIsVoting[i] && Time::dt(time, mLastDetectedTime[i]) * 1000 <= RELEASE_VOTE_WINDOW);
+		total += mWeights[i];
+		if(isVoting)votes += mWeights[i];
+		if(isVoting != mIsVoting[i])
+		{
+			mIsVoting[i] = isVoting;
+			Debug::print(LOG_SUMMARY, "Release: %s %s\r\n", getSignalName((SIGNAL)i), isVoting ? "detected" : "lost");
+		}
+	}
+	double confidence = total > 0 ? votes / total : 0;
+	if(confidence != mConfidence)
+	{
+		mConfidence = confidence;
+		Debug::print(LOG_SUMMARY, "Release: confidence %.2f\r\n", mConfidence);
+	}
+	return mConfidence >= mThreshold && votes > 0;
+}
+double ReleaseDetector::getConfidence() const
+{
+	return mConfidence;
+}
+bool ReleaseDetector::setWeight(const std::string& name, double weight)
+{
+	for(unsigned int i = 0;i < SIGNAL_COUNT;++i)
+	{
+		if(name.compare(getSignalName((SIGNAL)i)) == 0)
+		{
+			mWeights[i] = weight;
+			return true;
+		}
+	}
+	return false;
+}
+void ReleaseDetector::setThreshold(double threshold)
+{
+	mThreshold = threshold;
+}
+void ReleaseDetector::showState() const
+{
+	Debug::print(LOG_SUMMARY, "Release: confidence %.2f (threshold %.2f), descent %.2f +- %.2f m/s\r\n", mConfidence, mThreshold, mDescentSpeed, mDescentSigma);
+	for(unsigned int i = 0;i < SIGNAL_COUNT;++i)
+	{
+		Debug::print(LOG_SUMMARY, " %-8s weight %.2f %s\r\n", getSignalName((SIGNAL)i), mWeights[i], mIsVoting[i] ? "detected" : "-");
+	}
+}
+ReleaseDetector::ReleaseDetector() : mDescentSpeed(0), mDescentSigma(0), mIsFreefall(false), mThreshold(RELEASE_VOTE_THRESHOLD), mConfidence(0)
+{
+	for(unsigned int i = 0;i < SIGNAL_COUNT;++i)
+	{
+		mIsDetected[i] = mIsVoting[i] = false;
+		mWeights[i] = 1;
+	}
+}
+
 //////////////////////////////////////////////
 // Waiting
 //////////////////////////////////////////////
@@ -145,14 +270,21 @@ bool Waiting::onInit(const struct timespec& time)
 	Debug::print(LOG_SUMMARY, "Waiting... ");
 	Time::showNowTime();
 
-	mContinuousLightCount = 0;
-
 	//現在の時刻を保存
 	mStartTime = time;
 
 	//必要なタスクを使用できるようにする
-	TaskManager::getInstance()->setRunMode(false);
+	TaskManager::getInstance()->beginTransition();
 	setRunMode(true);
+
+	//放出判定まで長時間待つため、全タスクの実行頻度を下げる(明るさの変化は割り込みで検出する)
+	TaskManager::getInstance()->setMinimumPeriod(WAITING_IDLE_PERIOD);
+
+	//放出判定に使うセンサ
+	mReleaseDetector.reset(time);
+	gAccelerationSensor.setRunMode(true);
+	gPressureSensor.setRunMode(true);
+	gPressureSensor.setBaseline();//放出前の気圧を高度の基準にする
 	gLightSensor.setRunMode(true);
 
 	//gXbeeSleep.setRunMode(true);//Xbeeをスリープモードにするならコメントアウトを解除すること
@@ -176,6 +308,9 @@ bool Waiting::onInit(const struct timespec& time)
 }
 void Waiting::nextState()
 {
+	//通常の実行頻度に戻す
+	TaskManager::getInstance()->setMinimumPeriod(0);
+
 	gBuzzer.start(100);
 
 	//スリープを解除
@@ -191,15 +326,22 @@ void Waiting::onUpdate(const struct timespec& time)
 	//XBeeをスリープモードに設定(ロケット内電波規制)
 	//gXbeeSleep.setState(true);//Xbeeをスリープモードにするならコメントアウトを解除すること
 
-	//明るい場合カウント
-	if(gLightSensor.get())
+	//明るい場合ブザーを鳴らす
+	bool isBright;
+	bool isStable = gLightSensor.getStable(time, WAITING_LIGHT_TIME, isBright);
+	if(isBright)gBuzzer.start(1);
+
+	//自由落下、気圧、明るさの多数決で放出判定
+	if(mReleaseDetector.update(time))
 	{
-		++mContinuousLightCount;
-		gBuzzer.start(10);
-	}else mContinuousLightCount = 0;
+		Debug::print(LOG_SUMMARY, "Release detected (confidence %.2f)\r\n", mReleaseDetector.getConfidence());
+		nextState();
+		return;
+	}
 
-	if(mContinuousLightCount >= WAITING_LIGHT_COUNT)//明るい場合放出判定
+	if(isStable && isBright)//他のセンサが使えない場合も、一定時間明るいままであれば放出判定
 	{
+		Debug::print(LOG_SUMMARY, "Release detected by light (confidence %.2f)\r\n", mReleaseDetector.getConfidence());
 		nextState();
 		return;
 	}
@@ -211,10 +353,30 @@ void Waiting::onUpdate(const struct timespec& time)
 		return;
 	}
 }
+bool Waiting::onCommand(const std::vector<std::string>& args)
+{
+	if(args.size() == 4 && args[1].compare("weight") == 0)
+	{
+		if(!mReleaseDetector.setWeight(args[2], atof(args[3].c_str())))return false;
+		mReleaseDetector.showState();
+		return true;
+	}
+	if(args.size() == 3 && args[1].compare("threshold") == 0)
+	{
+		mReleaseDetector.setThreshold(atof(args[2].c_str()));
+		mReleaseDetector.showState();
+		return true;
+	}
+	mReleaseDetector.showState();
+	Debug::print(LOG_PRINT, "waiting weight [freefall/pressure/light] [weight] : set weight of vote\r\n\
+waiting threshold [confidence]                  : set confidence to detect release\r\n");
+	return true;
+}
 Waiting::Waiting()
 {
 	setName("waiting");
 	setPriority(TASK_PRIORITY_SEQUENCE,TASK_INTERVAL_SEQUENCE);
+	setPeriod(TASK_PERIOD_SEQUENCE,TASK_DEADLINE_SEQUENCE);
 }
 Waiting::~Waiting(){}
 
@@ -228,13 +390,12 @@ bool Falling::onInit(const struct timespec& time)
 	Time::showNowTime();
 
         mOnInit=true;
-	mStartTime = mLastCheckTime = time;
-	mLastPressure = 0;
-	mContinuousPressureCount = 0;
+	mStartTime = mLastCheckTime = mLastMovingTime = time;
+	mIsPressureLanded = false;
 	mCoutinuousGyroCount = 0;
 
 	//必要なタスクを使用できるようにする
-	TaskManager::getInstance()->setRunMode(false);
+	TaskManager::getInstance()->beginTransition();
 	setRunMode(true);
 	gBuzzer.setRunMode(true);
 	gPressureSensor.setRunMode(true);
@@ -253,9 +414,10 @@ bool Falling::onInit(const struct timespec& time)
 	gBackStabiServo.moveHold();
 	gSoftCameraServo.moveHold();
 
-	//空撮開始処理(端末から、バックグラウンド処理で空撮用コマンドを実行)
+	//空撮開始処理(カメラのタスクが取り込んだフレームを別スレッドで動画に書き込む)
 	Debug::print(LOG_SUMMARY, "Start aerial recording\r\n");
-	system("python /home/pi/high-ball-server/video/record.py aerialvideo &");
+	gWebCamera.setRunMode(true);
+	gWebCamera.start();
 
 	return true;
 }
@@ -268,8 +430,16 @@ void Falling::onUpdate(const struct timespec& time)
 		gSoftCameraServo.moveHold();
 		mOnInit=false;
 	}
-	//初回のみ気圧を取得
-	if(mLastPressure == 0)mLastPressure = gPressureSensor.get();
+	//気圧から求めた鉛直速度がほぼ0の状態が一定時間続いたら、気圧からは着地とみなす
+	PressureSensor::Snapshot pressure;
+	gPressureSensor.getSnapshot(pressure);
+	if(gPressureSensor.isActive() && (!pressure.isBaselineReady || fabs(pressure.verticalSpeed) > FALLING_LANDING_SPEED || pressure.verticalSpeedVariance > FALLING_LANDING_SPEED * FALLING_LANDING_SPEED))mLastMovingTime = time;
+	bool isPressureLanded = Time::dt(time,mLastMovingTime) * 1000 >= FALLING_LANDING_TIME;
+	if(isPressureLanded != mIsPressureLanded)
+	{
+		mIsPressureLanded = isPressureLanded;
+		Debug::print(LOG_SUMMARY, "Pressure %s (%.1f m, %.2f m/s)\r\n",isPressureLanded ? "Landed" : "Moving",pressure.altitude,pressure.verticalSpeed);
+	}
 
 	//角速度が閾値以下ならカウント
 	if(gGyroSensor.getRvx() < FALLING_GYRO_THRESHOLD && gGyroSensor.getRvy() < FALLING_GYRO_THRESHOLD && gGyroSensor.getRvz() < FALLING_GYRO_THRESHOLD)
@@ -277,18 +447,17 @@ void Falling::onUpdate(const struct timespec& time)
 		if(mCoutinuousGyroCount < FALLING_GYRO_COUNT)++mCoutinuousGyroCount;
 	}else mCoutinuousGyroCount = 0;
 
+	//気圧と角速度から着地と判断できれば次の状態に移行
+	if(mIsPressureLanded && mCoutinuousGyroCount >= FALLING_GYRO_COUNT)
+	{
+		nextState();
+		return;
+	}
+
 	//1秒ごとに以下の処理を行う
 	if(Time::dt(time,mLastCheckTime) < 1)return;
 	mLastCheckTime = time;
 
-	//気圧の差が一定以下ならカウント
-	int newPressure = gPressureSensor.get();
-	if(abs((int)(newPressure - mLastPressure)) < FALLING_DELTA_PRESSURE_THRESHOLD)
-	{
-		if(mContinuousPressureCount < FALLING_PRESSURE_COUNT)++mContinuousPressureCount;
-	}else mContinuousPressureCount = 0;
-	mLastPressure = newPressure;
-
 	//エンコーダの値の差が一定以上ならカウント
 	unsigned long long newMotorPulseL = gMotorDrive.getL(), newMotorPulseR = gMotorDrive.getR();
 	if(newMotorPulseL - mLastMotorPulseL > FALLING_MOTOR_PULSE_THRESHOLD || newMotorPulseR - mLastMotorPulseR > FALLING_MOTOR_PULSE_THRESHOLD)
@@ -297,7 +466,7 @@ void Falling::onUpdate(const struct timespec& time)
 	}else mContinuousMotorPulseCount = 0;
 
 	//判定状態を表示
-	Debug::print(LOG_SUMMARY, "Pressure Count   %d / %d (%d hPa)\r\n",mContinuousPressureCount,FALLING_PRESSURE_COUNT,newPressure);
+	Debug::print(LOG_SUMMARY, "Pressure         %s (%.1f m, %.2f +- %.2f m/s)\r\n",mIsPressureLanded ? "Landed" : "Moving",pressure.altitude,pressure.verticalSpeed,sqrt(pressure.verticalSpeedVariance));
 	Debug::print(LOG_SUMMARY, "Gyro Count       %d / %d\r\n",mCoutinuousGyroCount,FALLING_GYRO_COUNT);
 	Debug::print(LOG_SUMMARY, "MotorPulse Count %d / %d (%llu,%llu)\r\n",mContinuousMotorPulseCount,FALLING_MOTOR_PULSE_COUNT,newMotorPulseL - mLastMotorPulseL,newMotorPulseR - mLastMotorPulseR);
 
@@ -310,7 +479,7 @@ void Falling::onUpdate(const struct timespec& time)
 	else Debug::print(LOG_SUMMARY, "GPS Position     Unable to get\r\n");
 
 	//カウント回数が一定以上なら次の状態に移行
-	if(mContinuousPressureCount >= FALLING_PRESSURE_COUNT && (mCoutinuousGyroCount >= FALLING_GYRO_COUNT || mContinuousMotorPulseCount >= FALLING_MOTOR_PULSE_COUNT))
+	if(mIsPressureLanded && mContinuousMotorPulseCount >= FALLING_MOTOR_PULSE_COUNT)
 	{
 		nextState();
 		return;
@@ -332,10 +501,11 @@ void Falling::nextState()
 
 	Debug::print(LOG_SUMMARY, "Falling Finished!\r\n");
 }
-Falling::Falling() : mLastPressure(0),mLastMotorPulseL(0),mLastMotorPulseR(0),mContinuousPressureCount(0),mCoutinuousGyroCount(0),mContinuousMotorPulseCount(0)
+Falling::Falling() : mIsPressureLanded(false),mLastMotorPulseL(0),mLastMotorPulseR(0),mCoutinuousGyroCount(0),mContinuousMotorPulseCount(0)
 {
 	setName("falling");
 	setPriority(TASK_PRIORITY_SEQUENCE,TASK_INTERVAL_SEQUENCE);
+	setPeriod(TASK_PERIOD_SEQUENCE,TASK_DEADLINE_SEQUENCE);
 }
 Falling::~Falling()
 {
@@ -351,7 +521,7 @@ bool Separating::onInit(const struct timespec& time)
 	Time::showNowTime();
 
 	//必要なタスクを使用できるようにする
-	TaskManager::getInstance()->setRunMode(false);
+	TaskManager::getInstance()->beginTransition();
 	setRunMode(true);
 	gBuzzer.setRunMode(true);
 	gParaServo.setRunMode(true);
@@ -365,25 +535,9 @@ bool Separating::onInit(const struct timespec& time)
 	gSoftCameraServo.setRunMode(true);
 	gPoseDetecting.setRunMode(true);//方向角度検知　８－２４　ちょう
 
-	//録画停止処理　pid(process id)指定してkill
-	//pid読み込む
-	ifstream ifs("/home/pi/high-ball-server/video/video_pid");
-	string str, command;
-	if(ifs.good())
-	{
-		//pidファイルが読み込めた
-
-		//pid指定して空撮処理をkill
-		//kill -9 [pid]
-		getline(ifs, str);
-		command = "kill -9 " + str;
-		system(command.c_str());
-		Debug::print(LOG_SUMMARY, "Aerial recording finished\r\n");
-	}else
-	{
-		//pidファイルが無い
-		Debug::print(LOG_SUMMARY, "Pid file does not exist\r\n");
-	}
+	//録画停止処理(残りのフレームを書き込んでからファイルを閉じる)
+	gWebCamera.stop();
+	Debug::print(LOG_SUMMARY, "Aerial recording finished\r\n");
 
 	//動画配信開始
 	system("python /home/pi/high-ball-server/websocket_upload/websocket_sendvideo_mp.py &");
@@ -440,12 +594,12 @@ void Separating::onUpdate(const struct timespec& time)
 	case STEP_PRE_PARA_JUDGE:
 		//起き上がり動作を実行し、画像処理を行う前に1秒待機して画像のブレを防止する
 		if(gWakingState.isActive())mLastUpdateTime = time;//起き上がり動作中は待機する
+		if(gCameraCapture.isInitializing())mLastUpdateTime = time;//カメラの初期化中は待機する
 		if(Time::dt(time,mLastUpdateTime) > 1)//起き上がり動作後1秒待機する
 		{
 			//次状態に遷移
 			mLastUpdateTime = time;
 			mCurStep = STEP_GO_FORWARD;
-			gCameraCapture.startWarming();
 		}
 		break;
 /*	case STEP_PARA_JUDGE:
@@ -504,6 +658,7 @@ Separating::Separating() : mCurServoState(false),mServoCount(0)
 {
 	setName("separating");
 	setPriority(TASK_PRIORITY_SEQUENCE,TASK_INTERVAL_SEQUENCE);
+	setPeriod(TASK_PERIOD_SEQUENCE,TASK_DEADLINE_SEQUENCE);
 }
 Separating::~Separating()
 {
@@ -22,14 +22,55 @@ public:
 	~Testing();
 };
 
+//放出判定クラス
+//自由落下(加速度)、気圧の上昇(降下)、明るさをそれぞれ短い時間窓で検出し、重み付きの多数決で放出を判定する
+class ReleaseDetector
+{
+public:
+	enum SIGNAL {SIGNAL_FREEFALL, SIGNAL_PRESSURE, SIGNAL_LIGHT, SIGNAL_COUNT};
+private:
+	double mDescentSpeed, mDescentSigma;//気圧から求めた降下速度とその推定誤差(m/s、表示用)
+	struct timespec mLastPressureTime,mLastAccelTime;//最後に使ったセンサの更新時刻
+
+	bool mIsFreefall;//自由落下中
+	struct timespec mFreefallStartTime;//自由落下が始まった時刻
+
+	bool mIsDetected[SIGNAL_COUNT];//各センサが現在検出しているか
+	bool mIsVoting[SIGNAL_COUNT];//投票に加わっているか(検出してからRELEASE_VOTE_WINDOWの間)
+	struct timespec mLastDetectedTime[SIGNAL_COUNT];
+	double mWeights[SIGNAL_COUNT];//投票の重み
+	double mThreshold;//放出判定とする確信度
+	double mConfidence;//確信度(投票に加わっているセンサの重みの割合)
+
+	void updateFreefall(const struct timespec& time);
+	void updatePressure(const struct timespec& time);
+	void updateLight(const struct timespec& time);
+public:
+	static const char* getSignalName(SIGNAL signal);
+
+	//判定を最初からやり直す
+	void reset(const struct timespec& time);
+	//センサの値を確認し、放出と判定した場合はtrueを返す
+	bool update(const struct timespec& time);
+	double getConfidence() const;
+
+	//投票の重みを設定する(nameはfreefall/pressure/light、見つからなければfalse)
+	bool setWeight(const std::string& name, double weight);
+	void setThreshold(double threshold);
+	void showState() const;
+
+	ReleaseDetector();
+};
+
 //筒の中に入っている状態
 class Waiting : public TaskBase
 {
 	struct timespec mStartTime;//状態開始時刻
-	unsigned int mContinuousLightCount;//光っていることが検知された回数
+	ReleaseDetector mReleaseDetector;
 protected:
 	virtual bool onInit(const struct timespec& time);
 	virtual void onUpdate(const struct timespec& time);
+	virtual bool onCommand(const std::vector<std::string>& args);
 
 	//次の状態に移行
 	void nextState();
@@ -46,9 +87,9 @@ private:
 	bool mOnInit;//能代
 	struct timespec mStartTime;//状態開始時刻
 	struct timespec mLastCheckTime;//前回のチェック時刻
-	int mLastPressure;//前回の気圧
+	struct timespec mLastMovingTime;//気圧から求めた鉛直速度が最後に閾値を超えていた時刻
+	bool mIsPressureLanded;//気圧から見て着地しているか
 	unsigned long long mLastMotorPulseL,mLastMotorPulseR;//前回チェック時のモーター回転数
-	unsigned int mContinuousPressureCount;//気圧が閾値以下の状態が続いた回数
 	unsigned int mCoutinuousGyroCount;//角速度が閾値以下の状態が続いた回数
 	unsigned int mContinuousMotorPulseCount;//モータ回転数が閾値以上の状態が続いた回数
 protected:
@@ -8,13 +8,15 @@
 #include "utils.h"
 #include "serial_command.h"
 #include "motor.h"
+#include "recorder.h"
 
 SerialCommand gSerialCommand;
 
 void SerialCommand::onUpdate(const struct timespec& time)
 {
 	int c;
-	while((c = getchar()) != EOF)
+	//入力された文字は記録/再生の対象(再生中は記録された文字のみを使う)
+	while((c = Recorder::value(Recorder::EVENT_INPUT, 0, Recorder::isReplaying() ? EOF : getchar())) != EOF)
 	{
 		mCommandBuffer.insert(mCursorPos,(char*)(&c),1);
 		bool need2update = false;
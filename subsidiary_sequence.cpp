@@ -14,6 +14,7 @@
 #include "motor.h"
 #include "image_proc.h"
 #include "constants.h"
+#include "telemetry.h"
 //Escaping gEscapingState;
 //EscapingRandom gEscapingRandomState;
 //EscapingByStabi gEscapingByStabiState;
@@ -169,7 +170,6 @@ void Escaping::onUpdate(const struct timespec& time)
 			mCurStep = STEP_AFTER_BACKWARD;
 			mLastUpdateTime = time;
 			gMotorDrive.drive(0);
-			gCameraCapture.startWarming();
 		}
 		break;
 	case STEP_AFTER_BACKWARD:
@@ -203,7 +203,6 @@ void Escaping::onUpdate(const struct timespec& time)
 			mCurStep = STEP_CAMERA;
 			mLastUpdateTime = time;
 			gMotorDrive.drive(0);
-			gCameraCapture.startWarming();
 		}
 		break;
 	case STEP_CAMERA:
@@ -223,7 +222,6 @@ void Escaping::onUpdate(const struct timespec& time)
 		//???????????A??]????K?v??????????
 		if(Time::dt(time,mLastUpdateTime) > 0.4 || abs(gGyroSensor.getRz() - mAngle) > 70)
 		{
-			gCameraCapture.startWarming();
 			mCurStep = STEP_CAMERA_FORWARD;
 			gMotorDrive.startPID(0,100);
 			mLastUpdateTime = time;
@@ -242,7 +240,6 @@ void Escaping::onUpdate(const struct timespec& time)
 		//???????????A??????]????K?v??????????
 		if(Time::dt(time,mLastUpdateTime) > 0.4 || abs(gGyroSensor.getRz() - mAngle) > 70)
 		{
-			gCameraCapture.startWarming();
 			mCurStep = STEP_BACKWARD;
 			gMotorDrive.drive(-100);
 			mLastUpdateTime = time;
@@ -695,6 +692,7 @@ Waking::Waking() : mWakeRetryCount(0),mStartPower(100),mAngleThreshold(70),mDeac
 {
 	setName("waking");
 	setPriority(TASK_PRIORITY_SEQUENCE,TASK_INTERVAL_SEQUENCE);
+	setPeriod(TASK_PERIOD_SEQUENCE,TASK_DEADLINE_SEQUENCE);
 }
 Waking::~Waking()
 {
@@ -836,71 +834,34 @@ bool SensorLogging::onInit(const struct timespec& time)
 {
 	Debug::print(LOG_SUMMARY, "Log: Enabled\r\n");
 
-	write(mFilenameGPS,"Log started\r\n");
-	write(mFilenameGyro,"Log started\r\n");
-	write(mFilenamePressure,"Log started\r\n");
-	//write(mFilenameEncoder,"Log started\r\n");
+	//eZT͓ǂݍ񂾃Tv̂܂TelemetryɋL^
+	if(!Telemetry::start())return false;
 
 	gGyroSensor.setRunMode(true);
+	gAccelerationSensor.setRunMode(true);
 	gGPSSensor.setRunMode(true);
 	gPressureSensor.setRunMode(true);
 	gMotorDrive.setRunMode(true);
 	mLastUpdateTime = time;
-	//mLastEncL = gMotorDrive.getL();
-	//mLastEncR = gMotorDrive.getR();
 	return true;
 }
 void SensorLogging::onUpdate(const struct timespec& time)
 {
-	if(Time::dt(time,mLastUpdateTime) >= 1)
+	//obt@tɂȂȂĂԊuŏ
+	if(Time::dt(time,mLastUpdateTime) >= TELEMETRY_FLUSH_PERIOD)
 	{
 		mLastUpdateTime = time;
-
-		//???O????
-		VECTOR3 vec;
-		gGPSSensor.get(vec);
-		if(gGPSSensor.isActive())write(mFilenameGPS,"%f,%f,%f\r\n",vec.x,vec.y,vec.z);
-		else write(mFilenameGPS,"unavailable\r\n");
-
-		if(gGyroSensor.isActive())write(mFilenameGyro,"%f,%f,%f,%f,%f,%f\r\n",gGyroSensor.getRvx(),gGyroSensor.getRvy(),gGyroSensor.getRvz(),gGyroSensor.getRx(),gGyroSensor.getRy(),gGyroSensor.getRz());
-		else write(mFilenameGyro,"unavailable\r\n");
-
-		if(gPressureSensor.isActive())write(mFilenamePressure,"%d\r\n",gPressureSensor.get());
-		else write(mFilenamePressure,"unavailable\r\n");
-
-		//if(gMotorDrive.isActive())
-		//{
-		//	write(mFilenameEncoder,"%llu,%llu\r\n",gMotorDrive.getL() - mLastEncL,gMotorDrive.getR() - mLastEncR);
-		//	mLastEncL = gMotorDrive.getL();
-		//	mLastEncR = gMotorDrive.getR();
-		//}else write(mFilenameEncoder,"unavailable\r\n");
+		Telemetry::flush();
 	}
 }
-void SensorLogging::write(const std::string& filename, const char* fmt, ... )
+void SensorLogging::onClean()
 {
-	std::ofstream of(filename.c_str(),std::ios::out | std::ios::app);
-
-	char buf[MAX_STRING_LENGTH];
-
-	va_list argp;
-	va_start(argp, fmt);
-	vsprintf(buf, fmt, argp);
-
-	of << buf;
+	Telemetry::stop();
 }
 SensorLogging::SensorLogging() : mLastUpdateTime()
 {
 	setName("sensorlogging");
 	setPriority(UINT_MAX,TASK_INTERVAL_SEQUENCE);
-
-	Filename("log_gps",".txt").get(mFilenameGPS);
-	Debug::print(LOG_SUMMARY, "%s\r\n",mFilenameGPS.c_str());
-	Filename("log_gyro",".txt").get(mFilenameGyro);
-	Debug::print(LOG_SUMMARY, "%s\r\n",mFilenameGyro.c_str());
-	Filename("log_pressure",".txt").get(mFilenamePressure);
-	Debug::print(LOG_SUMMARY, "%s\r\n",mFilenamePressure.c_str());
-	//Filename("log_encoder_by_sensorlogging",".txt").get(mFilenameEncoder);
-	//Debug::print(LOG_SUMMARY, "%s\r\n",mFilenameEncoder.c_str());
 }
 SensorLogging::~SensorLogging()
 {
@@ -158,13 +158,10 @@ public:
 class SensorLogging : public TaskBase
 {
 	struct timespec mLastUpdateTime;
-	std::string mFilenameGPS,mFilenameGyro,mFilenamePressure,mFilenameEncoder;
-	unsigned long long mLastEncL,mLastEncR;
 protected:
 	virtual bool onInit(const struct timespec& time);
 	virtual void onUpdate(const struct timespec& time);
-
-	void write(const std::string& filename,const char* fmt, ... );
+	virtual void onClean();
 public:
 	SensorLogging();
 	~SensorLogging();
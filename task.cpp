@@ -6,8 +6,72 @@
 #include <stdio.h>
 #include "utils.h"
 #include "task.h"
+#include "recorder.h"
 
-TaskBase::TaskBase() : mpName(0),mPriority(UINT_MAX),mInterval(UINT_MAX),mSlept(0),mIsRunning(false),mNewRunningState(false),mInitializeRetryCount(0)
+TaskProfile::TaskProfile()
+{
+    reset();
+}
+unsigned long long TaskProfile::now()
+{
+    //CLOCK_MONOTONICはvDSOで取得できるため、システムコールを発生させずに計測できる
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC,&time);
+    return (unsigned long long)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+void TaskProfile::add(KIND kind, unsigned long long elapsed, unsigned long long budget)
+{
+    Histogram& histogram = mHistograms[kind];
+    unsigned int index = 63 - __builtin_clzll(elapsed | 1);
+    if(index >= BUCKET_COUNT)index = BUCKET_COUNT - 1;
+    ++histogram.buckets[index];
+    ++histogram.count;
+    if(elapsed > budget)++histogram.overrun;
+    if(elapsed < histogram.min)histogram.min = elapsed;
+    if(elapsed > histogram.max)histogram.max = elapsed;
+}
+unsigned long long TaskProfile::getPercentile(const Histogram& histogram, unsigned int percent)
+{
+    //何回目の呼び出しまでに指定した割合に達するか(切り上げ)
+    unsigned long long rank = ((unsigned long long)histogram.count * percent + 99) / 100;
+    unsigned long long sum = 0;
+    for(unsigned int i = 0;i < BUCKET_COUNT;++i)
+    {
+        sum += histogram.buckets[i];
+        if(sum >= rank)
+        {
+            unsigned long long upper = (2ULL << i) - 1;
+            if(upper > histogram.max)upper = histogram.max;
+            if(upper < histogram.min)upper = histogram.min;
+            return upper;
+        }
+    }
+    return histogram.max;
+}
+void TaskProfile::print(const char* name) const
+{
+    const static char* KIND_NAMES[PROFILE_KIND_COUNT] = {"init","update","clean","command"};
+    for(unsigned int i = 0;i < PROFILE_KIND_COUNT;++i)
+    {
+        const Histogram& histogram = mHistograms[i];
+        if(histogram.count == 0)continue;
+        Debug::print(LOG_PRINT, " %-16s %-8s %8u %9.1f %9.1f %9.1f %9.1f %7u\r\n", name, KIND_NAMES[i], histogram.count,
+            histogram.min / 1000.0, getPercentile(histogram, 50) / 1000.0, getPercentile(histogram, 99) / 1000.0, histogram.max / 1000.0, histogram.overrun);
+    }
+}
+void TaskProfile::reset()
+{
+    for(unsigned int i = 0;i < PROFILE_KIND_COUNT;++i)
+    {
+        Histogram& histogram = mHistograms[i];
+        histogram.count = histogram.overrun = 0;
+        histogram.min = ULLONG_MAX;
+        histogram.max = 0;
+        for(unsigned int j = 0;j < BUCKET_COUNT;++j)histogram.buckets[j] = 0;
+    }
+}
+
+TaskBase::TaskBase() : mpName(0),mPriority(UINT_MAX),mInterval(UINT_MAX),mPeriod(0),mDeadline(0),mNextUpdateTime(0),mUpdatedRound(0),mDeadlineMissCount(0),mIsRunning(false),mNewRunningState(false),mInitializeRetryCount(0),mIsAsyncInit(false),mIsInitializing(false),mIsInitFinished(false),mInitResult(false),mInitElapsed(0)
 {
     getManager()->add(this);
 }
@@ -40,12 +104,40 @@ void TaskBase::setPriority(unsigned int pri,unsigned int interval)
     mPriority = pri;
     mInterval = interval;
 
+    //実行間隔を実行周期に換算する
+    if(interval != UINT_MAX)setPeriod((interval + 1) * TASK_TICK_PERIOD);
+
     getManager()->sortByPriority();
 }
+void TaskBase::setPeriod(unsigned long long period,unsigned long long deadline)
+{
+    if(period == 0)period = 1;
+    mPeriod = period;
+    mDeadline = (deadline == 0) ? period : deadline;
+}
+void TaskBase::setAsyncInit(bool async)
+{
+    mIsAsyncInit = async;
+}
 bool TaskBase::isActive()
 {
     return mIsRunning;
 }
+bool TaskBase::isInitializing()
+{
+    return mIsInitializing;
+}
+void* TaskBase::initThread(void* arg)
+{
+    //初期化スレッド：onInitを呼び出して結果を保存する(結果の反映はTaskManagerのupdateで行う)
+    TaskBase* pTask = (TaskBase*)arg;
+    unsigned long long start = TaskProfile::now();
+    pTask->mInitResult = pTask->onInit(pTask->mInitTime);
+    pTask->mInitElapsed = TaskProfile::now() - start;
+    __sync_synchronize();
+    pTask->mIsInitFinished = true;
+    return NULL;
+}
 TaskManager* TaskBase::getManager()
 {
     return TaskManager::getInstance();
@@ -68,7 +160,7 @@ void TaskBase::onUpdate(const struct timespec& time)
 {
 }
 
-TaskManager::TaskManager()
+TaskManager::TaskManager() : mUpdateRound(0),mIsTransitionPending(false),mIsInTransition(false),mTransitionStoppedCount(0),mTransitionStartedCount(0),mMinimumPeriod(0)
 {
 }
 TaskManager::~TaskManager()
@@ -92,9 +184,22 @@ void TaskManager::clean()
     std::vector<TaskBase*>::iterator it = mTasks.begin();
     while(it != mTasks.end())
     {
+        if(*it != NULL)if((**it).mIsInitializing)
+        {
+            //初期化中のタスクは初期化が終わるのを待ってから開放する
+            pthread_join((*it)->mInitThread, NULL);
+            (*it)->mIsInitializing = false;
+            if((*it)->mInitResult)(*it)->mIsRunning = true;
+        }
         if(*it != NULL)if((**it).mIsRunning)
         {
+#ifdef USE_TASK_PROFILE
+            unsigned long long profileStart = TaskProfile::now();
             (*it)->onClean();
+            (*it)->mProfile.add(TaskProfile::PROFILE_CLEAN, TaskProfile::now() - profileStart, TASK_PROFILE_BUDGET * 1000);
+#else
+            (*it)->onClean();
+#endif
             (*it)->mIsRunning = false;
         }
         ++it;
@@ -125,7 +230,14 @@ bool TaskManager::command(const std::string& arg)
             //コマンド実行対象のタスクが見つかったらコマンドを実行
             if(args[0].compare(pTask->mpName) == 0)
             {
+#ifdef USE_TASK_PROFILE
+                unsigned long long profileStart = TaskProfile::now();
+                bool result = pTask->onCommand(args);
+                pTask->mProfile.add(TaskProfile::PROFILE_COMMAND, TaskProfile::now() - profileStart, TASK_PROFILE_BUDGET * 1000);
+                if(result)return true;
+#else
                 if(pTask->onCommand(args))return true;
+#endif
                 else
                 {
                     Debug::print(LOG_SUMMARY, "Failed to exec command! (Error on task)\r\n");
@@ -142,6 +254,9 @@ bool TaskManager::command(const std::string& arg)
         Debug::print(LOG_PRINT, " start [task name]      : start task\r\n");
         Debug::print(LOG_PRINT, " stop [task name]       : stop task\r\n");
         Debug::print(LOG_PRINT, " list                   : enumerate tasks\r\n");
+#ifdef USE_TASK_PROFILE
+        Debug::print(LOG_PRINT, " profile                : show and reset task timings\r\n");
+#endif
 #ifdef USE_ALIAS
         Debug::print(LOG_PRINT, " alias                  : enumerate aliases\r\n");
         Debug::print(LOG_PRINT, " alias [alias] [command]: add new alias\r\n");
@@ -159,14 +274,16 @@ bool TaskManager::command(const std::string& arg)
 void TaskManager::enumTasks()
 {
     //すべてのタスクとその状態を列挙して表示
-    Debug::print(LOG_PRINT, "\r\n Active Priority Interval Name\r\n");
+    Debug::print(LOG_PRINT, "\r\n Active Priority Period(us) Deadline(us) Missed Name\r\n");
     std::vector<TaskBase*>::iterator it = mTasks.begin();
     while(it != mTasks.end())
     {
         TaskBase* pTask = *it;
         if(pTask != NULL)
         {
-            Debug::print(LOG_PRINT, " %s %8d %8d %s\r\n",pTask->mIsRunning ? "Yes   " : "No    ",pTask->mPriority,pTask->mInterval,pTask->mpName);
+            const char* state = pTask->mIsInitializing ? "Init  " : (pTask->mIsRunning ? "Yes   " : "No    ");
+            if(pTask->mInterval == UINT_MAX)Debug::print(LOG_PRINT, " %s %8u %10s %12s %6s %s\r\n",state,pTask->mPriority,"-","-","-",pTask->mpName);
+            else Debug::print(LOG_PRINT, " %s %8u %10llu %12llu %6u %s\r\n",state,pTask->mPriority,pTask->mPeriod,pTask->mDeadline,pTask->mDeadlineMissCount,pTask->mpName);
         }
         ++it;
     }
@@ -175,56 +292,244 @@ void TaskManager::enumTasks()
 void TaskManager::update()
 {
 	struct timespec newTime;
-	if(clock_gettime(CLOCK_MONOTONIC_RAW,&newTime) != 0)
-	{
-		Debug::print(LOG_DETAIL, "FAILED to get time!\r\n");
-	}
+	Time::get(newTime);
+	unsigned long long now = Time::toMicroseconds(newTime);
+
+    //実行時刻を過ぎたタスクのupdate処理を締め切りの早い順に実行(1回のupdateで各タスク最大1回)
+    ++mUpdateRound;
+    std::vector<TaskBase*>::iterator it;
+    while(true)
+    {
+        TaskBase* pNextTask = NULL;
+        for(it = mTasks.begin();it != mTasks.end();++it)
+        {
+            TaskBase* pTask = *it;
+            //mIntervalがUINT_MAXならupdate不要なタスク
+            if(pTask == NULL || pTask->mInterval == UINT_MAX || !pTask->mIsRunning || pTask->mUpdatedRound == mUpdateRound)continue;
+            if(pTask->mNextUpdateTime > now)continue;
+            //締め切りが同じ場合は優先度の高いタスクを先に実行する
+            if(pNextTask == NULL || pTask->mNextUpdateTime + pTask->mDeadline < pNextTask->mNextUpdateTime + pNextTask->mDeadline)pNextTask = pTask;
+        }
+        if(pNextTask == NULL)break;
+
+        pNextTask->mUpdatedRound = mUpdateRound;
+#ifdef USE_TASK_PROFILE
+        unsigned long long profileStart = TaskProfile::now();
+        pNextTask->onUpdate(newTime);
+        pNextTask->mProfile.add(TaskProfile::PROFILE_UPDATE, TaskProfile::now() - profileStart, pNextTask->mDeadline * 1000);
+#else
+        pNextTask->onUpdate(newTime);
+#endif
+
+        Time::get(newTime);
+        now = Time::toMicroseconds(newTime);
+        if(now > pNextTask->mNextUpdateTime + pNextTask->mDeadline)
+        {
+            ++pNextTask->mDeadlineMissCount;
+            Debug::print(LOG_DETAIL, "Task %s missed deadline (%llu us late)\r\n", pNextTask->mpName, now - pNextTask->mNextUpdateTime - pNextTask->mDeadline);
+        }
 
-    //タスクのupdate処理を実行
+        //次の実行時刻を設定(処理が間に合わなかった周期は飛ばし、位相は保つ)
+        unsigned long long period = pNextTask->mPeriod < mMinimumPeriod ? mMinimumPeriod : pNextTask->mPeriod;
+        pNextTask->mNextUpdateTime += period;
+        if(pNextTask->mNextUpdateTime <= now)pNextTask->mNextUpdateTime += ((now - pNextTask->mNextUpdateTime) / period + 1) * period;
+    }
+
+    //タスクの実行状態を切り替え(停止するタスクをすべて開放してから、開始するタスクを初期化する)
+    //初期化中に状態遷移が始まった場合は、同じupdate内で続けて切り替える
+    for(unsigned int pass = 0;pass < TASK_MAX_TRANSITION_PASS_COUNT;++pass)
+    {
+        mIsTransitionPending = false;
+
+        //停止するタスクを開放
+        for(it = mTasks.begin();it != mTasks.end();++it)
+        {
+            TaskBase* pTask = *it;
+            if(pTask == NULL)continue;
+            if(pTask->mIsInitializing)
+            {
+                //初期化スレッドが終わっていれば結果を反映する(終わるまでは他のタスクの処理を続ける)
+                if(pTask->mIsInitFinished)
+                {
+                    finishAsyncInit(pTask);
+                    pTask->mNextUpdateTime = now;
+                }
+                continue;
+            }
+            if(pTask->mIsRunning && !pTask->mNewRunningState && pTask->mInitializeRetryCount < TASK_MAX_INITIALIZE_RETRY_COUNT)
+            {
+                ++pTask->mInitializeRetryCount;
+                //実行停止する場合：onCleanを呼び出し
+#ifdef USE_TASK_PROFILE
+                unsigned long long profileStart = TaskProfile::now();
+                pTask->onClean();
+                pTask->mProfile.add(TaskProfile::PROFILE_CLEAN, TaskProfile::now() - profileStart, TASK_PROFILE_BUDGET * 1000);
+#else
+                pTask->onClean();
+#endif
+                pTask->mIsRunning = false;
+                pTask->mNextUpdateTime = now;
+                if(mIsInTransition)++mTransitionStoppedCount;
+            }
+        }
+
+        //開始するタスクを初期化
+        for(it = mTasks.begin();it != mTasks.end();++it)
+        {
+            TaskBase* pTask = *it;
+            if(pTask == NULL || pTask->mIsInitializing)continue;
+            if(!pTask->mIsRunning && pTask->mNewRunningState && pTask->mInitializeRetryCount < TASK_MAX_INITIALIZE_RETRY_COUNT)
+            {
+                ++pTask->mInitializeRetryCount;
+                if(pTask->mIsAsyncInit && Recorder::getMode() == Recorder::MODE_NONE)
+                {
+                    //別スレッドで初期化する場合：スレッドを開始し、結果は初期化が終わった後のupdateで反映
+                    if(startAsyncInit(pTask, newTime))
+                    {
+                        if(mIsInTransition)++mTransitionStartedCount;
+                    }else Debug::print(LOG_SUMMARY, "FAILED to start initializing task %s (%d/%d)\r\n", pTask->mpName,pTask->mInitializeRetryCount,TASK_MAX_INITIALIZE_RETRY_COUNT);
+                }else
+                {
+                    //実行開始する場合：onInitを呼び出し、成功した場合は実行中状態に設定
+#ifdef USE_TASK_PROFILE
+                    unsigned long long profileStart = TaskProfile::now();
+                    bool result = pTask->onInit(newTime);
+                    pTask->mProfile.add(TaskProfile::PROFILE_INIT, TaskProfile::now() - profileStart, TASK_PROFILE_BUDGET * 1000);
+#else
+                    bool result = pTask->onInit(newTime);
+#endif
+                    if(result)
+                    {
+                        pTask->mIsRunning = pTask->mNewRunningState;
+                        if(mIsInTransition)++mTransitionStartedCount;
+                    }
+                    else Debug::print(LOG_SUMMARY, "FAILED to initialize task %s (%d/%d)\r\n", pTask->mpName,pTask->mInitializeRetryCount,TASK_MAX_INITIALIZE_RETRY_COUNT);//失敗した場合はログ出力
+                }
+                pTask->mNextUpdateTime = now;
+            }
+        }
+
+        if(!mIsTransitionPending)break;
+    }
+
+    //状態遷移が完了したら結果を表示
+    if(mIsInTransition && !mIsTransitionPending)
+    {
+        unsigned int activeCount = 0;
+        for(it = mTasks.begin();it != mTasks.end();++it)
+        {
+            TaskBase* pTask = *it;
+            if(pTask != NULL && (pTask->mIsRunning || pTask->mIsInitializing))++activeCount;
+        }
+        struct timespec endTime;
+        Time::get(endTime);
+        Debug::print(LOG_SUMMARY, "Transition: %u stopped, %u started, %u kept (%.2f ms)\r\n", mTransitionStoppedCount, mTransitionStartedCount,
+            activeCount > mTransitionStartedCount ? activeCount - mTransitionStartedCount : 0, Time::dt(endTime, mTransitionStartTime) * 1000);
+        mIsInTransition = false;
+    }
+}
+
+void TaskManager::wait()
+{
+    //再生中は仮想時計で動くため、待たずに次のupdateへ進む
+    if(Recorder::isReplaying())return;
+
+    //時刻の記録と再生が一致するように、ここではTime::getを使わない
+    struct timespec curTime;
+    clock_gettime(CLOCK_MONOTONIC_RAW,&curTime);
+    unsigned long long now = Time::toMicroseconds(curTime);
+    unsigned long long nextUpdateTime = now + TASK_MAX_SLEEP_PERIOD;
+
+    //最も早く実行時刻が来るタスクを探す
     std::vector<TaskBase*>::iterator it = mTasks.begin();
     while(it != mTasks.end())
     {
         TaskBase* pTask = *it;
         if(pTask != NULL)
         {
-            if(pTask->mInterval != UINT_MAX && pTask->mIsRunning && (pTask->mInterval <= pTask->mSlept++))
+            //初期化スレッドの終了は一定間隔で確認する
+            if(pTask->mIsInitializing)
             {
-                //実行するタイミングであれば処理を行う(mIntervalがUINT_MAXならupdate不要なタスク)
-                pTask->onUpdate(newTime);
-                pTask->mSlept = 0;
+                if(pTask->mIsInitFinished)return;
+                if(now + TASK_ASYNC_INIT_POLL_PERIOD < nextUpdateTime)nextUpdateTime = now + TASK_ASYNC_INIT_POLL_PERIOD;
+                ++it;
+                continue;
             }
+            //実行状態の切り替えが残っている場合はすぐに返す
+            if(pTask->mIsRunning != pTask->mNewRunningState && pTask->mInitializeRetryCount < TASK_MAX_INITIALIZE_RETRY_COUNT)return;
+            if(pTask->mIsRunning && pTask->mInterval != UINT_MAX && pTask->mNextUpdateTime < nextUpdateTime)nextUpdateTime = pTask->mNextUpdateTime;
         }
         ++it;
     }
+    if(nextUpdateTime <= now)return;
+
+    //次の実行時刻までスリープ(busy-waitせずにCPUを開放する)
+    unsigned long long sleepPeriod = nextUpdateTime - now;
+    struct timespec sleepTime;
+    sleepTime.tv_sec = sleepPeriod / 1000000;
+    sleepTime.tv_nsec = (sleepPeriod % 1000000) * 1000;
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &sleepTime, NULL);
+}
 
-    //タスクの実行状態を切り替え
-    it = mTasks.begin();
+bool TaskManager::startAsyncInit(TaskBase* pTask, const struct timespec& time)
+{
+    pTask->mInitTime = time;
+    pTask->mInitResult = false;
+    pTask->mIsInitFinished = false;
+    pTask->mIsInitializing = true;
+    if(pthread_create(&pTask->mInitThread, NULL, TaskBase::initThread, pTask) != 0)
+    {
+        pTask->mIsInitializing = false;
+        return false;
+    }
+    return true;
+}
+void TaskManager::finishAsyncInit(TaskBase* pTask)
+{
+    pthread_join(pTask->mInitThread, NULL);
+    pTask->mIsInitializing = false;
+#ifdef USE_TASK_PROFILE
+    pTask->mProfile.add(TaskProfile::PROFILE_INIT, pTask->mInitElapsed, TASK_PROFILE_BUDGET * 1000);
+#endif
+
+    if(!pTask->mInitResult)
+    {
+        //失敗した場合はログ出力(実行状態が変わっていなければ次のupdateで再試行する)
+        Debug::print(LOG_SUMMARY, "FAILED to initialize task %s (%d/%d)\r\n", pTask->mpName,pTask->mInitializeRetryCount,TASK_MAX_INITIALIZE_RETRY_COUNT);
+    }else if(pTask->mNewRunningState)
+    {
+        pTask->mIsRunning = true;
+    }else
+    {
+        //初期化中に停止が要求された場合は、初期化が終わった時点で開放する
+#ifdef USE_TASK_PROFILE
+        unsigned long long profileStart = TaskProfile::now();
+        pTask->onClean();
+        pTask->mProfile.add(TaskProfile::PROFILE_CLEAN, TaskProfile::now() - profileStart, TASK_PROFILE_BUDGET * 1000);
+#else
+        pTask->onClean();
+#endif
+    }
+}
+
+#ifdef USE_TASK_PROFILE
+void TaskManager::printProfile()
+{
+    //すべてのタスクの処理時間の統計を表示し、次の計測のためにリセットする
+    Debug::print(LOG_PRINT, "\r\n Name             Kind        Count   Min(us)   P50(us)   P99(us)   Max(us) Overrun\r\n");
+    std::vector<TaskBase*>::iterator it = mTasks.begin();
     while(it != mTasks.end())
     {
         TaskBase* pTask = *it;
         if(pTask != NULL)
         {
-            if(pTask->mIsRunning != pTask->mNewRunningState && pTask->mInitializeRetryCount < TASK_MAX_INITIALIZE_RETRY_COUNT)
-            {
-                ++pTask->mInitializeRetryCount;
-                //実行状態を変更する必要がある場合変更する
-                if(pTask->mIsRunning == false)
-                {
-                    //実行開始する場合：onInitを呼び出し、成功した場合は実行中状態に設定
-                    if(pTask->onInit(newTime))pTask->mIsRunning = pTask->mNewRunningState;
-                    else Debug::print(LOG_SUMMARY, "FAILED to initialize task %s (%d/%d)\r\n", pTask->mpName,pTask->mInitializeRetryCount,TASK_MAX_INITIALIZE_RETRY_COUNT);//失敗した場合はログ出力
-                }else
-                {
-                    //実行停止する場合：onCleanを呼び出し
-                    pTask->onClean();
-                    pTask->mIsRunning = pTask->mNewRunningState;
-                }
-                pTask->mSlept = 0;
-            }
+            pTask->mProfile.print(pTask->mpName != NULL ? pTask->mpName : "(noname)");
+            pTask->mProfile.reset();
         }
         ++it;
     }
 }
+#endif
 
 TaskBase* TaskManager::get(const std::string& name)
 {
@@ -243,6 +548,31 @@ TaskBase* TaskManager::get(const std::string& name)
     }
     return NULL;
 }
+void TaskManager::beginTransition()
+{
+    //すべてのタスクを停止予定にする(実際の切り替えはupdate時に行う)
+    //この後setRunMode(true)されたタスクのうち、実行中のものは開放されずに実行を続ける
+    std::vector<TaskBase*>::iterator it = mTasks.begin();
+    while(it != mTasks.end())
+    {
+        TaskBase* pTask = *it;
+        if(pTask != NULL && pTask->mNewRunningState)
+        {
+            //要求する状態が変わるため、setRunModeと同様に失敗回数を数え直す
+            pTask->mNewRunningState = false;
+            pTask->mInitializeRetryCount = 0;
+        }
+        ++it;
+    }
+    mIsTransitionPending = true;
+    mMinimumPeriod = 0;
+    if(!mIsInTransition)
+    {
+        mIsInTransition = true;
+        mTransitionStoppedCount = mTransitionStartedCount = 0;
+        Time::get(mTransitionStartTime);
+    }
+}
 void TaskManager::setRunMode(bool running)
 {
     std::vector<TaskBase*>::iterator it = mTasks.begin();
@@ -256,6 +586,25 @@ void TaskManager::setRunMode(bool running)
         ++it;
     }
 }
+const char* TaskManager::getTaskName(unsigned int index)
+{
+    if(index >= mTasks.size() || mTasks[index] == NULL)return NULL;
+    return mTasks[index]->mpName;
+}
+void TaskManager::setMinimumPeriod(unsigned long long period)
+{
+    if(period != mMinimumPeriod)Debug::print(LOG_DETAIL, "TaskManager: minimum period %llu us\r\n", period);
+    mMinimumPeriod = period;
+}
+unsigned long long TaskManager::getRunningMask()
+{
+    unsigned long long mask = 0;
+    for(unsigned int i = 0;i < mTasks.size() && i < 64;++i)
+    {
+        if(mTasks[i] != NULL && mTasks[i]->mIsRunning)mask |= 1ULL << i;
+    }
+    return mask;
+}
 bool TaskManager::executeFile(const char* path)
 {
     Debug::print(LOG_SUMMARY, "Reading %s...", path);
@@ -332,6 +681,13 @@ bool TaskManager::onCommand(const std::vector<std::string>& args)
             enumTasks();
             return true;
         }
+#ifdef USE_TASK_PROFILE
+        else if(args[0].compare("profile") == 0)
+        {
+            printProfile();
+            return true;
+        }
+#endif
 #ifdef USE_ALIAS
         else if(args[0].compare("alias") == 0)
         {
@@ -19,13 +19,47 @@
 #include <limits.h>
 #include <vector>
 #include <time.h>
+#include <pthread.h>
 #include "alias.h"
 
 #define USE_ALIAS
 #define USE_EXEC_SCRIPT
+#define USE_TASK_PROFILE
 
 class TaskManager;
 
+//タスクの各処理にかかった時間の統計(2のべき乗ごとに区切ったヒストグラム)
+//飛行中も有効にしておけるように、記録は固定サイズの配列への加算のみで行う
+class TaskProfile
+{
+public:
+    enum KIND {PROFILE_INIT, PROFILE_UPDATE, PROFILE_CLEAN, PROFILE_COMMAND, PROFILE_KIND_COUNT};
+    const static unsigned int BUCKET_COUNT = 32;//i番目のバケットは[2^i, 2^(i+1))nsの処理時間を数える
+private:
+    struct Histogram
+    {
+        unsigned int count;//呼び出し回数
+        unsigned int overrun;//予算時間を超えた回数
+        unsigned long long min,max;//最小/最大処理時間(ns)
+        unsigned int buckets[BUCKET_COUNT];
+    } mHistograms[PROFILE_KIND_COUNT];
+
+    //指定した割合の呼び出しが収まる処理時間(ns、バケットの上端で近似)
+    static unsigned long long getPercentile(const Histogram& histogram, unsigned int percent);
+public:
+    //計測用の現在時刻(ns)
+    static unsigned long long now();
+
+    //処理時間(ns)を記録する(budgetは予算時間(ns))
+    void add(KIND kind, unsigned long long elapsed, unsigned long long budget);
+    //統計を表示する(呼び出しのなかった処理は表示しない)
+    void print(const char* name) const;
+    //統計をリセットする
+    void reset();
+
+    TaskProfile();
+};
+
 //タスク基底クラス
 class TaskBase
 {
@@ -36,17 +70,43 @@ private:
     //タスクの状態を表す変数
     char* mpName;//タスク名
     unsigned int mPriority,mInterval;//タスク実行設定(優先度、実行間隔)
-    unsigned int mSlept;//実行がスキップされた回数
+    unsigned long long mPeriod,mDeadline;//実行周期と締め切り(us)
+    unsigned long long mNextUpdateTime;//次にonUpdateを呼び出す時刻(us)
+    unsigned int mUpdatedRound;//最後にonUpdateが呼ばれたTaskManagerのupdate回数
+    unsigned int mDeadlineMissCount;//締め切りまでにonUpdateが終わらなかった回数
     bool mIsRunning;//実行中
     bool mNewRunningState;//新しい実行状態
     unsigned int mInitializeRetryCount;//初期化失敗回数
+
+    //非同期初期化用の変数
+    bool mIsAsyncInit;//onInitを別スレッドで呼び出す
+    pthread_t mInitThread;
+    volatile bool mIsInitializing;//初期化スレッド実行中(結果の反映待ちを含む)
+    volatile bool mIsInitFinished;//初期化スレッドでonInitが終わった
+    bool mInitResult;//onInitの戻り値
+    struct timespec mInitTime;//onInitに渡す時刻
+    unsigned long long mInitElapsed;//onInitにかかった時間(ns)
+    static void* initThread(void* arg);
+#ifdef USE_TASK_PROFILE
+    TaskProfile mProfile;//各処理にかかった時間の統計
+#endif
 protected:
     //このタスクに名前を設定することでコマンドを受け付けるようにする
     void setName(const char* name);
 
     //このタスクに優先度(小さいほど先に実行される)と実行間隔(小さいほどたくさん実行する)を設定する
+    //実行間隔は(interval + 1) * TASK_TICK_PERIOD[us]の実行周期に換算される(UINT_MAXならonUpdateは呼ばれない)
     void setPriority(unsigned int pri,unsigned int interval);
 
+    //このタスクの実行周期と締め切り(周期の開始からonUpdateが終わるまでの時間)をマイクロ秒で設定する
+    //deadlineが0の場合は周期と同じ値になる
+    void setPeriod(unsigned long long period,unsigned long long deadline = 0);
+
+    //onInitを別スレッドで呼び出すようにする(初期化に時間がかかるタスク用)
+    //初期化中も他のタスクのonUpdateは呼ばれ続け、初期化が終わった時点で実行中状態になる
+    //onInitから他のタスクの状態を変更したり、他のスレッドと共有する変数に触れたりしないこと
+    void setAsyncInit(bool async);
+
     //このタスクを管理するTaskManagerのインスタンスを返す
     virtual TaskManager* getManager();
 
@@ -70,9 +130,10 @@ protected:
     */
     virtual bool onCommand(const std::vector<std::string>& args);
 
-    /* ある程度の時間ごとに呼び出される関数
+    /* 実行周期ごとに呼び出される関数
       数ms以内に処理を返すこと！！
       実行中状態の場合にのみ呼び出される
+      実行時刻を過ぎたタスクは締め切りの早い順に呼び出される
     */
     virtual void onUpdate(const struct timespec& time);
     ///////////////////////////////////////////////////
@@ -81,6 +142,9 @@ public:
     //このタスクの実行状態を返す
     bool isActive();
 
+    //このタスクが別スレッドで初期化中かどうかを返す(初期化中はisActiveはfalse)
+    bool isInitializing();
+
     //このタスクの実行状態を変更する(必要に応じてinit/cleanが呼ばれる)
     void setRunMode(bool running);
 
@@ -104,13 +168,32 @@ private:
             return riLeft->mPriority < riRight->mPriority;
         }
     };
+    unsigned int mUpdateRound;//updateが呼ばれた回数
+
+    //状態遷移の管理用
+    bool mIsTransitionPending;//実行状態の切り替えが済んでいない状態遷移がある
+    bool mIsInTransition;//状態遷移中(結果の表示待ち)
+    unsigned int mTransitionStoppedCount,mTransitionStartedCount;//状態遷移で停止/開始したタスク数
+    struct timespec mTransitionStartTime;//状態遷移の開始時刻
+
+    unsigned long long mMinimumPeriod;//全タスクの実行周期の下限(us、0なら制限なし)
+
     TaskManager();
     
     bool onCommand(const std::vector<std::string>& args);
     bool setRunModeByCommand(const std::string& name, bool state);
+    //初期化スレッドを開始する(失敗時はfalse)
+    bool startAsyncInit(TaskBase* pTask, const struct timespec& time);
+    //初期化スレッドの終了を待って結果を反映する
+    void finishAsyncInit(TaskBase* pTask);
     void enumTasks();
+#ifdef USE_TASK_PROFILE
+    //全タスクの処理時間の統計を表示してリセットする
+    void printProfile();
+#endif
 public:
     const static unsigned int TASK_MAX_INITIALIZE_RETRY_COUNT = 5;
+    const static unsigned int TASK_MAX_TRANSITION_PASS_COUNT = 3;//1回のupdateで実行状態の切り替えを繰り返す最大回数
     //インスタンスを取得
     static TaskManager* getInstance();
 
@@ -120,13 +203,29 @@ public:
     void clean();
     //指定されたコマンドを実行する(空白文字区切り)
     bool command(const std::string& arg);
-    //ある程度の時間ごとに呼び出すこと
+    //ある程度の時間ごとに呼び出すこと(実行時刻を過ぎたタスクのみ実行される)
     void update();
+    //次にタスクを実行する時刻までスリープする(最大TASK_MAX_SLEEP_PERIOD[us])
+    void wait();
     //指定されたタスクへのポインタを返す(NULLはエラー)
     TaskBase* get(const std::string& name);
 
     //全タスクの実行状態を変更する
     void setRunMode(bool running);
+
+    //優先度順でindex番目のタスクの名前を返す(範囲外ならNULL)
+    const char* getTaskName(unsigned int index);
+    //実行中のタスクを優先度順に先頭から64個までビットマスクで返す
+    unsigned long long getRunningMask();
+
+    //状態遷移を開始する(全タスクを停止予定にし、続けて必要なタスクをsetRunMode(true)すること)
+    //次のupdateで、不要になったタスクだけを開放し、新しく必要になったタスクだけを初期化する
+    //実行周期の下限(setMinimumPeriod)は解除される
+    void beginTransition();
+
+    //全タスクの実行周期の下限をマイクロ秒で設定する(0で解除)
+    //長時間待機する状態でメインループの実行頻度を下げ、消費電力を抑えるために使う
+    void setMinimumPeriod(unsigned long long period);
     
     //設定ファイルを実行する
     bool executeFile(const char* path);
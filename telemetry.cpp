@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string>
+#include "telemetry.h"
+#include "utils.h"
+
+int Telemetry::mFd = -1;
+unsigned char Telemetry::mBuffers[TELEMETRY_BUFFER_COUNT][TELEMETRY_BUFFER_SIZE];
+unsigned int Telemetry::mBufferSizes[TELEMETRY_BUFFER_COUNT];
+unsigned int Telemetry::mCurrent = 0, Telemetry::mPending = 0;
+unsigned short Telemetry::mSequence[TELEMETRY_CHANNEL_COUNT];
+unsigned int Telemetry::mLastEncoderL = 0, Telemetry::mLastEncoderR = 0;
+unsigned long long Telemetry::mRecordCount = 0, Telemetry::mByteCount = 0, Telemetry::mDroppedCount = 0;
+pthread_t Telemetry::mThread;
+pthread_mutex_t Telemetry::mMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t Telemetry::mCond = PTHREAD_COND_INITIALIZER;
+bool Telemetry::mIsRunning = false;
+
+bool Telemetry::start()
+{
+	if(mFd >= 0)return true;
+
+	std::string filename;
+	Filename("telemetry",".bin").get(filename);
+	mFd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if(mFd < 0)
+	{
+		Debug::print(LOG_SUMMARY, "Telemetry: Unable to open %s\r\n", filename.c_str());
+		return false;
+	}
+	memset(mSequence, 0, sizeof(mSequence));
+	mLastEncoderL = mLastEncoderR = 0;
+	mRecordCount = mByteCount = mDroppedCount = 0;
+	mCurrent = mPending = 0;
+	memset(mBufferSizes, 0, sizeof(mBufferSizes));
+	memcpy(mBuffers[mCurrent], TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+	mBufferSizes[mCurrent] = sizeof(TELEMETRY_MAGIC);
+
+	//SDカードへの書き込みは専用のスレッドで行う(スレッドが作れない場合はflush時に直接書き込む)
+	mIsRunning = true;
+	if(pthread_create(&mThread, NULL, writerThread, NULL) != 0)
+	{
+		mIsRunning = false;
+		Debug::print(LOG_SUMMARY, "Telemetry: Unable to create thread, writing synchronously\r\n");
+	}
+
+	Debug::print(LOG_SUMMARY, "Telemetry: %s\r\n", filename.c_str());
+	return true;
+}
+void Telemetry::stop()
+{
+	if(mFd < 0)return;
+	submit();
+
+	//書き込み待ちのバッファをすべて書き込んでからスレッドを終了する
+	pthread_mutex_lock(&mMutex);
+	bool isRunning = mIsRunning;
+	mIsRunning = false;
+	pthread_cond_signal(&mCond);
+	pthread_mutex_unlock(&mMutex);
+	if(isRunning)pthread_join(mThread, NULL);
+
+	close(mFd);
+	mFd = -1;
+	Debug::print(LOG_SUMMARY, "Telemetry: %llu records (%llu bytes) written, %llu dropped\r\n", mRecordCount, mByteCount, mDroppedCount);
+}
+void Telemetry::flush()
+{
+	if(mFd < 0)return;
+	submit();
+}
+bool Telemetry::isActive()
+{
+	return mFd >= 0;
+}
+bool Telemetry::submit()
+{
+	if(mBufferSizes[mCurrent] == 0)return true;
+	if(!mIsRunning)
+	{
+		writeBuffer(mCurrent);
+		return true;
+	}
+
+	pthread_mutex_lock(&mMutex);
+	bool isFree = mPending + 1 < TELEMETRY_BUFFER_COUNT;
+	if(isFree)
+	{
+		++mPending;
+		mCurrent = (mCurrent + 1) % TELEMETRY_BUFFER_COUNT;
+		pthread_cond_signal(&mCond);
+	}
+	pthread_mutex_unlock(&mMutex);
+	return isFree;
+}
+void* Telemetry::writerThread(void* arg)
+{
+	pthread_mutex_lock(&mMutex);
+	while(true)
+	{
+		//stopが呼ばれても書き込み待ちのバッファは書き込む
+		while(mIsRunning && mPending == 0)pthread_cond_wait(&mCond, &mMutex);
+		if(mPending == 0)break;
+		unsigned int index = (mCurrent + TELEMETRY_BUFFER_COUNT - mPending) % TELEMETRY_BUFFER_COUNT;
+		pthread_mutex_unlock(&mMutex);
+
+		writeBuffer(index);
+
+		pthread_mutex_lock(&mMutex);
+		--mPending;
+	}
+	pthread_mutex_unlock(&mMutex);
+	return NULL;
+}
+void Telemetry::writeBuffer(unsigned int index)
+{
+	const unsigned char* pBuffer = mBuffers[index];
+	unsigned int size = mBufferSizes[index];
+	unsigned int written = 0;
+	while(written < size)
+	{
+		ssize_t result = ::write(mFd, pBuffer + written, size - written);
+		if(result < 0)
+		{
+			if(errno == EINTR)continue;
+			Debug::print(LOG_DETAIL, "Telemetry: write failed\r\n");
+			break;
+		}
+		written += result;
+	}
+	mBufferSizes[index] = 0;
+
+	pthread_mutex_lock(&mMutex);
+	mByteCount += written;
+	pthread_mutex_unlock(&mMutex);
+}
+void Telemetry::write(TELEMETRY_CHANNEL channel, const struct timespec& time, TelemetryHeader& header, unsigned int size)
+{
+	header.time = Time::toMicroseconds(time);
+	header.channel = channel;
+	header.size = size;
+	header.sequence = mSequence[channel]++;
+
+	//バッファが一杯なら書き込みスレッドに渡して次のバッファに記録する(空きが無ければ捨てる)
+	if(mBufferSizes[mCurrent] + size > TELEMETRY_BUFFER_SIZE && !submit())
+	{
+		++mDroppedCount;
+		return;
+	}
+	memcpy(mBuffers[mCurrent] + mBufferSizes[mCurrent], &header, size);
+	mBufferSizes[mCurrent] += size;
+	++mRecordCount;
+}
+
+void Telemetry::writeGyro(const struct timespec& time, short x, short y, short z)
+{
+	if(mFd < 0)return;
+	TelemetryGyro record;
+	record.x = x;
+	record.y = y;
+	record.z = z;
+	write(TELEMETRY_GYRO, time, record.header, sizeof(record));
+}
+void Telemetry::writeAccel(const struct timespec& time, short x, short y, short z)
+{
+	if(mFd < 0)return;
+	TelemetryAccel record;
+	record.x = x;
+	record.y = y;
+	record.z = z;
+	write(TELEMETRY_ACCEL, time, record.header, sizeof(record));
+}
+void Telemetry::writePressure(const struct timespec& time, unsigned int padc, unsigned int tadc, float pressure)
+{
+	if(mFd < 0)return;
+	TelemetryPressure record;
+	record.padc = padc;
+	record.tadc = tadc;
+	record.pressure = pressure;
+	write(TELEMETRY_PRESSURE, time, record.header, sizeof(record));
+}
+void Telemetry::writeGPS(const struct timespec& time, int longitude, int latitude, int altitude, int course, int speed, int satelites)
+{
+	if(mFd < 0)return;
+	TelemetryGPS record;
+	record.longitude = longitude;
+	record.latitude = latitude;
+	record.altitude = altitude;
+	record.course = course;
+	record.speed = speed;
+	record.satelites = satelites;
+	record.reserved = 0;
+	write(TELEMETRY_GPS, time, record.header, sizeof(record));
+}
+void Telemetry::writeEncoder(const struct timespec& time, unsigned long long left, unsigned long long right)
+{
+	if(mFd < 0)return;
+	//パルス数が変化していなければ記録しない
+	if((unsigned int)left == mLastEncoderL && (unsigned int)right == mLastEncoderR && mSequence[TELEMETRY_ENCODER] != 0)return;
+	mLastEncoderL = left;
+	mLastEncoderR = right;
+
+	TelemetryEncoder record;
+	record.left = left;
+	record.right = right;
+	write(TELEMETRY_ENCODER, time, record.header, sizeof(record));
+}
@@ -0,0 +1,106 @@
+/*
+	テレメトリ記録クラス
+
+	センサの値をサンプルごとに固定長のバイナリレコードとして1つのファイル(telemetry*.bin)に追記します
+	・ファイルの先頭はTELEMETRY_MAGIC、以降は[TelemetryHeader][チャンネルごとの値]のレコードが続く
+	・値はセンサから読んだ生の値のまま保存し、単位の変換はPC側で行う
+	・記録はバッファへのコピーのみ行い、バッファが一杯になるかflushを呼んだときに書き込みスレッドに渡してwriteする
+	・書き込みが遅れてすべてのバッファが埋まった場合はレコードを捨て、捨てた数を記録する
+	・PCではmake telemetry_convertで作成される変換ツールでチャンネルごとのCSVに変換できます
+	・SensorLoggingタスクの実行中のみ記録します
+*/
+#pragma once
+#include <time.h>
+#include <pthread.h>
+#include "constants.h"
+
+const static char TELEMETRY_MAGIC[8] = {'R','O','V','E','T','L','M','2'};
+
+enum TELEMETRY_CHANNEL
+{
+	TELEMETRY_GYRO = 1,		//L3GD20のFIFOの1サンプル
+	TELEMETRY_ACCEL,		//MMA8451QのFIFOの1サンプル
+	TELEMETRY_PRESSURE,		//MPL115A2の値
+	TELEMETRY_GPS,			//Navigatronの新しい座標
+	TELEMETRY_ENCODER,		//エンコーダのパルス数(変化した場合のみ)
+	TELEMETRY_CHANNEL_COUNT
+};
+
+#pragma pack(push, 1)
+struct TelemetryHeader
+{
+	unsigned long long time;//Time::getの時刻(us)
+	unsigned char channel;
+	unsigned char size;//ヘッダを含むレコードの大きさ
+	unsigned short sequence;//チャンネルごとの通し番号(欠落の確認用)
+};
+struct TelemetryGyro
+{
+	TelemetryHeader header;
+	short x, y, z;//生の値(0.070dps/LSB)
+};
+struct TelemetryAccel
+{
+	TelemetryHeader header;
+	short x, y, z;//1/1024G/LSB(MMA8451Qの±8Gレンジの値)
+};
+struct TelemetryPressure
+{
+	TelemetryHeader header;
+	unsigned short padc, tadc;//気圧と温度のADC値
+	float pressure;//補正後の気圧(hPa)
+};
+struct TelemetryGPS
+{
+	TelemetryHeader header;
+	int longitude, latitude;//1e-7度単位
+	short altitude;//m
+	short course;//0.1度単位
+	short speed;//0.01単位
+	unsigned char satelites;
+	unsigned char reserved;
+};
+struct TelemetryEncoder
+{
+	TelemetryHeader header;
+	unsigned int left, right;//累積パルス数
+};
+#pragma pack(pop)
+
+class Telemetry
+{
+	static int mFd;
+	//記録中のバッファ(mCurrent)と、その前のmPending個のバッファが書き込み待ち
+	static unsigned char mBuffers[TELEMETRY_BUFFER_COUNT][TELEMETRY_BUFFER_SIZE];
+	static unsigned int mBufferSizes[TELEMETRY_BUFFER_COUNT];
+	static unsigned int mCurrent, mPending;
+	static unsigned short mSequence[TELEMETRY_CHANNEL_COUNT];
+	static unsigned int mLastEncoderL, mLastEncoderR;
+	static unsigned long long mRecordCount, mByteCount, mDroppedCount;
+
+	//書き込みスレッド(mPendingとmByteCountはmMutexで保護)
+	static pthread_t mThread;
+	static pthread_mutex_t mMutex;
+	static pthread_cond_t mCond;
+	static bool mIsRunning;
+
+	static void* writerThread(void* arg);
+	static void writeBuffer(unsigned int index);
+	//記録中のバッファを書き込みスレッドに渡す(空きバッファが無ければfalse)
+	static bool submit();
+	static void write(TELEMETRY_CHANNEL channel, const struct timespec& time, TelemetryHeader& header, unsigned int size);
+public:
+	//新しいファイルを作成して記録を開始する
+	static bool start();
+	//残りを書き込んで記録を終了する
+	static void stop();
+	//バッファの内容を書き込みスレッドに渡す(書き込みは待たない)
+	static void flush();
+	static bool isActive();
+
+	static void writeGyro(const struct timespec& time, short x, short y, short z);
+	static void writeAccel(const struct timespec& time, short x, short y, short z);
+	static void writePressure(const struct timespec& time, unsigned int padc, unsigned int tadc, float pressure);
+	static void writeGPS(const struct timespec& time, int longitude, int latitude, int altitude, int course, int speed, int satelites);
+	static void writeEncoder(const struct timespec& time, unsigned long long left, unsigned long long right);
+};
@@ -0,0 +1,151 @@
+/*
+	テレメトリ変換ツール(PC用)
+
+	Telemetryクラスが記録したバイナリファイルをチャンネルごとのCSVファイルに変換します
+	・ビルド：make telemetry_convert
+	・使い方：./telemetry_convert telemetry1.bin [出力ファイル名の先頭]
+	  telemetry1_gyro.csvのようにチャンネルごとに1ファイル出力します(時刻は記録開始からの秒)
+*/
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "telemetry.h"
+
+struct ChannelInfo
+{
+	const char* name;
+	const char* columns;
+	unsigned int size;
+};
+const static ChannelInfo CHANNEL_INFO[TELEMETRY_CHANNEL_COUNT] =
+{
+	{NULL, NULL, 0},
+	{"gyro", "time,sequence,x[dps],y[dps],z[dps]", sizeof(TelemetryGyro)},
+	{"accel", "time,sequence,x[G],y[G],z[G]", sizeof(TelemetryAccel)},
+	{"pressure", "time,sequence,padc,tadc,pressure[hPa]", sizeof(TelemetryPressure)},
+	{"gps", "time,sequence,longitude,latitude,altitude,course,speed,satelites", sizeof(TelemetryGPS)},
+	{"encoder", "time,sequence,left,right", sizeof(TelemetryEncoder)},
+};
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s [telemetry file] [output prefix]\n", argv[0]);
+		return 1;
+	}
+	std::string prefix;
+	if(argc >= 3)prefix = argv[2];
+	else
+	{
+		prefix = argv[1];
+		std::string::size_type pos = prefix.rfind('.');
+		if(pos != std::string::npos)prefix.erase(pos);
+	}
+
+	FILE* pInput = fopen(argv[1], "rb");
+	if(pInput == NULL)
+	{
+		fprintf(stderr, "Unable to open %s\n", argv[1]);
+		return 1;
+	}
+	std::vector<unsigned char> data;
+	unsigned char buf[65536];
+	size_t size;
+	while((size = fread(buf, 1, sizeof(buf), pInput)) > 0)data.insert(data.end(), buf, buf + size);
+	fclose(pInput);
+
+	if(data.size() < sizeof(TELEMETRY_MAGIC) || memcmp(&data[0], TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC)) != 0)
+	{
+		fprintf(stderr, "%s is not a telemetry file\n", argv[1]);
+		return 1;
+	}
+
+	FILE* pOutputs[TELEMETRY_CHANNEL_COUNT] = {NULL};
+	unsigned long long counts[TELEMETRY_CHANNEL_COUNT] = {0}, gaps[TELEMETRY_CHANNEL_COUNT] = {0};
+	unsigned short nextSequence[TELEMETRY_CHANNEL_COUNT] = {0};
+	unsigned long long startTime = 0, unknownCount = 0;
+	size_t pos = sizeof(TELEMETRY_MAGIC);
+	while(pos + sizeof(TelemetryHeader) <= data.size())
+	{
+		TelemetryHeader header;
+		memcpy(&header, &data[pos], sizeof(header));
+		if(header.size < sizeof(TelemetryHeader) || pos + header.size > data.size())break;//途中で切れている
+
+		//知らないチャンネルや大きさの違うレコードは読み飛ばす
+		if(header.channel == 0 || header.channel >= TELEMETRY_CHANNEL_COUNT || header.size != CHANNEL_INFO[header.channel].size)
+		{
+			++unknownCount;
+			pos += header.size;
+			continue;
+		}
+		const ChannelInfo& info = CHANNEL_INFO[header.channel];
+		if(pOutputs[header.channel] == NULL)
+		{
+			std::string filename = prefix + "_" + info.name + ".csv";
+			pOutputs[header.channel] = fopen(filename.c_str(), "w");
+			if(pOutputs[header.channel] == NULL)
+			{
+				fprintf(stderr, "Unable to create %s\n", filename.c_str());
+				return 1;
+			}
+			fprintf(pOutputs[header.channel], "%s\n", info.columns);
+		}
+		if(counts[header.channel] != 0 && header.sequence != nextSequence[header.channel])gaps[header.channel] += (unsigned short)(header.sequence - nextSequence[header.channel]);
+		nextSequence[header.channel] = header.sequence + 1;
+		if(startTime == 0)startTime = header.time;
+		++counts[header.channel];
+
+		FILE* pOutput = pOutputs[header.channel];
+		fprintf(pOutput, "%.6f,%u,", (header.time - startTime) / 1000000.0, header.sequence);
+		switch(header.channel)
+		{
+		case TELEMETRY_GYRO:
+			{
+				TelemetryGyro record;
+				memcpy(&record, &data[pos], sizeof(record));
+				fprintf(pOutput, "%.3f,%.3f,%.3f\n", record.x * 0.070, record.y * 0.070, record.z * 0.070);
+			}
+			break;
+		case TELEMETRY_ACCEL:
+			{
+				TelemetryAccel record;
+				memcpy(&record, &data[pos], sizeof(record));
+				fprintf(pOutput, "%.4f,%.4f,%.4f\n", record.x / 1024.0, record.y / 1024.0, record.z / 1024.0);
+			}
+			break;
+		case TELEMETRY_PRESSURE:
+			{
+				TelemetryPressure record;
+				memcpy(&record, &data[pos], sizeof(record));
+				fprintf(pOutput, "%u,%u,%.2f\n", record.padc, record.tadc, record.pressure);
+			}
+			break;
+		case TELEMETRY_GPS:
+			{
+				TelemetryGPS record;
+				memcpy(&record, &data[pos], sizeof(record));
+				fprintf(pOutput, "%.7f,%.7f,%d,%.1f,%.2f,%u\n", record.longitude / 10000000.0, record.latitude / 10000000.0, record.altitude, record.course / 10.0, record.speed / 100.0, record.satelites);
+			}
+			break;
+		case TELEMETRY_ENCODER:
+			{
+				TelemetryEncoder record;
+				memcpy(&record, &data[pos], sizeof(record));
+				fprintf(pOutput, "%u,%u\n", record.left, record.right);
+			}
+			break;
+		}
+		pos += header.size;
+	}
+
+	for(int i = 1;i < TELEMETRY_CHANNEL_COUNT;++i)
+	{
+		if(pOutputs[i] != NULL)fclose(pOutputs[i]);
+		if(counts[i] != 0)printf("%-9s %llu records, %llu missing\n", CHANNEL_INFO[i].name, counts[i], gaps[i]);
+	}
+	if(unknownCount != 0)printf("%llu unknown records skipped\n", unknownCount);
+	if(pos != data.size())printf("%u bytes at the end were truncated\n", (unsigned int)(data.size() - pos));
+	return 0;
+}
@@ -11,15 +11,11 @@
 #include <fcntl.h>
 #include <time.h>
 #include "utils.h"
+#include "recorder.h"
+#include "logger.h"
 
 void Debug::print(LOG_LEVEL level, const char* fmt, ... )
 {
-	static std::string mFilename;
-	if(mFilename.length() == 0)
-	{
-		Filename filename("log",".txt");
-		filename.get(mFilename);
-	}
 #ifndef _LOG_DETAIL
 	if(level == LOG_DETAIL)return; //デバッグモードでなければログ出力しない
 #endif
@@ -28,16 +24,15 @@ void Debug::print(LOG_LEVEL level, const char* fmt, ... )
 
 	va_list argp;
 	va_start(argp, fmt);
-	vsprintf(buf, fmt, argp);
+	int length = vsnprintf(buf, sizeof(buf), fmt, argp);
+	va_end(argp);
+	if(length < 0)return;
+	if((unsigned int)length >= sizeof(buf))length = sizeof(buf) - 1;//長すぎる場合は切り詰める
 	
 	//画面に出力
-	printf(buf);
-	//ログファイルに出力
-	if(level != LOG_PRINT)
-	{
-		std::ofstream of(mFilename.c_str(),std::ios::out | std::ios::app);
-		of << buf;
-	}
+	fputs(buf, stdout);
+	//ログファイルに出力(書き込みはLoggerのスレッドが行うため待たない)
+	if(level != LOG_PRINT)Logger::push(buf, length);
 }
 void Filename::get(std::string& name)
 {
@@ -76,10 +71,21 @@ double Time::dt(const struct timespec& now, const struct timespec& last)
 }
 void Time::get(struct timespec& time)
 {
+	//再生中は記録された時刻を返す(仮想時計)
+	if(Recorder::isReplaying())
+	{
+		Recorder::replayTime(time);
+		return;
+	}
 	if(clock_gettime(CLOCK_MONOTONIC_RAW,&time) != 0)
 	{
 		Debug::print(LOG_DETAIL, "FAILED to get time!\r\n");
 	}
+	Recorder::recordTime(time);
+}
+unsigned long long Time::toMicroseconds(const struct timespec& time)
+{
+	return (unsigned long long)time.tv_sec * 1000000 + time.tv_nsec / 1000;
 }
 void Time::showNowTime()
 {
@@ -316,6 +322,61 @@ VECTOR3 VECTOR3::normalize() const
 VECTOR3::VECTOR3() : x(0),y(0),z(0){}
 VECTOR3::VECTOR3(double tx, double ty, double tz) : x(tx),y(ty),z(tz){}
 
+void RunningStatistics::add(const VECTOR3& sample)
+{
+	++mCount;
+	VECTOR3 delta = sample - mMean;
+	mMean += delta / mCount;
+	VECTOR3 delta2 = sample - mMean;
+	mM2.x += delta.x * delta2.x;
+	mM2.y += delta.y * delta2.y;
+	mM2.z += delta.z * delta2.z;
+}
+void RunningStatistics::merge(const RunningStatistics& other)
+{
+	if(other.mCount == 0)return;
+	if(mCount == 0)
+	{
+		*this = other;
+		return;
+	}
+	double count = (double)mCount + other.mCount;
+	double weight = (double)mCount * other.mCount / count;
+	VECTOR3 delta = other.mMean - mMean;
+	mMean += delta * (other.mCount / count);
+	mM2.x += other.mM2.x + delta.x * delta.x * weight;
+	mM2.y += other.mM2.y + delta.y * delta.y * weight;
+	mM2.z += other.mM2.z + delta.z * delta.z * weight;
+	mCount += other.mCount;
+}
+void RunningStatistics::limit(unsigned int maxCount)
+{
+	if(mCount <= maxCount)return;
+	mM2 *= (double)maxCount / mCount;
+	mCount = maxCount;
+}
+void RunningStatistics::reset()
+{
+	mCount = 0;
+	mMean = mM2 = VECTOR3();
+}
+unsigned int RunningStatistics::getCount() const
+{
+	return mCount;
+}
+const VECTOR3& RunningStatistics::getMean() const
+{
+	return mMean;
+}
+VECTOR3 RunningStatistics::getVariance() const
+{
+	if(mCount < 2)return VECTOR3();
+	return mM2 / (mCount - 1);
+}
+RunningStatistics::RunningStatistics() : mCount(0),mMean(),mM2()
+{
+}
+
 QUATERNION::QUATERNION() : x(0), y(0), z(0), w(1)
 {
 }
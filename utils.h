@@ -54,7 +54,7 @@ public:
 /*
  * Timespec 8-24 chou
  */
-#ifndef __timespec_defined
+#if !defined(__timespec_defined) && !defined(_STRUCT_TIMESPEC)
 #define __timespec_defined
 struct timespec {
   time_t  tv_sec;   // Seconds
@@ -69,6 +69,8 @@ public:
     static double dt(const struct timespec& now,const struct timespec& last);
 	//現在時刻を取得
     static void get(struct timespec& time);
+	//時刻をマイクロ秒に変換
+	static unsigned long long toMicroseconds(const struct timespec& time);
 	//現在時刻をログに出力する
 	static void showNowTime();
 };
@@ -154,6 +156,27 @@ public:
 	VECTOR3 normalize() const;//8-24 chou
 };
 
+//3軸の平均と分散を1サンプルずつ更新するクラス(Welfordの方法、メモリを確保しない)
+class RunningStatistics
+{
+	unsigned int mCount;
+	VECTOR3 mMean;
+	VECTOR3 mM2;//平均との差の2乗和
+public:
+	void add(const VECTOR3& sample);
+	//別の統計を足し合わせる
+	void merge(const RunningStatistics& other);
+	//サンプル数がmaxCountを超えていれば平均を変えずにサンプル数を減らす(以降は古いサンプルほど重みが下がる)
+	void limit(unsigned int maxCount);
+	void reset();
+
+	unsigned int getCount() const;
+	const VECTOR3& getMean() const;
+	VECTOR3 getVariance() const;//標本分散
+
+	RunningStatistics();
+};
+
 //3Dの角度を扱うときに便利なクラス
 // 参考: https://svn.code.sf.net/p/irrlicht/code/trunk/include/quaternion.h
 class QUATERNION
@@ -0,0 +1,179 @@
+#include "video_recorder.h"
+#include "utils.h"
+
+bool VideoRecorder::start(const std::string& filename)
+{
+	if(isRecording())return false;
+	join();
+
+	pthread_mutex_lock(&mMutex);
+	mFilename = filename;
+	mpWriter = NULL;
+	mpLastImage = NULL;
+	mWrittenCount = 0;
+	mReceivedCount = mDroppedCount = mRepeatedCount = 0;
+	mTotalEncodeTime = mMaxEncodeTime = 0;
+
+	mIsRunning = true;
+	if(pthread_create(&mThread, NULL, recorderThread, this) != 0)
+	{
+		mIsRunning = false;
+		pthread_mutex_unlock(&mMutex);
+		Debug::print(LOG_SUMMARY, "VideoRecorder: Failed to start thread\r\n");
+		return false;
+	}
+	mHasThread = true;
+	pthread_mutex_unlock(&mMutex);
+	return true;
+}
+bool VideoRecorder::push(SharedImage* pImage, const struct timespec& time)
+{
+	pthread_mutex_lock(&mMutex);
+	if(!mIsRunning || mCount == VIDEO_RECORDER_QUEUE_SIZE)
+	{
+		if(mIsRunning)++mDroppedCount;
+		pthread_mutex_unlock(&mMutex);
+		pImage->release();
+		return false;
+	}
+	Job& job = mJobs[(mHead + mCount++) % VIDEO_RECORDER_QUEUE_SIZE];
+	job.pImage = pImage;
+	job.time = time;
+	++mReceivedCount;
+	pthread_cond_signal(&mCond);
+	pthread_mutex_unlock(&mMutex);
+	return true;
+}
+void VideoRecorder::stop()
+{
+	pthread_mutex_lock(&mMutex);
+	mIsRunning = false;
+	pthread_cond_signal(&mCond);
+	pthread_mutex_unlock(&mMutex);
+}
+void VideoRecorder::join()
+{
+	stop();
+	if(!mHasThread)return;
+	pthread_join(mThread, NULL);
+	mHasThread = false;
+}
+bool VideoRecorder::isRecording()
+{
+	pthread_mutex_lock(&mMutex);
+	bool isRunning = mIsRunning;
+	pthread_mutex_unlock(&mMutex);
+	return isRunning;
+}
+void* VideoRecorder::recorderThread(void* arg)
+{
+	((VideoRecorder*)arg)->run();
+	return NULL;
+}
+void VideoRecorder::run()
+{
+	pthread_mutex_lock(&mMutex);
+	while(true)
+	{
+		//stopが呼ばれても残りのフレームは書き込む
+		while(mIsRunning && mCount == 0)pthread_cond_wait(&mCond, &mMutex);
+		if(mCount == 0)break;
+
+		Job job = mJobs[mHead];
+		mJobs[mHead].pImage = NULL;
+		mHead = (mHead + 1) % VIDEO_RECORDER_QUEUE_SIZE;
+		--mCount;
+		pthread_mutex_unlock(&mMutex);
+
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		unsigned int repeated = mWrittenCount;
+		bool result = write(job);
+		repeated = mWrittenCount - repeated;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+		double elapsed = Time::dt(end, start);
+		pthread_mutex_lock(&mMutex);
+		if(result)
+		{
+			if(repeated > 1)mRepeatedCount += repeated - 1;
+			mTotalEncodeTime += elapsed;
+			if(elapsed > mMaxEncodeTime)mMaxEncodeTime = elapsed;
+		}else ++mDroppedCount;
+	}
+	unsigned int droppedCount = mDroppedCount;
+	pthread_mutex_unlock(&mMutex);
+
+	//ファイルを閉じる(ここでインデックスが書き込まれる)
+	if(mpLastImage != NULL)mpLastImage->release();
+	mpLastImage = NULL;
+	if(mpWriter == NULL)return;
+	cvReleaseVideoWriter(&mpWriter);
+	Debug::print(LOG_SUMMARY, "VideoRecorder: %s was saved (%u frames, %u dropped)\r\n", mFilename.c_str(), mWrittenCount, droppedCount);
+}
+bool VideoRecorder::write(const Job& job)
+{
+	IplImage* pImage = job.pImage->get();
+	if(mpWriter == NULL)
+	{
+		mpWriter = cvCreateVideoWriter(mFilename.c_str(), CV_FOURCC('M','J','P','G'), VIDEO_RECORDER_FPS, cvSize(pImage->width, pImage->height));
+		if(mpWriter == NULL)
+		{
+			job.pImage->release();
+			Debug::print(LOG_SUMMARY, "VideoRecorder: Failed to open %s\r\n", mFilename.c_str());
+			return false;
+		}
+		mStartTime = job.time;
+		Debug::print(LOG_SUMMARY, "VideoRecorder: Recording %s (%dx%d)\r\n", mFilename.c_str(), pImage->width, pImage->height);
+	}
+
+	//フレームの時刻に対応する位置を求める(既にその位置まで書き込んでいれば捨てる)
+	double dt = Time::dt(job.time, mStartTime);
+	unsigned int position = dt > 0 ? (unsigned int)(dt * VIDEO_RECORDER_FPS + 0.5) : 0;
+	if(position < mWrittenCount)
+	{
+		job.pImage->release();
+		return true;
+	}
+
+	//取りこぼした位置は直前のフレームを繰り返して埋める(最大VIDEO_RECORDER_FPS枚まで)
+	unsigned int gap = position - mWrittenCount;
+	if(gap > VIDEO_RECORDER_FPS)gap = VIDEO_RECORDER_FPS;
+	for(unsigned int i = 0;i < gap && mpLastImage != NULL;++i)
+	{
+		cvWriteFrame(mpWriter, mpLastImage->get());
+		++mWrittenCount;
+	}
+	cvWriteFrame(mpWriter, pImage);
+	++mWrittenCount;
+
+	//このフレームを次の穴埋め用に残す
+	if(mpLastImage != NULL)mpLastImage->release();
+	mpLastImage = job.pImage;
+	return true;
+}
+void VideoRecorder::showState()
+{
+	pthread_mutex_lock(&mMutex);
+	if(!mIsRunning)Debug::print(LOG_SUMMARY, "VideoRecorder: stopped\r\n");
+	else
+	{
+		Debug::print(LOG_SUMMARY, "VideoRecorder: recording %s, %u queued\r\n", mFilename.c_str(), mCount);
+		Debug::print(LOG_SUMMARY, " Received %u (avg %.0f ms, max %.0f ms), repeated %u, dropped %u\r\n", mReceivedCount,
+			mReceivedCount == 0 ? 0 : mTotalEncodeTime / mReceivedCount * 1000, mMaxEncodeTime * 1000, mRepeatedCount, mDroppedCount);
+	}
+	pthread_mutex_unlock(&mMutex);
+}
+VideoRecorder::VideoRecorder() : mHead(0), mCount(0), mIsRunning(false), mHasThread(false), mpWriter(NULL), mpLastImage(NULL), mWrittenCount(0),
+	mReceivedCount(0), mDroppedCount(0), mRepeatedCount(0), mTotalEncodeTime(0), mMaxEncodeTime(0)
+{
+	for(unsigned int i = 0;i < VIDEO_RECORDER_QUEUE_SIZE;++i)mJobs[i].pImage = NULL;
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mCond, NULL);
+}
+VideoRecorder::~VideoRecorder()
+{
+	join();
+	pthread_cond_destroy(&mCond);
+	pthread_mutex_destroy(&mMutex);
+}
@@ -0,0 +1,68 @@
+/*
+	動画記録キュー
+
+	カメラのフレームを動画ファイルにエンコードして書き込む処理を専用のスレッドで行います
+	・フレームは参照カウント付き(SharedImage)で受け取り、呼び出し元はキューに積むだけで待たされない
+	・キューが一杯の場合はフレームを捨て、捨てた数を記録する
+	・フレームの時刻からVIDEO_RECORDER_FPSでの位置を求め、取りこぼした分は直前のフレームを繰り返して再生時間を合わせる
+	・stopは終了を指示するだけで待たない。スレッドは残りのフレームをすべて書き込んでからファイルを閉じて終了する(末尾が失われない)
+	・終了したスレッドは次のstartかjoinで回収する
+*/
+#pragma once
+#include <pthread.h>
+#include <time.h>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "constants.h"
+#include "image_saver.h"
+
+class VideoRecorder
+{
+	//書き込み待ちのフレーム
+	struct Job
+	{
+		SharedImage* pImage;
+		struct timespec time;//取り込んだ時刻
+	};
+	Job mJobs[VIDEO_RECORDER_QUEUE_SIZE];
+	unsigned int mHead, mCount;
+
+	pthread_t mThread;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mCond;
+	bool mIsRunning;//フレームを受け付けているか
+	bool mHasThread;//回収していないスレッドがあるか(呼び出し側のスレッドのみが使う)
+
+	//以下は書き込みスレッドのみが使う(start/stopの間)
+	std::string mFilename;
+	CvVideoWriter* mpWriter;//最初のフレームで画像サイズが決まってから開く
+	SharedImage* mpLastImage;//最後に書き込んだフレーム(取りこぼした分の穴埋めに使う)
+	struct timespec mStartTime;//最初のフレームの時刻
+	unsigned int mWrittenCount;//書き込んだフレームの数(繰り返した分を含む)
+
+	//統計(mMutexで保護)
+	unsigned int mReceivedCount, mDroppedCount, mRepeatedCount;
+	double mTotalEncodeTime, mMaxEncodeTime;//1フレームのエンコードと書き込みにかかった時間(秒)
+
+	static void* recorderThread(void* arg);
+	void run();
+	//1フレーム書き込む(書き込みスレッドから呼ぶ)
+	bool write(const Job& job);
+public:
+	//filenameに記録を開始する(記録中ならfalse、前回の記録の書き込みが残っていれば終わるまで待つ)
+	bool start(const std::string& filename);
+	//フレームを書き込み待ちにする(pImageの参照は書き込みが終わるか捨てられたときに解放される)
+	//記録中でないかキューが一杯ならfalseを返す
+	bool push(SharedImage* pImage, const struct timespec& time);
+	//記録を終了する(残りのフレームの書き込みとファイルを閉じるのはスレッドが行い、ここでは待たない)
+	void stop();
+	//スレッドが残りのフレームを書き込んで終了するまで待つ
+	void join();
+	bool isRecording();
+
+	//記録中のファイルと統計を表示する
+	void showState();
+
+	VideoRecorder();
+	~VideoRecorder();
+};